@@ -0,0 +1,235 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Huge page backed arenas, see cityhash-arena.h.
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "cityhash-arena.h"
+
+// size classes of 16 bytes to 512 KiB
+#define KMIN_CLASS (4)
+#define KCLASSES (16)
+
+struct cityhash_arena {
+  uint8_t* base;
+  size_t capacity;
+  size_t used;
+  size_t mapped; // bytes to unmap, from base
+  int backing;
+  void* free[KCLASSES];
+};
+
+// a free block holds the next one of its class
+struct free_block {
+  struct free_block* next;
+};
+
+struct cityhash_arena* cityhash_arena_create(size_t capacity, int flags) {
+
+  size_t size = (capacity + CITYHASH_HUGE_PAGE - 1) & ~(CITYHASH_HUGE_PAGE - 1);
+  struct cityhash_arena* arena;
+  uint8_t* p = MAP_FAILED;
+
+  if (size == 0)
+    size = CITYHASH_HUGE_PAGE;
+
+  arena = malloc(sizeof(*arena));
+
+  if (arena == NULL)
+    return NULL;
+
+  memset(arena, 0, sizeof(*arena));
+
+#if defined(MAP_HUGETLB)
+  if (flags & CITYHASH_ARENA_HUGETLB) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (p != MAP_FAILED) {
+      arena->backing = CITYHASH_ARENA_HUGETLB;
+      arena->mapped = size;
+    }
+  }
+#endif
+
+  // regular pages, over-mapped by a huge page and trimmed so that the range
+  // starts on a huge page boundary, which THP needs to use whole huge pages
+  if (p == MAP_FAILED) {
+
+    uint8_t* m = mmap(NULL, size + CITYHASH_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (m == MAP_FAILED) {
+      free(arena);
+      return NULL;
+    }
+
+    size_t head = -(uintptr_t)m & (CITYHASH_HUGE_PAGE - 1);
+
+    if (head > 0)
+      munmap(m, head);
+
+    munmap(m + head + size, CITYHASH_HUGE_PAGE - head);
+
+    p = m + head;
+    arena->mapped = size;
+
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+    if ((flags & CITYHASH_ARENA_THP) && madvise(p, size, MADV_HUGEPAGE) == 0)
+      arena->backing = CITYHASH_ARENA_THP;
+    else if (!(flags & CITYHASH_ARENA_THP))
+      madvise(p, size, MADV_NOHUGEPAGE);
+#endif
+  }
+
+  arena->base = p;
+  arena->capacity = size;
+
+  return arena;
+}
+
+void cityhash_arena_destroy(struct cityhash_arena* arena) {
+
+  if (arena == NULL)
+    return;
+
+  munmap(arena->base, arena->mapped);
+  free(arena);
+}
+
+int cityhash_arena_backing(const struct cityhash_arena* arena) {
+  return arena->backing;
+}
+
+void* cityhash_arena_base(const struct cityhash_arena* arena) {
+  return arena->base;
+}
+
+size_t cityhash_arena_capacity(const struct cityhash_arena* arena) {
+  return arena->capacity;
+}
+
+size_t cityhash_arena_used(const struct cityhash_arena* arena) {
+  return arena->used;
+}
+
+void* cityhash_arena_alloc(struct cityhash_arena* arena, size_t size,
+                           size_t align) {
+
+  if (align == 0)
+    align = 1;
+
+  size_t off = (arena->used + align - 1) & ~(align - 1);
+
+  if (off < arena->used || off > arena->capacity ||
+      size > arena->capacity - off)
+    return NULL;
+
+  arena->used = off + size;
+
+  return arena->base + off;
+}
+
+// class of the smallest power of two of at least size bytes
+static int size_class(size_t size) {
+
+  int c = 0;
+
+  while (c < KCLASSES && ((size_t)1 << (KMIN_CLASS + c)) < size)
+    c++;
+
+  return c;
+}
+
+void* cityhash_arena_get(struct cityhash_arena* arena, size_t size) {
+
+  int c = size_class(size);
+
+  if (c == KCLASSES)
+    return cityhash_arena_alloc(arena, size, 64);
+
+  struct free_block* b = arena->free[c];
+
+  if (b != NULL) {
+    arena->free[c] = b->next;
+    return b;
+  }
+
+  size_t block = (size_t)1 << (KMIN_CLASS + c);
+
+  return cityhash_arena_alloc(arena, block, block < 64 ? block : 64);
+}
+
+void cityhash_arena_put(struct cityhash_arena* arena, void* p, size_t size) {
+
+  int c = size_class(size);
+
+  if (p == NULL || c == KCLASSES)
+    return;
+
+  struct free_block* b = p;
+
+  b->next = arena->free[c];
+  arena->free[c] = b;
+}
+
+void cityhash_arena_reset(struct cityhash_arena* arena) {
+
+  arena->used = 0;
+  memset(arena->free, 0, sizeof(arena->free));
+}
+
+static void* heap_alloc(void* ctx, size_t size) {
+
+  (void)ctx;
+
+  return malloc(size);
+}
+
+static void heap_free(void* ctx, void* p, size_t size) {
+
+  (void)ctx;
+  (void)size;
+
+  free(p);
+}
+
+const struct cityhash_allocator cityhash_heap_allocator = {heap_alloc,
+                                                           heap_free, NULL};
+
+static void* arena_alloc(void* ctx, size_t size) {
+  return cityhash_arena_get(ctx, size);
+}
+
+static void arena_free(void* ctx, void* p, size_t size) {
+  cityhash_arena_put(ctx, p, size);
+}
+
+struct cityhash_allocator cityhash_arena_allocator(
+    struct cityhash_arena* arena) {
+
+  struct cityhash_allocator a = {arena_alloc, arena_free, arena};
+
+  return a;
+}
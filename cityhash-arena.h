@@ -0,0 +1,97 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Arena allocator for large hash tables and sketches.  An arena reserves
+// one range of memory aligned to 2 MiB and backs it with huge pages when it
+// can, from the hugetlb pool (MAP_HUGETLB) or as transparent huge pages
+// (madvise(MADV_HUGEPAGE)), so that random probes over gigabytes take far
+// fewer TLB misses than on 4 KiB pages; otherwise it uses regular pages.
+// Memory is handed out by bumping an offset, or in power-of-two size
+// classes whose blocks are reused through free lists, and is given back all
+// at once with cityhash_arena_reset().  Containers take memory through
+// struct cityhash_allocator, which an arena or malloc() can stand behind.
+// An arena is not thread-safe.
+
+#ifndef CITYHASH_ARENA_H
+#define CITYHASH_ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// the huge page size arenas are aligned and sized to
+#define CITYHASH_HUGE_PAGE ((size_t)2 << 20)
+
+// backing flags: what an arena may use, and what it got
+#define CITYHASH_ARENA_HUGETLB (1)
+#define CITYHASH_ARENA_THP (2)
+
+struct cityhash_arena;
+
+// an arena of capacity bytes (rounded up to CITYHASH_HUGE_PAGE) backed as
+// flags allow, trying hugetlb before transparent huge pages; flags of 0 asks
+// for regular pages only; NULL if the memory cannot be mapped
+struct cityhash_arena* cityhash_arena_create(size_t capacity, int flags);
+
+void cityhash_arena_destroy(struct cityhash_arena* arena);
+
+// CITYHASH_ARENA_HUGETLB, CITYHASH_ARENA_THP or 0 for regular pages;
+// transparent huge pages are advised, the kernel may still fall back
+int cityhash_arena_backing(const struct cityhash_arena* arena);
+
+// start of the arena's memory and its size
+void* cityhash_arena_base(const struct cityhash_arena* arena);
+size_t cityhash_arena_capacity(const struct cityhash_arena* arena);
+
+// bytes handed out since creation or the last reset
+size_t cityhash_arena_used(const struct cityhash_arena* arena);
+
+// size bytes aligned to align (a power of two) from the end of what was
+// handed out so far; NULL if the arena is full
+void* cityhash_arena_alloc(struct cityhash_arena* arena, size_t size,
+                           size_t align);
+
+// a block of the power-of-two size class of size, reused from the class's
+// free list when one was put back; sizes above 512 KiB are bump allocated
+void* cityhash_arena_get(struct cityhash_arena* arena, size_t size);
+
+// returns a block from cityhash_arena_get() of the same size to its class;
+// blocks above 512 KiB are only reclaimed by a reset
+void cityhash_arena_put(struct cityhash_arena* arena, void* p, size_t size);
+
+// forgets every allocation, the pages stay mapped for the next round
+void cityhash_arena_reset(struct cityhash_arena* arena);
+
+// what containers allocate through; free gets the size passed to alloc
+struct cityhash_allocator {
+  void* (*alloc)(void* ctx, size_t size);
+  void (*free)(void* ctx, void* p, size_t size);
+  void* ctx;
+};
+
+// malloc() and free()
+extern const struct cityhash_allocator cityhash_heap_allocator;
+
+// cityhash_arena_get() and cityhash_arena_put() of arena
+struct cityhash_allocator cityhash_arena_allocator(
+    struct cityhash_arena* arena);
+
+#endif // CITYHASH_ARENA_H
@@ -0,0 +1,82 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Helpers shared by the benchmark and test drivers: a small seeded generator
+// for keys and shuffles, and the clocks the timed loops read.
+
+#ifndef CITYHASH_BENCH_UTIL_H
+#define CITYHASH_BENCH_UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// splitmix64, advancing *state by one step
+static inline uint64_t splitmix64(uint64_t* state) {
+
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+// CPU time of the calling thread
+static inline double thread_ns() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static inline double wall_ns() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// TSC ticks per nanosecond, measured over 50 ms; 1 without a TSC, where
+// timers fall back to wall_ns()
+static inline double ticks_per_ns() {
+#if defined(HAVE_TSC)
+  double t0 = wall_ns();
+  uint64_t c0 = __rdtsc();
+
+  while (wall_ns() - t0 < 50e6)
+    ;
+
+  return (double)(__rdtsc() - c0) / (wall_ns() - t0);
+#else
+  return 1.0;
+#endif
+}
+
+#endif // CITYHASH_BENCH_UTIL_H
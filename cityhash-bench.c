@@ -0,0 +1,1628 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Throughput benchmark for every cityhash variant.
+//
+// Each variant is timed at every length from 0 to 128 bytes and at every
+// power of two from 256 bytes up to the maximum length (1 GiB by default).
+// In hot mode the same buffer is hashed over and over, so it stays in L1/L2.
+// In cold mode every call hashes a different, randomly chosen slot of a
+// large pool, so the input has to come from memory.
+//
+// With -P the throughput sweep is replaced by a hardware counter profile:
+// each variant hashes a stream of keys whose lengths are drawn from a length
+// class, either a single length or a random mix, and cycles, instructions,
+// branch misses and L1D/LLC misses per call are read with perf_event_open.
+// Comparing a mixed class such as 0-64 with the fixed lengths inside it shows
+// what the length dispatch in cityhash64() and city_murmur() costs; the
+// wall-clock ns per call is printed next to the counters, so the random and
+// fixed length throughput can be compared even where no PMU is available.
+//
+// With -L single calls of cityhash64() and cityhash32() (or of the variant
+// picked with -v) are timed one by one between serialized rdtscp reads, the
+// calibrated cost of an empty timed region is subtracted, and p50/p99/p99.9
+// per length are taken from a log-linear histogram; lengths stop at 4 KiB
+// unless -m is given.  -D switches to dependent-chain mode, where the offset
+// of every key is derived from the previous hash; the chain is timed in
+// blocks of KCHAIN calls, so what is measured is the true latency of a call
+// rather than pipelined throughput.
+//
+// With -N the pool is cut into a string column of random 0-32 byte keys that
+// cityhash64_numa_batch_offsets() hashes with one thread per CPU on every
+// NUMA node; the fastest of the reps runs is reported per node (threads,
+// rows, share of bytes hashed where they are stored and GB/s), next to
+// cityhash64_batch_offsets() on the calling thread.
+//
+// With -A hash table lookups are timed against table size, from half of L2
+// up to ten times the LLC (at most a quarter of memory): 2^20 random hits of
+// 16-byte keys in a 50% full linear probing table, each hashed with
+// cityhash64() and probed one after the other, then through
+// cityhash64_lookup_batch() with 4 to 32 lookups in flight.  The hashing
+// pool is not allocated, so it takes no memory from the tables.
+//
+// With -T 2^22 random 8-byte probes at cityhash64(i) & mask are timed over
+// tables of 16 MiB to 1 GiB (at most a quarter of memory) in arenas on 4 KiB
+// pages, on transparent huge pages and, where a hugetlb pool is reserved, on
+// hugetlb pages; next to ns per probe are the dTLB and LLC misses per probe
+// and the share of the table the kernel actually put on huge pages.  No
+// hashing pool is allocated here either.
+//
+// usage: cityhash_bench [-m max_len] [-p pool_mib] [-t min_ms] [-r reps]
+//                       [-v variant] [-H | -C] [-P] [-L [-D] [-n samples]]
+//                       [-N] [-A] [-T] [-j out.json] [-c out.csv]
+
+#if defined(BENCHMARKING)
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cityhash-arena.h"
+#include "cityhash-bench-util.h"
+#include "cityhash-histogram.h"
+#include "cityhash-lookup.h"
+#include "cityhash-numa.h"
+#include "cityhash-perf.h"
+#include "cityhash.h"
+
+#define KMAX_LEN ((size_t)1 << 30)
+#define KPOOL_MIB (256)
+#define KMIN_MS (10)
+#define KREPS (5)
+#define KOFFSETS (1 << 20)
+#define KPERF_KEYS (1 << 16)
+#define KPERF_REGION (1 << 16)
+#define KLAT_SAMPLES (100000)
+#define KLAT_MAX_LEN (4096)
+#define KLAT_REGION (1 << 16)
+#define KCHAIN (16)
+
+enum bench_mode { MODE_HOT = 0, MODE_COLD = 1 };
+
+static const char* mode_names[] = {"hot", "cold"};
+
+// every variant is wrapped so that it folds its result into 64 bits
+typedef uint64_t (*bench_fn)(const uint8_t* s, size_t len);
+
+static const uint64_t kseed0 = 1234567;
+static const uint64_t kseed1 = 0xc3a5c85c97cb3127ULL;
+static const uint128_t kseed128 = {1234567, 0xc3a5c85c97cb3127ULL};
+
+static uint64_t bench_cityhash32(const uint8_t* s, size_t len) {
+  return cityhash32(s, len);
+}
+
+static uint64_t bench_cityhash64(const uint8_t* s, size_t len) {
+  return cityhash64(s, len);
+}
+
+static uint64_t bench_cityhash32_padded(const uint8_t* s, size_t len) {
+  return cityhash32_padded(s, len);
+}
+
+static uint64_t bench_cityhash64_padded(const uint8_t* s, size_t len) {
+  return cityhash64_padded(s, len);
+}
+
+static uint64_t bench_cityhash64_with_seed(const uint8_t* s, size_t len) {
+  return cityhash64_with_seed(s, len, kseed0);
+}
+
+static uint64_t bench_cityhash64_with_seeds(const uint8_t* s, size_t len) {
+  return cityhash64_with_seeds(s, len, kseed0, kseed1);
+}
+
+static uint64_t bench_cityhash128(const uint8_t* s, size_t len) {
+  uint128_t h = cityhash128(s, len);
+  return h.a ^ h.b;
+}
+
+static uint64_t bench_cityhash128_with_seed(const uint8_t* s, size_t len) {
+  uint128_t h = cityhash128_with_seed(s, len, kseed128);
+  return h.a ^ h.b;
+}
+
+#if defined(__SSE4_2__) && defined(__x86_64)
+
+static uint64_t bench_cityhash128_crc(const uint8_t* s, size_t len) {
+  uint128_t h = cityhash128_crc(s, len);
+  return h.a ^ h.b;
+}
+
+static uint64_t bench_cityhash128_crc_with_seed(const uint8_t* s, size_t len) {
+  uint128_t h = cityhash128_crc_with_seed(s, len, kseed128);
+  return h.a ^ h.b;
+}
+
+static uint64_t bench_cityhash256_crc(const uint8_t* s, size_t len) {
+  uint256_t h = cityhash256_crc(s, len);
+  return h.a ^ h.b ^ h.c ^ h.d;
+}
+
+#endif
+
+struct bench_variant {
+  const char* name;
+  bench_fn fn;
+};
+
+static const struct bench_variant variants[] = {
+    {"cityhash32", bench_cityhash32},
+    {"cityhash64", bench_cityhash64},
+    {"cityhash32_padded", bench_cityhash32_padded},
+    {"cityhash64_padded", bench_cityhash64_padded},
+    {"cityhash64_with_seed", bench_cityhash64_with_seed},
+    {"cityhash64_with_seeds", bench_cityhash64_with_seeds},
+    {"cityhash128", bench_cityhash128},
+    {"cityhash128_with_seed", bench_cityhash128_with_seed},
+#if defined(__SSE4_2__) && defined(__x86_64)
+    {"cityhash128_crc", bench_cityhash128_crc},
+    {"cityhash128_crc_with_seed", bench_cityhash128_crc_with_seed},
+    {"cityhash256_crc", bench_cityhash256_crc},
+#endif
+};
+
+#define NVARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+struct bench_result {
+  const char* variant;
+  enum bench_mode mode;
+  size_t len;
+  double ns_per_call;
+  double cycles_per_call;
+};
+
+// keeps the compiler from discarding the hash results
+static volatile uint64_t sink;
+
+static uint8_t* buf;
+static size_t buf_size;
+static size_t* offsets;
+
+static uint64_t now_cycles() {
+#if defined(HAVE_TSC)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// fill the buffer with the same generator cityhash-test.c uses
+static void setup_buffer(size_t size) {
+
+  uint64_t a = 9;
+  uint64_t b = 777;
+
+  for (size_t i = 0; i < size; i++) {
+    a += b;
+    b += a;
+    a = (a ^ (a >> 41)) * kseed1;
+    b = (b ^ (b >> 41)) * kseed1 + i;
+    buf[i] = (uint8_t)(b >> 37);
+  }
+}
+
+// pick KOFFSETS random cache-line aligned slots of at least len bytes
+static void setup_offsets(size_t len) {
+
+  size_t stride = (len + 63) & ~(size_t)63;
+  size_t slots;
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+  if (stride == 0)
+    stride = 64;
+
+  slots = buf_size / stride;
+
+  for (size_t i = 0; i < KOFFSETS; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    offsets[i] = slots > 1 ? (x % slots) * stride : 0;
+  }
+}
+
+// time iters calls, returns elapsed nanoseconds and cycles
+static double run_batch(bench_fn fn, size_t len, enum bench_mode mode,
+                        size_t iters, uint64_t* cycles) {
+
+  uint64_t acc = 0;
+  double t0 = wall_ns();
+  uint64_t c0 = now_cycles();
+
+  if (mode == MODE_HOT) {
+
+    for (size_t i = 0; i < iters; i++)
+      acc += fn(buf, len);
+  } else {
+
+    for (size_t i = 0; i < iters; i++)
+      acc += fn(buf + offsets[i & (KOFFSETS - 1)], len);
+  }
+
+  *cycles = now_cycles() - c0;
+  sink += acc;
+
+  return wall_ns() - t0;
+}
+
+static int compare_double(const void* a, const void* b) {
+
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+static void measure(const struct bench_variant* v, size_t len,
+                    enum bench_mode mode, double min_ns, int reps,
+                    struct bench_result* out) {
+
+  size_t iters = 1;
+  uint64_t cycles;
+  double ns[reps], cyc[reps];
+
+  // grow the batch until a single batch takes at least min_ns
+  while (run_batch(v->fn, len, mode, iters, &cycles) < min_ns)
+    iters *= 2;
+
+  for (int r = 0; r < reps; r++) {
+    ns[r] = run_batch(v->fn, len, mode, iters, &cycles) / iters;
+    cyc[r] = (double)cycles / iters;
+  }
+
+  qsort(ns, reps, sizeof(double), compare_double);
+  qsort(cyc, reps, sizeof(double), compare_double);
+
+  out->variant = v->name;
+  out->mode = mode;
+  out->len = len;
+  out->ns_per_call = ns[reps / 2];
+  out->cycles_per_call = cyc[reps / 2];
+}
+
+static double per_byte(double x, size_t len) {
+  return len > 0 ? x / len : x;
+}
+
+static void print_result(FILE* f, const struct bench_result* r) {
+
+  fprintf(f, "%-26s %-4s %11zu %14.2f %14.2f %10.3f %10.3f\n", r->variant,
+          mode_names[r->mode], r->len, r->ns_per_call, r->cycles_per_call,
+          per_byte(r->cycles_per_call, r->len),
+          r->ns_per_call > 0 ? r->len / r->ns_per_call : 0.0);
+}
+
+static void write_csv(const char* path, const struct bench_result* r,
+                      size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "variant,mode,len,ns_per_call,cycles_per_call,cycles_per_byte,"
+             "gb_per_s\n");
+
+  for (size_t i = 0; i < n; i++) {
+    fprintf(f, "%s,%s,%zu,%.4f,%.4f,%.6f,%.6f\n", r[i].variant,
+            mode_names[r[i].mode], r[i].len, r[i].ns_per_call,
+            r[i].cycles_per_call, per_byte(r[i].cycles_per_call, r[i].len),
+            r[i].ns_per_call > 0 ? r[i].len / r[i].ns_per_call : 0.0);
+  }
+
+  fclose(f);
+}
+
+static void write_json(const char* path, const struct bench_result* r,
+                       size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "{\n  \"cycle_source\": \"%s\",\n  \"results\": [\n",
+#if defined(HAVE_TSC)
+          "tsc"
+#else
+          "none"
+#endif
+  );
+
+  for (size_t i = 0; i < n; i++) {
+    fprintf(f,
+            "    {\"variant\": \"%s\", \"mode\": \"%s\", \"len\": %zu, "
+            "\"ns_per_call\": %.4f, \"cycles_per_call\": %.4f, "
+            "\"cycles_per_byte\": %.6f, \"gb_per_s\": %.6f}%s\n",
+            r[i].variant, mode_names[r[i].mode], r[i].len, r[i].ns_per_call,
+            r[i].cycles_per_call, per_byte(r[i].cycles_per_call, r[i].len),
+            r[i].ns_per_call > 0 ? r[i].len / r[i].ns_per_call : 0.0,
+            i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+// lengths of a perf profile are drawn uniformly from [lo, hi]
+struct length_class {
+  const char* name;
+  size_t lo;
+  size_t hi;
+};
+
+static const struct length_class length_classes[] = {
+    {"8", 8, 8},          {"24", 24, 24},       {"48", 48, 48},
+    {"96", 96, 96},       {"0-16", 0, 16},      {"17-32", 17, 32},
+    {"33-64", 33, 64},    {"65-128", 65, 128},  {"0-64", 0, 64},
+    {"1-64", 1, 64},      {"0-128", 0, 128},    {"129-1024", 129, 1024},
+};
+
+#define NCLASSES (sizeof(length_classes) / sizeof(length_classes[0]))
+
+struct perf_result {
+  const char* variant;
+  const char* length_class;
+  uint64_t calls;
+  uint64_t bytes;
+  double ns_per_call;
+  struct perf_sample sample;
+};
+
+static double perf_per_call(const struct perf_result* r, int id) {
+  return r->sample.valid[id] ? (double)r->sample.value[id] / r->calls : -1.0;
+}
+
+static double perf_ipc(const struct perf_result* r) {
+
+  if (!r->sample.valid[PERF_CYCLES] || !r->sample.valid[PERF_INSTRUCTIONS] ||
+      r->sample.value[PERF_CYCLES] == 0)
+    return -1.0;
+
+  return (double)r->sample.value[PERF_INSTRUCTIONS] /
+         r->sample.value[PERF_CYCLES];
+}
+
+static double perf_branch_miss_rate(const struct perf_result* r) {
+
+  if (!r->sample.valid[PERF_BRANCHES] || !r->sample.valid[PERF_BRANCH_MISSES] ||
+      r->sample.value[PERF_BRANCHES] == 0)
+    return -1.0;
+
+  return (double)r->sample.value[PERF_BRANCH_MISSES] /
+         r->sample.value[PERF_BRANCHES];
+}
+
+// hash the same KPERF_KEYS keys passes times under the counters
+static void perf_profile(struct perf_counters* pc, bench_fn fn,
+                         const size_t* key_off, const size_t* key_len,
+                         size_t passes, struct perf_result* out) {
+
+  uint64_t acc = 0;
+
+  perf_counters_start(pc);
+
+  for (size_t p = 0; p < passes; p++) {
+    for (size_t i = 0; i < KPERF_KEYS; i++)
+      acc += fn(buf + key_off[i], key_len[i]);
+  }
+
+  perf_counters_stop(pc, &out->sample);
+  sink += acc;
+
+  out->calls = (uint64_t)passes * KPERF_KEYS;
+}
+
+static void print_perf_value(double x) {
+
+  if (x < 0)
+    printf(" %10s", "n/a");
+  else
+    printf(" %10.3f", x);
+}
+
+static void write_perf_csv(const char* path, const struct perf_result* r,
+                           size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "variant,length_class,calls,bytes,ns_per_call");
+
+  for (int c = 0; c < PERF_NCOUNTERS; c++)
+    fprintf(f, ",%s", perf_counter_names[c]);
+
+  fprintf(f, ",ipc,branch_miss_rate\n");
+
+  for (size_t i = 0; i < n; i++) {
+
+    fprintf(f, "%s,%s,%llu,%llu,%.4f", r[i].variant, r[i].length_class,
+            (unsigned long long)r[i].calls, (unsigned long long)r[i].bytes,
+            r[i].ns_per_call);
+
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+      if (r[i].sample.valid[c])
+        fprintf(f, ",%llu", (unsigned long long)r[i].sample.value[c]);
+      else
+        fprintf(f, ",");
+    }
+
+    fprintf(f, ",%.4f,%.6f\n", perf_ipc(&r[i]), perf_branch_miss_rate(&r[i]));
+  }
+
+  fclose(f);
+}
+
+static void write_perf_json(const char* path, const struct perf_result* r,
+                            size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "{\n  \"results\": [\n");
+
+  for (size_t i = 0; i < n; i++) {
+
+    fprintf(f,
+            "    {\"variant\": \"%s\", \"length_class\": \"%s\", "
+            "\"calls\": %llu, \"bytes\": %llu, \"ns_per_call\": %.4f",
+            r[i].variant, r[i].length_class, (unsigned long long)r[i].calls,
+            (unsigned long long)r[i].bytes, r[i].ns_per_call);
+
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+      if (r[i].sample.valid[c])
+        fprintf(f, ", \"%s\": %llu", perf_counter_names[c],
+                (unsigned long long)r[i].sample.value[c]);
+      else
+        fprintf(f, ", \"%s\": null", perf_counter_names[c]);
+    }
+
+    if (perf_ipc(&r[i]) >= 0)
+      fprintf(f, ", \"ipc\": %.4f", perf_ipc(&r[i]));
+    else
+      fprintf(f, ", \"ipc\": null");
+
+    if (perf_branch_miss_rate(&r[i]) >= 0)
+      fprintf(f, ", \"branch_miss_rate\": %.6f", perf_branch_miss_rate(&r[i]));
+    else
+      fprintf(f, ", \"branch_miss_rate\": null");
+
+    fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static int run_perf(const char* only, double min_ns, const char* json_path,
+                    const char* csv_path) {
+
+  struct perf_counters pc;
+  size_t* key_off = malloc(KPERF_KEYS * sizeof(size_t));
+  size_t* key_len = malloc(KPERF_KEYS * sizeof(size_t));
+  struct perf_result* results =
+      malloc(NVARIANTS * NCLASSES * sizeof(struct perf_result));
+  size_t nresults = 0;
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+  if (perf_counters_open(&pc) == 0)
+    fprintf(stderr, "warning: no hardware counters available, "
+                    "check /proc/sys/kernel/perf_event_paranoid\n");
+
+  printf("%-26s %-9s %10s %10s %10s %10s %10s %10s %10s %10s\n", "variant",
+         "lengths", "ns", "cycles", "instrs", "IPC", "br-miss", "br-miss%",
+         "L1D-miss", "LLC-miss");
+
+  for (size_t l = 0; l < NCLASSES; l++) {
+
+    const struct length_class* lc = &length_classes[l];
+    uint64_t bytes = 0;
+
+    // random lengths and offsets inside a small, cache resident region
+    for (size_t i = 0; i < KPERF_KEYS; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      key_len[i] = lc->lo + (size_t)(x % (lc->hi - lc->lo + 1));
+      key_off[i] = (size_t)((x >> 32) % KPERF_REGION);
+      bytes += key_len[i];
+    }
+
+    for (size_t v = 0; v < NVARIANTS; v++) {
+
+      if (only != NULL && strcmp(only, variants[v].name) != 0)
+        continue;
+
+      struct perf_result* r = &results[nresults++];
+      size_t passes = 1;
+      double t0;
+
+      // warm up and size the run so that it takes at least min_ns
+      do {
+        t0 = wall_ns();
+        perf_profile(&pc, variants[v].fn, key_off, key_len, passes, r);
+        passes *= 2;
+      } while (wall_ns() - t0 < min_ns);
+
+      t0 = wall_ns();
+      perf_profile(&pc, variants[v].fn, key_off, key_len, passes, r);
+      r->ns_per_call = (wall_ns() - t0) / r->calls;
+
+      r->variant = variants[v].name;
+      r->length_class = lc->name;
+      r->bytes = bytes * passes;
+
+      printf("%-26s %-9s", r->variant, r->length_class);
+      print_perf_value(r->ns_per_call);
+      print_perf_value(perf_per_call(r, PERF_CYCLES));
+      print_perf_value(perf_per_call(r, PERF_INSTRUCTIONS));
+      print_perf_value(perf_ipc(r));
+      print_perf_value(perf_per_call(r, PERF_BRANCH_MISSES));
+      print_perf_value(perf_branch_miss_rate(r) < 0
+                           ? -1.0
+                           : perf_branch_miss_rate(r) * 100);
+      print_perf_value(perf_per_call(r, PERF_L1D_MISSES));
+      print_perf_value(perf_per_call(r, PERF_LLC_MISSES));
+      printf("\n");
+      fflush(stdout);
+    }
+  }
+
+  if (csv_path != NULL)
+    write_perf_csv(csv_path, results, nresults);
+
+  if (json_path != NULL)
+    write_perf_json(json_path, results, nresults);
+
+  perf_counters_close(&pc);
+  free(results);
+  free(key_len);
+  free(key_off);
+
+  return 0;
+}
+
+// timestamps for a single call: the fences keep the hashed work from
+// drifting out of the timed region in either direction
+static inline uint64_t timer_begin() {
+#if defined(HAVE_TSC)
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+#else
+  return (uint64_t)wall_ns();
+#endif
+}
+
+static inline uint64_t timer_end() {
+#if defined(HAVE_TSC)
+  unsigned int aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+#else
+  return (uint64_t)wall_ns();
+#endif
+}
+
+// smallest cost of an empty timed region, subtracted from every sample
+static uint64_t timer_overhead() {
+
+  uint64_t best = UINT64_MAX;
+
+  for (int i = 0; i < 100000; i++) {
+
+    uint64_t t0 = timer_begin();
+    uint64_t t1 = timer_end();
+
+    if (t1 - t0 < best)
+      best = t1 - t0;
+  }
+
+  return best;
+}
+
+struct latency_result {
+  const char* variant;
+  size_t len;
+  struct histogram hist;
+};
+
+static void measure_latency(bench_fn fn, size_t len, int chain,
+                            size_t samples, uint64_t overhead,
+                            struct histogram* hist) {
+
+  uint64_t h = 0;
+
+  histogram_init(hist);
+
+  if (!chain) {
+
+    for (size_t i = 0; i < samples; i++) {
+
+      uint64_t t0 = timer_begin();
+      h += fn(buf, len);
+      uint64_t t1 = timer_end();
+      uint64_t d = t1 - t0;
+
+      histogram_record(hist, d > overhead ? d - overhead : 0);
+    }
+  } else {
+
+    // the address of every key depends on the hash of the one before it
+    for (size_t i = 0; i < samples; i++) {
+
+      uint64_t t0 = timer_begin();
+
+      for (int c = 0; c < KCHAIN; c++)
+        h = fn(buf + ((h ^ (h >> 29)) & (KLAT_REGION - 1)), len);
+
+      uint64_t t1 = timer_end();
+      uint64_t d = t1 - t0;
+
+      histogram_record(hist, d > overhead ? (d - overhead) / KCHAIN : 0);
+    }
+  }
+
+  sink += h;
+}
+
+static void write_latency_csv(const char* path, const struct latency_result* r,
+                              size_t n, double rate) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "variant,len,samples,min,p50,p99,p99_9,max,p50_ns,p99_ns,"
+             "p99_9_ns\n");
+
+  for (size_t i = 0; i < n; i++) {
+
+    const struct histogram* h = &r[i].hist;
+    uint64_t p50 = histogram_percentile(h, 50.0);
+    uint64_t p99 = histogram_percentile(h, 99.0);
+    uint64_t p999 = histogram_percentile(h, 99.9);
+
+    fprintf(f, "%s,%zu,%llu,%llu,%llu,%llu,%llu,%llu,%.2f,%.2f,%.2f\n",
+            r[i].variant, r[i].len, (unsigned long long)h->count,
+            (unsigned long long)h->min, (unsigned long long)p50,
+            (unsigned long long)p99, (unsigned long long)p999,
+            (unsigned long long)h->max, p50 / rate, p99 / rate, p999 / rate);
+  }
+
+  fclose(f);
+}
+
+static void write_latency_json(const char* path,
+                               const struct latency_result* r, size_t n,
+                               int chain, uint64_t overhead, double rate) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f,
+          "{\n  \"mode\": \"%s\",\n  \"timer_overhead\": %llu,\n"
+          "  \"ticks_per_ns\": %.4f,\n  \"results\": [\n",
+          chain ? "chain" : "single", (unsigned long long)overhead, rate);
+
+  for (size_t i = 0; i < n; i++) {
+
+    const struct histogram* h = &r[i].hist;
+
+    fprintf(f,
+            "    {\"variant\": \"%s\", \"len\": %zu, \"samples\": %llu, "
+            "\"min\": %llu, \"p50\": %llu, \"p99\": %llu, "
+            "\"p99_9\": %llu, \"max\": %llu, \"histogram\": ",
+            r[i].variant, r[i].len, (unsigned long long)h->count,
+            (unsigned long long)h->min,
+            (unsigned long long)histogram_percentile(h, 50.0),
+            (unsigned long long)histogram_percentile(h, 99.0),
+            (unsigned long long)histogram_percentile(h, 99.9),
+            (unsigned long long)h->max);
+    histogram_write_json(h, f);
+    fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static int run_latency(const char* only, const size_t* lens, size_t nlens,
+                       int chain, size_t samples, const char* json_path,
+                       const char* csv_path) {
+
+  struct latency_result* results =
+      malloc(NVARIANTS * nlens * sizeof(struct latency_result));
+  size_t nresults = 0;
+  uint64_t overhead = timer_overhead();
+  double rate = ticks_per_ns();
+
+  printf("# %s mode, timer overhead %llu ticks, %.3f ticks/ns\n",
+         chain ? "dependent-chain" : "single-call",
+         (unsigned long long)overhead, rate);
+  printf("%-26s %11s %10s %10s %10s %10s %10s\n", "variant", "len", "min",
+         "p50", "p99", "p99.9", "max");
+
+  for (size_t l = 0; l < nlens; l++) {
+
+    // chained keys are placed anywhere in the first KLAT_REGION bytes
+    if (chain && lens[l] + KLAT_REGION > buf_size)
+      break;
+
+    for (size_t v = 0; v < NVARIANTS; v++) {
+
+      if (only != NULL ? strcmp(only, variants[v].name) != 0
+                       : variants[v].fn != bench_cityhash64 &&
+                             variants[v].fn != bench_cityhash32)
+        continue;
+
+      struct latency_result* r = &results[nresults++];
+      const struct histogram* h = &r->hist;
+
+      r->variant = variants[v].name;
+      r->len = lens[l];
+
+      // warm up caches and predictors first
+      measure_latency(variants[v].fn, lens[l], chain, samples / 10 + 1,
+                      overhead, &r->hist);
+      measure_latency(variants[v].fn, lens[l], chain, samples, overhead,
+                      &r->hist);
+
+      printf("%-26s %11zu %10llu %10llu %10llu %10llu %10llu\n", r->variant,
+             r->len, (unsigned long long)h->min,
+             (unsigned long long)histogram_percentile(h, 50.0),
+             (unsigned long long)histogram_percentile(h, 99.0),
+             (unsigned long long)histogram_percentile(h, 99.9),
+             (unsigned long long)h->max);
+      fflush(stdout);
+    }
+  }
+
+  if (csv_path != NULL)
+    write_latency_csv(csv_path, results, nresults, rate);
+
+  if (json_path != NULL)
+    write_latency_json(json_path, results, nresults, chain, overhead, rate);
+
+  free(results);
+
+  return 0;
+}
+
+static double numa_gbps(const struct cityhash_numa_node* r) {
+  return r->seconds > 0 ? r->bytes / r->seconds / 1e9 : 0.0;
+}
+
+static double numa_local(const struct cityhash_numa_node* r) {
+  return r->bytes > 0 ? (double)r->local_bytes / r->bytes * 100 : 0.0;
+}
+
+static void write_numa_csv(const char* path,
+                           const struct cityhash_numa_report* r) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "node,threads,rows,bytes,local_bytes,seconds,gb_per_s\n");
+
+  for (int k = 0; k < r->nodes; k++) {
+    const struct cityhash_numa_node* n = &r->node[k];
+    fprintf(f, "%d,%d,%llu,%llu,%llu,%.6f,%.4f\n", n->node, n->threads,
+            (unsigned long long)n->rows, (unsigned long long)n->bytes,
+            (unsigned long long)n->local_bytes, n->seconds, numa_gbps(n));
+  }
+
+  fclose(f);
+}
+
+static void write_numa_json(const char* path,
+                            const struct cityhash_numa_report* r,
+                            double serial_gbps) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "{\n  \"serial_gb_per_s\": %.4f,\n  \"nodes\": [\n",
+          serial_gbps);
+
+  for (int k = 0; k < r->nodes; k++) {
+    const struct cityhash_numa_node* n = &r->node[k];
+    fprintf(f,
+            "    {\"node\": %d, \"threads\": %d, \"rows\": %llu, "
+            "\"bytes\": %llu, \"local_bytes\": %llu, \"seconds\": %.6f, "
+            "\"gb_per_s\": %.4f}%s\n",
+            n->node, n->threads, (unsigned long long)n->rows,
+            (unsigned long long)n->bytes, (unsigned long long)n->local_bytes,
+            n->seconds, numa_gbps(n), k + 1 < r->nodes ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static int run_numa(int reps, const char* json_path, const char* csv_path) {
+
+  size_t cap = buf_size / 16;
+  uint32_t* col = malloc((cap + 1) * sizeof(uint32_t));
+  uint64_t* out = malloc(cap * sizeof(uint64_t));
+  struct cityhash_numa_report best, report;
+  double best_s = 0, serial_s = 0;
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  size_t rows = 0;
+
+  if (col == NULL || out == NULL) {
+    fprintf(stderr, "error: cannot allocate the column\n");
+    free(out);
+    free(col);
+    return 1;
+  }
+
+  // random 0-32 byte keys back to back, capped below 4 GiB of key bytes
+  col[0] = 0;
+
+  while (rows < cap) {
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    size_t next = col[rows] + (size_t)(x % 33);
+
+    if (next > buf_size || next > UINT32_MAX)
+      break;
+
+    col[++rows] = (uint32_t)next;
+  }
+
+  for (int r = 0; r < reps; r++) {
+
+    double t0 = wall_ns();
+    cityhash64_numa_batch_offsets(buf, col, rows, out, 0, &report);
+    double t = (wall_ns() - t0) / 1e9;
+
+    if (r == 0 || t < best_s) {
+      best_s = t;
+      best = report;
+    }
+
+    t0 = wall_ns();
+    cityhash64_batch_offsets(buf, col, rows, out);
+    t = (wall_ns() - t0) / 1e9;
+
+    if (r == 0 || t < serial_s)
+      serial_s = t;
+  }
+
+  printf("# %zu rows, %u key bytes, %d node(s)\n", rows, col[rows],
+         best.nodes);
+  printf("%-6s %8s %12s %14s %8s %10s %8s\n", "node", "threads", "rows",
+         "bytes", "local%", "seconds", "GB/s");
+
+  for (int k = 0; k < best.nodes; k++) {
+    const struct cityhash_numa_node* n = &best.node[k];
+    printf("%-6d %8d %12llu %14llu %8.1f %10.4f %8.2f\n", n->node,
+           n->threads, (unsigned long long)n->rows,
+           (unsigned long long)n->bytes, numa_local(n), n->seconds,
+           numa_gbps(n));
+  }
+
+  printf("%-6s %8s %12zu %14u %8s %10.4f %8.2f\n", "all", "", rows,
+         col[rows], "", best_s, col[rows] / best_s / 1e9);
+  printf("%-6s %8d %12zu %14u %8s %10.4f %8.2f\n", "serial", 1, rows,
+         col[rows], "", serial_s, col[rows] / serial_s / 1e9);
+
+  if (csv_path != NULL)
+    write_numa_csv(csv_path, &best);
+
+  if (json_path != NULL)
+    write_numa_json(json_path, &best, col[rows] / serial_s / 1e9);
+
+  free(out);
+  free(col);
+
+  return 0;
+}
+
+// lookups timed per table size, 16-byte keys from 50% full linear probing
+// tables of 16-byte buckets
+#define KLOOKUP_QUERIES (1 << 20)
+#define KLOOKUP_KEY (16)
+#define KLOOKUP_COLUMNS (5)
+
+static const int klookup_inflight[KLOOKUP_COLUMNS - 1] = {4, 8, 16, 32};
+
+struct lookup_bucket {
+  uint64_t hash;
+  uint64_t value; // key number + 1, 0 for an empty bucket
+};
+
+struct lookup_table {
+  struct lookup_bucket* bucket;
+  size_t mask;
+  uint64_t* found;
+};
+
+struct lookup_result {
+  size_t table_bytes;
+  size_t keys;
+  double mlps[KLOOKUP_COLUMNS]; // serial, then each inflight
+};
+
+static void lookup_key(uint8_t* key, uint64_t k) {
+
+  uint64_t w[2] = {k, k * 0x9e3779b97f4a7c15ULL};
+
+  memcpy(key, w, KLOOKUP_KEY);
+}
+
+static const void* lookup_bucket_of(void* table, uint64_t hash) {
+
+  struct lookup_table* t = table;
+
+  return &t->bucket[hash & t->mask];
+}
+
+static const void* lookup_probe(void* table, size_t i, uint64_t hash,
+                                const void* at) {
+
+  struct lookup_table* t = table;
+  const struct lookup_bucket* b = at;
+
+  if (b->value != 0 && b->hash != hash)
+    return &t->bucket[(b - t->bucket + 1) & t->mask];
+
+  t->found[i] = b->value;
+
+  return NULL;
+}
+
+static double lookup_serial(struct lookup_table* t, const uint8_t* const* keys,
+                            const size_t* lens, size_t n) {
+
+  double t0 = wall_ns();
+
+  for (size_t i = 0; i < n; i++) {
+
+    uint64_t hash = cityhash64(keys[i], lens[i]);
+    const void* at = lookup_bucket_of(t, hash);
+
+    while ((at = lookup_probe(t, i, hash, at)) != NULL)
+      ;
+  }
+
+  return wall_ns() - t0;
+}
+
+static double lookup_amac(struct lookup_table* t, const uint8_t* const* keys,
+                          const size_t* lens, size_t n, int inflight) {
+
+  const struct cityhash_lookup lookup = {t, lookup_bucket_of, lookup_probe};
+  double t0 = wall_ns();
+
+  cityhash64_lookup_batch(&lookup, keys, lens, n, inflight);
+
+  return wall_ns() - t0;
+}
+
+static void write_lookup_csv(const char* path, const struct lookup_result* r,
+                             size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "table_bytes,keys,inflight,mlookups_per_s\n");
+
+  for (size_t k = 0; k < n; k++)
+    for (int c = 0; c < KLOOKUP_COLUMNS; c++)
+      fprintf(f, "%zu,%zu,%d,%.3f\n", r[k].table_bytes, r[k].keys,
+              c == 0 ? 0 : klookup_inflight[c - 1], r[k].mlps[c]);
+
+  fclose(f);
+}
+
+static void write_lookup_json(const char* path,
+                              const struct lookup_result* r, size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "[\n");
+
+  for (size_t k = 0; k < n; k++) {
+    fprintf(f, "  {\"table_bytes\": %zu, \"keys\": %zu, \"serial\": %.3f",
+            r[k].table_bytes, r[k].keys, r[k].mlps[0]);
+
+    for (int c = 1; c < KLOOKUP_COLUMNS; c++)
+      fprintf(f, ", \"inflight_%d\": %.3f", klookup_inflight[c - 1],
+              r[k].mlps[c]);
+
+    fprintf(f, "}%s\n", k + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "]\n");
+  fclose(f);
+}
+
+static int run_lookup(int reps, const char* json_path, const char* csv_path) {
+
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long page = sysconf(_SC_PAGESIZE);
+  size_t lo = l2 > 0 ? (size_t)l2 / 2 : (size_t)512 << 10;
+  size_t hi = (llc > 0 ? (size_t)llc : (size_t)32 << 20) * 10;
+
+  // leave room for the queries, their results and the rest of the system
+  if (pages > 0 && page > 0 && hi > (size_t)pages * page / 4) {
+    hi = (size_t)pages * page / 4;
+    printf("# largest table limited to a quarter of memory\n");
+  }
+
+  uint8_t* qbuf = malloc((size_t)KLOOKUP_QUERIES * KLOOKUP_KEY);
+  const uint8_t** keys = malloc(KLOOKUP_QUERIES * sizeof(uint8_t*));
+  size_t* lens = malloc(KLOOKUP_QUERIES * sizeof(size_t));
+  uint64_t* found = malloc(KLOOKUP_QUERIES * sizeof(uint64_t));
+  struct lookup_result results[64];
+  size_t nresults = 0;
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  int rc = 0;
+
+  if (qbuf == NULL || keys == NULL || lens == NULL || found == NULL) {
+    fprintf(stderr, "error: cannot allocate the queries\n");
+    rc = 1;
+    goto out;
+  }
+
+  printf("# Mlookups/s of %d hits, %d-byte keys, 50%% full tables\n",
+         KLOOKUP_QUERIES, KLOOKUP_KEY);
+  printf("%12s %12s %10s %10s %10s %10s %10s\n", "table_bytes", "keys",
+         "serial", "inflight4", "inflight8", "inflight16", "inflight32");
+
+  for (size_t size = lo; size <= hi && nresults < 64; size *= 2) {
+
+    struct lookup_table t;
+    size_t buckets = 1;
+
+    while (buckets * sizeof(struct lookup_bucket) < size)
+      buckets <<= 1;
+
+    if (posix_memalign((void**)&t.bucket, 64,
+                       buckets * sizeof(struct lookup_bucket)) != 0) {
+      fprintf(stderr, "error: cannot allocate a %zu byte table\n", size);
+      break;
+    }
+
+    memset(t.bucket, 0, buckets * sizeof(struct lookup_bucket));
+    t.mask = buckets - 1;
+    t.found = found;
+
+    size_t nkeys = buckets / 2;
+    uint8_t key[KLOOKUP_KEY];
+
+    for (size_t k = 0; k < nkeys; k++) {
+
+      lookup_key(key, k);
+
+      uint64_t hash = cityhash64(key, KLOOKUP_KEY);
+      size_t b = hash & t.mask;
+
+      while (t.bucket[b].value != 0)
+        b = (b + 1) & t.mask;
+
+      t.bucket[b].hash = hash;
+      t.bucket[b].value = k + 1;
+    }
+
+    for (size_t i = 0; i < KLOOKUP_QUERIES; i++) {
+
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+
+      lookup_key(qbuf + i * KLOOKUP_KEY, x % nkeys);
+      keys[i] = qbuf + i * KLOOKUP_KEY;
+      lens[i] = KLOOKUP_KEY;
+    }
+
+    struct lookup_result* r = &results[nresults++];
+
+    r->table_bytes = buckets * sizeof(struct lookup_bucket);
+    r->keys = nkeys;
+
+    for (int c = 0; c < KLOOKUP_COLUMNS; c++) {
+
+      double best = 0;
+
+      for (int rep = 0; rep < reps; rep++) {
+
+        double ns = c == 0 ? lookup_serial(&t, keys, lens, KLOOKUP_QUERIES)
+                           : lookup_amac(&t, keys, lens, KLOOKUP_QUERIES,
+                                         klookup_inflight[c - 1]);
+
+        if (rep == 0 || ns < best)
+          best = ns;
+      }
+
+      r->mlps[c] = KLOOKUP_QUERIES / best * 1e3;
+    }
+
+    printf("%12zu %12zu %10.2f %10.2f %10.2f %10.2f %10.2f\n", r->table_bytes,
+           r->keys, r->mlps[0], r->mlps[1], r->mlps[2], r->mlps[3],
+           r->mlps[4]);
+    fflush(stdout);
+    free(t.bucket);
+  }
+
+  if (csv_path != NULL)
+    write_lookup_csv(csv_path, results, nresults);
+
+  if (json_path != NULL)
+    write_lookup_json(json_path, results, nresults);
+
+out:
+  free(found);
+  free(lens);
+  free(keys);
+  free(qbuf);
+
+  return rc;
+}
+
+// random probes per table size and backing
+#define KTLB_PROBES (1 << 22)
+#define KTLB_MIN ((size_t)16 << 20)
+#define KTLB_MAX ((size_t)1 << 30)
+#define KTLB_BACKINGS (3)
+
+static const int ktlb_flags[KTLB_BACKINGS] = {0, CITYHASH_ARENA_THP,
+                                              CITYHASH_ARENA_HUGETLB};
+
+static const char* tlb_backing_name(int backing) {
+  return backing == CITYHASH_ARENA_HUGETLB ? "hugetlb"
+         : backing == CITYHASH_ARENA_THP   ? "thp"
+                                           : "4k";
+}
+
+struct tlb_result {
+  size_t table_bytes;
+  int backing;
+  double huge_share; // of the table on huge pages, -1 if unknown
+  double ns_per_probe;
+  double tlb_per_probe; // -1 without counters
+  double llc_per_probe;
+};
+
+// AnonHugePages of the process in bytes, -1 if it cannot be read
+static double anon_huge_bytes(void) {
+
+  FILE* f = fopen("/proc/self/smaps_rollup", "r");
+  char line[256];
+  double kb = -1;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "AnonHugePages: %lf kB", &kb) == 1)
+      break;
+  }
+
+  fclose(f);
+
+  return kb < 0 ? -1 : kb * 1024;
+}
+
+static uint64_t tlb_probe(const uint64_t* table, size_t mask) {
+
+  uint64_t acc = 0;
+
+  for (uint64_t i = 0; i < KTLB_PROBES; i++)
+    acc += table[cityhash64((const uint8_t*)&i, sizeof(i)) & mask];
+
+  return acc;
+}
+
+static double tlb_per_probe(const struct perf_sample* s, int counter) {
+  return s->valid[counter] ? (double)s->value[counter] / KTLB_PROBES : -1;
+}
+
+static void write_tlb_csv(const char* path, const struct tlb_result* r,
+                          size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "table_bytes,backing,huge_share,ns_per_probe,dtlb_misses_per_"
+             "probe,llc_misses_per_probe\n");
+
+  for (size_t i = 0; i < n; i++)
+    fprintf(f, "%zu,%s,%.3f,%.3f,%.4f,%.4f\n", r[i].table_bytes,
+            tlb_backing_name(r[i].backing), r[i].huge_share,
+            r[i].ns_per_probe, r[i].tlb_per_probe, r[i].llc_per_probe);
+
+  fclose(f);
+}
+
+static void write_tlb_json(const char* path, const struct tlb_result* r,
+                           size_t n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "[\n");
+
+  for (size_t i = 0; i < n; i++) {
+    fprintf(f,
+            "  {\"table_bytes\": %zu, \"backing\": \"%s\", "
+            "\"huge_share\": %.3f, \"ns_per_probe\": %.3f",
+            r[i].table_bytes, tlb_backing_name(r[i].backing),
+            r[i].huge_share, r[i].ns_per_probe);
+
+    if (r[i].tlb_per_probe >= 0)
+      fprintf(f, ", \"dtlb_misses_per_probe\": %.4f", r[i].tlb_per_probe);
+    else
+      fprintf(f, ", \"dtlb_misses_per_probe\": null");
+
+    if (r[i].llc_per_probe >= 0)
+      fprintf(f, ", \"llc_misses_per_probe\": %.4f", r[i].llc_per_probe);
+    else
+      fprintf(f, ", \"llc_misses_per_probe\": null");
+
+    fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "]\n");
+  fclose(f);
+}
+
+static int run_tlb(int reps, const char* json_path, const char* csv_path) {
+
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long page = sysconf(_SC_PAGESIZE);
+  size_t hi = KTLB_MAX;
+  struct tlb_result results[64];
+  size_t nresults = 0;
+  struct perf_counters pc;
+
+  if (pages > 0 && page > 0 && hi > (size_t)pages * page / 4)
+    hi = (size_t)pages * page / 4;
+
+  if (perf_counters_open(&pc) == 0)
+    fprintf(stderr, "warning: no hardware counters available, "
+                    "check /proc/sys/kernel/perf_event_paranoid\n");
+
+  printf("# %d random 8-byte probes, table slot = cityhash64(i) & mask\n",
+         KTLB_PROBES);
+  printf("%12s %-8s %7s %10s %10s %10s\n", "table_bytes", "backing", "huge%",
+         "ns", "dTLB-miss", "LLC-miss");
+
+  for (size_t size = KTLB_MIN; size <= hi && nresults + KTLB_BACKINGS <= 64;
+       size *= 2) {
+
+    for (int b = 0; b < KTLB_BACKINGS; b++) {
+
+      struct cityhash_arena* arena =
+          cityhash_arena_create(size, ktlb_flags[b]);
+
+      // no hugetlb pool reserved, the arena fell back to other pages
+      if (arena == NULL ||
+          (ktlb_flags[b] != 0 &&
+           cityhash_arena_backing(arena) != ktlb_flags[b])) {
+        cityhash_arena_destroy(arena);
+        continue;
+      }
+
+      struct tlb_result* r = &results[nresults++];
+      uint64_t* table = cityhash_arena_alloc(arena, size, 64);
+      double huge = anon_huge_bytes();
+      // fault every page in before timing
+      for (size_t i = 0; i < size / sizeof(uint64_t); i++)
+        table[i] = i;
+
+      r->table_bytes = size;
+      r->backing = cityhash_arena_backing(arena);
+      r->huge_share = r->backing == CITYHASH_ARENA_HUGETLB ? 1.0
+                      : huge >= 0 ? (anon_huge_bytes() - huge) / size
+                                  : -1;
+      r->ns_per_probe = 0;
+
+      for (int rep = 0; rep < reps; rep++) {
+
+        struct perf_sample s;
+        double t0 = wall_ns();
+
+        perf_counters_start(&pc);
+        sink += tlb_probe(table, size / sizeof(uint64_t) - 1);
+        perf_counters_stop(&pc, &s);
+
+        double ns = (wall_ns() - t0) / KTLB_PROBES;
+
+        if (rep == 0 || ns < r->ns_per_probe) {
+          r->ns_per_probe = ns;
+          r->tlb_per_probe = tlb_per_probe(&s, PERF_DTLB_MISSES);
+          r->llc_per_probe = tlb_per_probe(&s, PERF_LLC_MISSES);
+        }
+      }
+
+      printf("%12zu %-8s", r->table_bytes, tlb_backing_name(r->backing));
+      if (r->huge_share < 0)
+        printf(" %7s", "n/a");
+      else
+        printf(" %7.1f", r->huge_share * 100);
+      print_perf_value(r->ns_per_probe);
+      print_perf_value(r->tlb_per_probe);
+      print_perf_value(r->llc_per_probe);
+      printf("\n");
+      fflush(stdout);
+
+      cityhash_arena_destroy(arena);
+    }
+  }
+
+  if (csv_path != NULL)
+    write_tlb_csv(csv_path, results, nresults);
+
+  if (json_path != NULL)
+    write_tlb_json(json_path, results, nresults);
+
+  perf_counters_close(&pc);
+
+  return 0;
+}
+
+static void usage(const char* prog) {
+
+  fprintf(stderr,
+          "usage: %s [-m max_len] [-p pool_mib] [-t min_ms] [-r reps]\n"
+          "       [-v variant] [-H | -C] [-P] [-L [-D] [-n samples]]\n"
+          "       [-N] [-A] [-T] [-j out.json] [-c out.csv]\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+
+  size_t max_len = KMAX_LEN;
+  int max_len_set = 0;
+  size_t pool = (size_t)KPOOL_MIB << 20;
+  double min_ns = KMIN_MS * 1e6;
+  int reps = KREPS;
+  const char* only = NULL;
+  const char* json_path = NULL;
+  const char* csv_path = NULL;
+  int modes[2] = {1, 1};
+  int perf = 0;
+  int latency = 0;
+  int chain = 0;
+  int numa = 0;
+  int lookup = 0;
+  int tlb = 0;
+  size_t samples = KLAT_SAMPLES;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:p:t:r:v:HCPLDNATn:j:c:h")) != -1) {
+    switch (opt) {
+    case 'm':
+      max_len = strtoull(optarg, NULL, 0);
+      max_len_set = 1;
+      break;
+    case 'p':
+      pool = strtoull(optarg, NULL, 0) << 20;
+      break;
+    case 't':
+      min_ns = atof(optarg) * 1e6;
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 'v':
+      only = optarg;
+      break;
+    case 'H':
+      modes[MODE_COLD] = 0;
+      break;
+    case 'C':
+      modes[MODE_HOT] = 0;
+      break;
+    case 'P':
+      perf = 1;
+      break;
+    case 'L':
+      latency = 1;
+      break;
+    case 'D':
+      chain = 1;
+      break;
+    case 'N':
+      numa = 1;
+      break;
+    case 'A':
+      lookup = 1;
+      break;
+    case 'T':
+      tlb = 1;
+      break;
+    case 'n':
+      samples = strtoull(optarg, NULL, 0);
+      break;
+    case 'j':
+      json_path = optarg;
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (reps < 1)
+    reps = 1;
+
+  // every length takes samples plus warm-up calls, and the latency of a
+  // single call of megabytes says nothing the throughput sweep does not
+  if (latency && !max_len_set)
+    max_len = KLAT_MAX_LEN;
+
+  // 0..128, then powers of two
+  size_t lens[256];
+  size_t nlens = 0;
+
+  for (size_t len = 0; len <= 128 && len <= max_len; len++)
+    lens[nlens++] = len;
+
+  for (size_t len = 256; len <= max_len; len <<= 1)
+    lens[nlens++] = len;
+
+  // the lookup and TLB runs build their own tables, a hashing pool would
+  // only take memory from them
+  if (lookup || tlb)
+    return lookup ? run_lookup(reps, json_path, csv_path)
+                  : run_tlb(reps, json_path, csv_path);
+
+  buf_size = max_len > pool ? max_len : pool;
+  offsets = malloc(KOFFSETS * sizeof(size_t));
+
+  // the padded variants may read CITYHASH_PADDING bytes past every key
+  if (posix_memalign((void**)&buf, 64, buf_size + CITYHASH_PADDING) != 0 ||
+      offsets == NULL) {
+    fprintf(stderr, "error: cannot allocate %zu bytes\n", buf_size);
+    return 1;
+  }
+
+  setup_buffer(buf_size + CITYHASH_PADDING);
+
+  if (numa) {
+
+    int rc = run_numa(reps, json_path, csv_path);
+
+    free(offsets);
+    free(buf);
+
+    return rc;
+  }
+
+  if (perf || latency) {
+
+    int rc = perf ? run_perf(only, min_ns, json_path, csv_path)
+                  : run_latency(only, lens, nlens, chain, samples, json_path,
+                                csv_path);
+
+    free(offsets);
+    free(buf);
+
+    return rc;
+  }
+
+  struct bench_result* results =
+      malloc(NVARIANTS * nlens * 2 * sizeof(struct bench_result));
+  size_t nresults = 0;
+
+  printf("%-26s %-4s %11s %14s %14s %10s %10s\n", "variant", "mode", "len",
+         "ns/call", "cycles/call", "cycles/B", "GB/s");
+
+  for (int m = MODE_HOT; m <= MODE_COLD; m++) {
+
+    if (!modes[m])
+      continue;
+
+    for (size_t l = 0; l < nlens; l++) {
+
+      if (m == MODE_COLD)
+        setup_offsets(lens[l]);
+
+      for (size_t v = 0; v < NVARIANTS; v++) {
+
+        if (only != NULL && strcmp(only, variants[v].name) != 0)
+          continue;
+
+        struct bench_result* r = &results[nresults++];
+
+        measure(&variants[v], lens[l], m, min_ns, reps, r);
+        print_result(stdout, r);
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (csv_path != NULL)
+    write_csv(csv_path, results, nresults);
+
+  if (json_path != NULL)
+    write_json(json_path, results, nresults);
+
+  free(results);
+  free(offsets);
+  free(buf);
+
+  return 0;
+}
+
+#endif // BENCHMARKING
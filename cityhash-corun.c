@@ -0,0 +1,453 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Co-run benchmark for the streaming variants.
+//
+// A victim thread walks a random cyclic pointer chain through a working set
+// that fits in the last level cache (-w MiB), one access per cache line, the
+// way a lookup into a cache resident index does.  Next to it a hasher thread
+// hashes a buffer much larger than the cache (-b MiB) over and over, first
+// with cityhash128() (or cityhash256_crc() with -f 256crc) and then with the
+// streaming variant at every prefetch distance given with -d.  Reported are
+// the victim's ns and LLC misses per access, its slowdown against running
+// alone, and the hasher's GB/s.  Times are thread CPU times, so the numbers
+// stay meaningful when both threads have to share a core.
+//
+// usage: cityhash_corun [-w victim_mib] [-b buffer_mib] [-t seconds]
+//                       [-f 128|256crc] [-d 256,1024,4096]
+//                       [-j out.json] [-c out.csv]
+
+#if defined(BENCHMARKING)
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cityhash-bench-util.h"
+#include "cityhash-perf.h"
+#include "cityhash.h"
+
+#define KVICTIM_MIB (32)
+#define KBUFFER_MIB (2048)
+#define KSECONDS (2.0)
+#define KSTEPS (1 << 16)
+#define KMAX_RUNS (32)
+
+// every node's next pointer sits in a cache line of its own
+struct node {
+  struct node* next;
+  uint8_t pad[64 - sizeof(struct node*)];
+};
+
+enum hasher_mode { HASH_NONE = 0, HASH_PLAIN, HASH_STREAM };
+
+struct run_config {
+  enum hasher_mode mode;
+  size_t distance;
+};
+
+struct run_result {
+  struct run_config config;
+  double victim_ns;
+  double victim_llc;
+  double hasher_gbps;
+};
+
+static int use_crc = 0;
+static int stop = 0;
+
+// keeps the compiler from discarding the hash results
+static volatile uint64_t sink;
+
+// link the nodes into a single random cycle (Sattolo's algorithm)
+static struct node* build_chain(size_t n) {
+
+  struct node* nodes = malloc(n * sizeof(struct node));
+  size_t* order = malloc(n * sizeof(size_t));
+  uint64_t state = 42;
+
+  if (nodes == NULL || order == NULL) {
+    free(nodes);
+    free(order);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    order[i] = i;
+
+  for (size_t i = n - 1; i > 0; i--) {
+
+    size_t j = splitmix64(&state) % i;
+    size_t t = order[i];
+
+    order[i] = order[j];
+    order[j] = t;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    nodes[order[i]].next = &nodes[order[(i + 1) % n]];
+
+  free(order);
+
+  return nodes;
+}
+
+struct victim {
+  pthread_t thread;
+  struct node* chain;
+  uint64_t steps;
+  double ns;
+  struct perf_sample perf;
+  int perf_ok;
+};
+
+static void* victim_main(void* p) {
+
+  struct victim* v = p;
+  struct perf_counters pc;
+  struct node* n = v->chain;
+
+  v->perf_ok = perf_counters_open(&pc) > 0;
+  v->steps = 0;
+
+  perf_counters_start(&pc);
+  double t0 = thread_ns();
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+
+    for (int i = 0; i < KSTEPS; i++)
+      n = n->next;
+
+    v->steps += KSTEPS;
+  }
+
+  v->ns = thread_ns() - t0;
+  perf_counters_stop(&pc, &v->perf);
+  perf_counters_close(&pc);
+  sink += (uintptr_t)n;
+
+  return NULL;
+}
+
+struct hasher {
+  pthread_t thread;
+  const uint8_t* buf;
+  size_t len;
+  struct run_config config;
+  uint64_t bytes;
+  double ns;
+};
+
+static uint64_t hash_buffer(const struct hasher* h) {
+
+#if defined(__SSE4_2__) && defined(__x86_64)
+  if (use_crc) {
+
+    uint256_t r = h->config.mode == HASH_STREAM
+                      ? cityhash256_crc_stream(h->buf, h->len,
+                                               h->config.distance)
+                      : cityhash256_crc(h->buf, h->len);
+
+    return r.a;
+  }
+#endif
+
+  uint128_t r = h->config.mode == HASH_STREAM
+                    ? cityhash128_stream(h->buf, h->len, h->config.distance)
+                    : cityhash128(h->buf, h->len);
+
+  return r.a;
+}
+
+static void* hasher_main(void* p) {
+
+  struct hasher* h = p;
+  uint64_t acc = 0;
+
+  h->bytes = 0;
+
+  double t0 = thread_ns();
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    acc += hash_buffer(h);
+    h->bytes += h->len;
+  }
+
+  h->ns = thread_ns() - t0;
+  sink += acc;
+
+  return NULL;
+}
+
+static void run(struct node* chain, const uint8_t* buf, size_t len,
+                double seconds, const struct run_config* config,
+                struct run_result* out) {
+
+  struct victim v = {0};
+  struct hasher h = {0};
+  struct timespec wait = {(time_t)seconds,
+                          (long)((seconds - (time_t)seconds) * 1e9)};
+
+  __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+
+  // warm the working set into the cache before the clock starts
+  v.chain = chain;
+  for (struct node* n = chain->next; n != chain; n = n->next)
+    sink += (uintptr_t)n;
+
+  pthread_create(&v.thread, NULL, victim_main, &v);
+
+  if (config->mode != HASH_NONE) {
+    h.buf = buf;
+    h.len = len;
+    h.config = *config;
+    pthread_create(&h.thread, NULL, hasher_main, &h);
+  }
+
+  nanosleep(&wait, NULL);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+  pthread_join(v.thread, NULL);
+
+  if (config->mode != HASH_NONE)
+    pthread_join(h.thread, NULL);
+
+  out->config = *config;
+  out->victim_ns = v.steps > 0 ? v.ns / v.steps : 0.0;
+  out->victim_llc = v.perf_ok && v.perf.valid[PERF_LLC_MISSES] && v.steps > 0
+                        ? (double)v.perf.value[PERF_LLC_MISSES] / v.steps
+                        : -1.0;
+  out->hasher_gbps = h.ns > 0 ? h.bytes / h.ns : 0.0;
+}
+
+static const char* mode_name(enum hasher_mode mode) {
+
+  switch (mode) {
+  case HASH_PLAIN:
+    return "plain";
+  case HASH_STREAM:
+    return "stream";
+  default:
+    return "alone";
+  }
+}
+
+static double slowdown(const struct run_result* r,
+                       const struct run_result* alone) {
+  return alone->victim_ns > 0 ? (r->victim_ns / alone->victim_ns - 1) * 100
+                              : 0.0;
+}
+
+static void write_csv(const char* path, const struct run_result* r, int n) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "hash,mode,distance,victim_ns,victim_llc,slowdown_pct,"
+             "hasher_gb_per_s\n");
+
+  for (int i = 0; i < n; i++) {
+
+    fprintf(f, "%s,%s,%zu,%.4f,", use_crc ? "cityhash256_crc" : "cityhash128",
+            mode_name(r[i].config.mode), r[i].config.distance, r[i].victim_ns);
+
+    if (r[i].victim_llc >= 0)
+      fprintf(f, "%.6f", r[i].victim_llc);
+
+    fprintf(f, ",%.2f,%.4f\n", slowdown(&r[i], &r[0]), r[i].hasher_gbps);
+  }
+
+  fclose(f);
+}
+
+static void write_json(const char* path, const struct run_result* r, int n,
+                       size_t victim_mib, size_t buffer_mib) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f,
+          "{\n  \"hash\": \"%s\",\n  \"victim_mib\": %zu,\n"
+          "  \"buffer_mib\": %zu,\n  \"results\": [\n",
+          use_crc ? "cityhash256_crc" : "cityhash128", victim_mib, buffer_mib);
+
+  for (int i = 0; i < n; i++) {
+
+    fprintf(f,
+            "    {\"mode\": \"%s\", \"distance\": %zu, \"victim_ns\": %.4f, ",
+            mode_name(r[i].config.mode), r[i].config.distance, r[i].victim_ns);
+
+    if (r[i].victim_llc >= 0)
+      fprintf(f, "\"victim_llc\": %.6f, ", r[i].victim_llc);
+    else
+      fprintf(f, "\"victim_llc\": null, ");
+
+    fprintf(f, "\"slowdown_pct\": %.2f, \"hasher_gb_per_s\": %.4f}%s\n",
+            slowdown(&r[i], &r[0]), r[i].hasher_gbps, i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static void usage(const char* prog) {
+
+  fprintf(stderr,
+          "usage: %s [-w victim_mib] [-b buffer_mib] [-t seconds]\n"
+          "       [-f 128|256crc] [-d 256,1024,4096]\n"
+          "       [-j out.json] [-c out.csv]\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+
+  size_t victim_mib = KVICTIM_MIB;
+  size_t buffer_mib = KBUFFER_MIB;
+  double seconds = KSECONDS;
+  const char* distances_arg = "256,1024,4096";
+  const char* json_path = NULL;
+  const char* csv_path = NULL;
+  struct run_config configs[KMAX_RUNS] = {{HASH_NONE, 0}, {HASH_PLAIN, 0}};
+  int nruns = 2;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:b:t:f:d:j:c:h")) != -1) {
+    switch (opt) {
+    case 'w':
+      victim_mib = strtoull(optarg, NULL, 0);
+      break;
+    case 'b':
+      buffer_mib = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 'f':
+      use_crc = strcmp(optarg, "256crc") == 0;
+      break;
+    case 'd':
+      distances_arg = optarg;
+      break;
+    case 'j':
+      json_path = optarg;
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+#if !defined(__SSE4_2__) || !defined(__x86_64)
+  if (use_crc) {
+    fprintf(stderr, "error: cityhash256_crc needs a build with -msse4.2\n");
+    return 1;
+  }
+#endif
+
+  for (const char* p = distances_arg; *p != '\0' && nruns < KMAX_RUNS;) {
+
+    char* end;
+    long d = strtol(p, &end, 10);
+
+    if (end == p || d < 1) {
+      fprintf(stderr, "error: bad distance list '%s'\n", distances_arg);
+      return 1;
+    }
+
+    configs[nruns].mode = HASH_STREAM;
+    configs[nruns++].distance = (size_t)d;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  if (victim_mib < 1 || buffer_mib < 1 || seconds <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  size_t nodes = (victim_mib << 20) / sizeof(struct node);
+  size_t len = buffer_mib << 20;
+  struct node* chain = build_chain(nodes);
+  uint8_t* buf = malloc(len);
+  struct run_result results[KMAX_RUNS];
+  uint64_t state = 7;
+
+  if (chain == NULL || buf == NULL) {
+    fprintf(stderr, "error: cannot allocate %zu + %zu MiB\n", victim_mib,
+            buffer_mib);
+    return 1;
+  }
+
+  for (size_t i = 0; i < len; i += 8) {
+    uint64_t x = splitmix64(&state);
+    memcpy(buf + i, &x, len - i < 8 ? len - i : 8);
+  }
+
+  printf("# victim %zu MiB pointer chain, hasher %s over %zu MiB\n",
+         victim_mib, use_crc ? "cityhash256_crc" : "cityhash128", buffer_mib);
+  printf("%-8s %9s %12s %12s %10s %10s\n", "mode", "distance", "victim ns",
+         "victim LLC", "slowdown%", "hash GB/s");
+
+  for (int i = 0; i < nruns; i++) {
+
+    struct run_result* r = &results[i];
+
+    run(chain, buf, len, seconds, &configs[i], r);
+
+    printf("%-8s %9zu %12.2f", mode_name(r->config.mode), r->config.distance,
+           r->victim_ns);
+
+    if (r->victim_llc >= 0)
+      printf(" %12.4f", r->victim_llc);
+    else
+      printf(" %12s", "n/a");
+
+    printf(" %10.1f %10.2f\n", slowdown(r, &results[0]), r->hasher_gbps);
+    fflush(stdout);
+  }
+
+  if (csv_path != NULL)
+    write_csv(csv_path, results, nruns);
+
+  if (json_path != NULL)
+    write_json(json_path, results, nruns, victim_mib, buffer_mib);
+
+  free(buf);
+  free(chain);
+
+  return 0;
+}
+
+#endif // BENCHMARKING
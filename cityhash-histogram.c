@@ -0,0 +1,129 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Log-linear histogram for the benchmarks, see cityhash-histogram.h.
+
+#if defined(BENCHMARKING)
+
+#include <string.h>
+
+#include "cityhash-histogram.h"
+
+#define SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+static size_t bucket_index(uint64_t v) {
+
+  if (v < SUB_COUNT)
+    return (size_t)v;
+
+  int shift = 63 - __builtin_clzll(v) - HISTOGRAM_SUB_BITS;
+
+  return ((size_t)(shift + 1) << HISTOGRAM_SUB_BITS) +
+         (size_t)((v >> shift) - SUB_COUNT);
+}
+
+// largest value that falls into bucket i
+static uint64_t bucket_highest(size_t i) {
+
+  if (i < SUB_COUNT)
+    return i;
+
+  int shift = (int)(i >> HISTOGRAM_SUB_BITS) - 1;
+  uint64_t lowest = (uint64_t)(SUB_COUNT + (i & (SUB_COUNT - 1))) << shift;
+
+  return lowest + (((uint64_t)1 << shift) - 1);
+}
+
+void histogram_init(struct histogram* h) {
+
+  memset(h, 0, sizeof(*h));
+  h->min = UINT64_MAX;
+}
+
+void histogram_record(struct histogram* h, uint64_t value) {
+
+  h->buckets[bucket_index(value)]++;
+  h->count++;
+
+  if (value < h->min)
+    h->min = value;
+
+  if (value > h->max)
+    h->max = value;
+}
+
+void histogram_merge(struct histogram* dst, const struct histogram* src) {
+
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+
+  dst->count += src->count;
+
+  if (src->min < dst->min)
+    dst->min = src->min;
+
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const struct histogram* h, double p) {
+
+  if (h->count == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+  uint64_t seen = 0;
+
+  if (rank == 0)
+    rank = 1;
+
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+
+    seen += h->buckets[i];
+
+    if (seen >= rank) {
+      uint64_t v = bucket_highest(i);
+      return v < h->max ? v : h->max;
+    }
+  }
+
+  return h->max;
+}
+
+void histogram_write_json(const struct histogram* h, FILE* f) {
+
+  const char* sep = "";
+
+  fprintf(f, "[");
+
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+
+    if (h->buckets[i] == 0)
+      continue;
+
+    fprintf(f, "%s[%llu, %llu]", sep, (unsigned long long)bucket_highest(i),
+            (unsigned long long)h->buckets[i]);
+    sep = ", ";
+  }
+
+  fprintf(f, "]");
+}
+
+#endif // BENCHMARKING
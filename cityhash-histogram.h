@@ -0,0 +1,56 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Log-linear latency histogram in the style of HdrHistogram.  Every power of
+// two range is split into 2^HISTOGRAM_SUB_BITS equal buckets, so a recorded
+// value is off by at most 1/32 of itself while the whole 64-bit range fits
+// in a fixed array.
+
+#ifndef CITYHASH_HISTOGRAM_H
+#define CITYHASH_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct histogram {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram* h);
+
+void histogram_record(struct histogram* h, uint64_t value);
+
+// add all values recorded in src to dst
+void histogram_merge(struct histogram* dst, const struct histogram* src);
+
+// highest value equivalent to the p-th percentile, 0 <= p <= 100
+uint64_t histogram_percentile(const struct histogram* h, double p);
+
+// write the non-empty buckets as a JSON array of [highest value, count]
+void histogram_write_json(const struct histogram* h, FILE* f);
+
+#endif // CITYHASH_HISTOGRAM_H
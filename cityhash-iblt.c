@@ -0,0 +1,523 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Invertible Bloom lookup tables and strata estimators, see
+// cityhash-iblt.h.
+
+#include <string.h>
+
+#include "cityhash-iblt.h"
+
+// second seed of cityhash64_with_seeds() on a key, and the constants the
+// bits for its indices, its check hash and its stratum are drawn with
+#define KSEED (0x9ae16a3b2f90404fULL)
+#define KINDEX (0xc3a5c85c97cb3127ULL)
+#define KCHECK (0xb492b66fbe98f273ULL)
+#define KSTRATUM (0x9e3779b97f4a7c15ULL)
+
+#define KMAX_HASHES (8)
+
+// a serialized table starts with its seed, cells and hashes, a serialized
+// strata estimator with its seed
+#define KHEADER (24)
+#define KSTRATA_HEADER (8)
+#define KCELL_BYTES (24)
+
+// cells of all strata of an estimator
+#define KSTRATA_TOTAL (CITYHASH_STRATA * CITYHASH_STRATA_CELLS)
+
+struct cell {
+  int64_t count;
+  uint64_t key_sum;
+  uint64_t hash_sum;
+};
+
+struct cityhash_iblt {
+  size_t cells;
+  size_t part; // cells / hashes, the range of each index
+  int hashes;
+  uint64_t seed;
+  struct cell* cell;
+  struct cityhash_allocator allocator;
+};
+
+struct cityhash_strata {
+  uint64_t seed;
+  struct cityhash_iblt stratum[CITYHASH_STRATA];
+  struct cell* cells;
+  struct cityhash_allocator allocator;
+};
+
+static uint64_t key_hash(uint64_t key, uint64_t seed) {
+
+  uint8_t b[8];
+
+  // the bytes of the key in little endian order, so that tables built on
+  // different machines can be subtracted
+  for (int i = 0; i < 8; i++)
+    b[i] = (uint8_t)(key >> (8 * i));
+
+  return cityhash64_with_seeds(b, 8, seed, KSEED);
+}
+
+// independent bits for each use from the one hash of a key (the splitmix64
+// finalizer), several times cheaper than hashing the key once per use
+static uint64_t derive(uint64_t h, uint64_t which) {
+
+  h += which;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+
+  return h ^ (h >> 31);
+}
+
+// one index per part of the table, so the indices of a key never coincide;
+// each gets 32 bits of its own, as indices derived from fewer independent
+// bits (double hashing) make pairs of keys share all their cells far more
+// often and stall the peeling
+static void indices(const struct cityhash_iblt* t, uint64_t h, size_t* idx) {
+
+  uint64_t x = 0;
+
+  for (int j = 0; j < t->hashes; j++) {
+
+    if (j % 2 == 0)
+      x = derive(h, KINDEX * (j / 2 + 1));
+
+    idx[j] = j * t->part + (size_t)(((x & 0xffffffff) * t->part) >> 32);
+    x >>= 32;
+  }
+}
+
+// adds (sign 1) or removes (-1) key of hash h
+static void update(struct cityhash_iblt* t, uint64_t key, uint64_t h,
+                   int64_t sign) {
+
+  size_t idx[KMAX_HASHES];
+  uint64_t check = derive(h, KCHECK);
+
+  indices(t, h, idx);
+
+  for (int j = 0; j < t->hashes; j++) {
+    t->cell[idx[j]].count += sign;
+    t->cell[idx[j]].key_sum ^= key;
+    t->cell[idx[j]].hash_sum ^= check;
+  }
+}
+
+// a cell holding exactly one key, inserted or erased
+static int pure(const struct cityhash_iblt* t, size_t i) {
+
+  const struct cell* c = &t->cell[i];
+
+  return (c->count == 1 || c->count == -1) &&
+         c->hash_sum == derive(key_hash(c->key_sum, t->seed), KCHECK);
+}
+
+// stack and queued hold t->cells entries; see cityhash_iblt_decode()
+static int peel(struct cityhash_iblt* t, size_t* stack, uint8_t* queued,
+                uint64_t* ours, size_t* nours, uint64_t* theirs,
+                size_t* ntheirs, size_t max) {
+
+  size_t top = 0;
+  size_t peeled = 0;
+  size_t no = 0;
+  size_t nt = 0;
+
+  memset(queued, 0, t->cells);
+
+  for (size_t i = 0; i < t->cells; i++) {
+    if (pure(t, i)) {
+      stack[top++] = i;
+      queued[i] = 1;
+    }
+  }
+
+  // every key peeled empties a cell for good, so a table that peels more
+  // keys than it has cells is corrupt
+  while (top > 0 && peeled < t->cells) {
+
+    size_t i = stack[--top];
+
+    queued[i] = 0;
+
+    if (!pure(t, i))
+      continue;
+
+    uint64_t key = t->cell[i].key_sum;
+    int64_t sign = t->cell[i].count;
+    size_t idx[KMAX_HASHES];
+
+    if (sign > 0) {
+      if (ours != NULL && no < max)
+        ours[no] = key;
+      no++;
+    } else {
+      if (theirs != NULL && nt < max)
+        theirs[nt] = key;
+      nt++;
+    }
+
+    uint64_t h = key_hash(key, t->seed);
+
+    update(t, key, h, -sign);
+    peeled++;
+
+    indices(t, h, idx);
+
+    for (int j = 0; j < t->hashes; j++) {
+      if (!queued[idx[j]] && pure(t, idx[j])) {
+        stack[top++] = idx[j];
+        queued[idx[j]] = 1;
+      }
+    }
+  }
+
+  *nours = no;
+  *ntheirs = nt;
+
+  if ((ours != NULL && no > max) || (theirs != NULL && nt > max))
+    return -1;
+
+  for (size_t i = 0; i < t->cells; i++) {
+    if (t->cell[i].count != 0 || t->cell[i].key_sum != 0 ||
+        t->cell[i].hash_sum != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get64(const uint8_t* p) {
+
+  uint64_t v = 0;
+
+  for (int i = 0; i < 8; i++)
+    v |= (uint64_t)p[i] << (8 * i);
+
+  return v;
+}
+
+static void put_cells(uint8_t* out, const struct cell* cell, size_t n) {
+
+  for (size_t i = 0; i < n; i++, out += KCELL_BYTES) {
+    put64(out, (uint64_t)cell[i].count);
+    put64(out + 8, cell[i].key_sum);
+    put64(out + 16, cell[i].hash_sum);
+  }
+}
+
+static void get_cells(struct cell* cell, const uint8_t* buf, size_t n) {
+
+  for (size_t i = 0; i < n; i++, buf += KCELL_BYTES) {
+    cell[i].count = (int64_t)get64(buf);
+    cell[i].key_sum = get64(buf + 8);
+    cell[i].hash_sum = get64(buf + 16);
+  }
+}
+
+size_t cityhash_iblt_cells(size_t difference) {
+
+  // peeling with four hashes succeeds above about 1.3 cells per key in
+  // large tables; small ones need a margin, and the strata estimate can be
+  // a quarter short
+  return 2 * difference + 64;
+}
+
+struct cityhash_iblt* cityhash_iblt_create(
+    size_t cells, int hashes, uint64_t seed,
+    const struct cityhash_allocator* allocator) {
+
+  if (allocator == NULL)
+    allocator = &cityhash_heap_allocator;
+
+  if (hashes == 0)
+    hashes = CITYHASH_IBLT_HASHES;
+
+  if (hashes < 1 || hashes > KMAX_HASHES)
+    return NULL;
+
+  size_t part = cells > 0 ? (cells + hashes - 1) / hashes : 1;
+
+  if (part > UINT32_MAX)
+    return NULL;
+
+  struct cityhash_iblt* t = allocator->alloc(allocator->ctx, sizeof(*t));
+
+  if (t == NULL)
+    return NULL;
+
+  t->cells = part * hashes;
+  t->part = part;
+  t->hashes = hashes;
+  t->seed = seed;
+  t->allocator = *allocator;
+  t->cell = allocator->alloc(allocator->ctx, t->cells * sizeof(struct cell));
+
+  if (t->cell == NULL) {
+    allocator->free(allocator->ctx, t, sizeof(*t));
+    return NULL;
+  }
+
+  memset(t->cell, 0, t->cells * sizeof(struct cell));
+
+  return t;
+}
+
+void cityhash_iblt_destroy(struct cityhash_iblt* iblt) {
+
+  if (iblt == NULL)
+    return;
+
+  struct cityhash_allocator a = iblt->allocator;
+
+  a.free(a.ctx, iblt->cell, iblt->cells * sizeof(struct cell));
+  a.free(a.ctx, iblt, sizeof(*iblt));
+}
+
+size_t cityhash_iblt_size(const struct cityhash_iblt* iblt) {
+  return iblt->cells;
+}
+
+void cityhash_iblt_insert(struct cityhash_iblt* iblt, uint64_t key) {
+  update(iblt, key, key_hash(key, iblt->seed), 1);
+}
+
+void cityhash_iblt_erase(struct cityhash_iblt* iblt, uint64_t key) {
+  update(iblt, key, key_hash(key, iblt->seed), -1);
+}
+
+int cityhash_iblt_subtract(struct cityhash_iblt* a,
+                           const struct cityhash_iblt* b) {
+
+  if (a->cells != b->cells || a->hashes != b->hashes || a->seed != b->seed)
+    return -1;
+
+  for (size_t i = 0; i < a->cells; i++) {
+    a->cell[i].count -= b->cell[i].count;
+    a->cell[i].key_sum ^= b->cell[i].key_sum;
+    a->cell[i].hash_sum ^= b->cell[i].hash_sum;
+  }
+
+  return 0;
+}
+
+int cityhash_iblt_decode(struct cityhash_iblt* iblt, uint64_t* ours,
+                         size_t* nours, uint64_t* theirs, size_t* ntheirs,
+                         size_t max) {
+
+  struct cityhash_allocator a = iblt->allocator;
+  size_t bytes = iblt->cells * (sizeof(size_t) + 1);
+  size_t* stack = a.alloc(a.ctx, bytes);
+
+  *nours = 0;
+  *ntheirs = 0;
+
+  if (stack == NULL)
+    return -1;
+
+  int rc = peel(iblt, stack, (uint8_t*)(stack + iblt->cells), ours, nours,
+                theirs, ntheirs, max);
+
+  a.free(a.ctx, stack, bytes);
+
+  return rc;
+}
+
+size_t cityhash_iblt_bytes(const struct cityhash_iblt* iblt) {
+  return KHEADER + iblt->cells * KCELL_BYTES;
+}
+
+void cityhash_iblt_serialize(const struct cityhash_iblt* iblt, uint8_t* out) {
+
+  put64(out, iblt->seed);
+  put64(out + 8, iblt->cells);
+  put64(out + 16, (uint64_t)iblt->hashes);
+  put_cells(out + KHEADER, iblt->cell, iblt->cells);
+}
+
+struct cityhash_iblt* cityhash_iblt_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator) {
+
+  if (len < KHEADER)
+    return NULL;
+
+  uint64_t seed = get64(buf);
+  uint64_t cells = get64(buf + 8);
+  uint64_t hashes = get64(buf + 16);
+
+  if (hashes < 1 || hashes > KMAX_HASHES || cells == 0 ||
+      cells % hashes != 0 || cells != (len - KHEADER) / KCELL_BYTES ||
+      (len - KHEADER) % KCELL_BYTES != 0)
+    return NULL;
+
+  struct cityhash_iblt* t =
+      cityhash_iblt_create(cells, (int)hashes, seed, allocator);
+
+  if (t != NULL)
+    get_cells(t->cell, buf + KHEADER, cells);
+
+  return t;
+}
+
+struct cityhash_strata* cityhash_strata_create(
+    uint64_t seed, const struct cityhash_allocator* allocator) {
+
+  if (allocator == NULL)
+    allocator = &cityhash_heap_allocator;
+
+  size_t bytes = KSTRATA_TOTAL * sizeof(struct cell);
+  struct cityhash_strata* s = allocator->alloc(allocator->ctx, sizeof(*s));
+
+  if (s == NULL)
+    return NULL;
+
+  s->seed = seed;
+  s->allocator = *allocator;
+  s->cells = allocator->alloc(allocator->ctx, bytes);
+
+  if (s->cells == NULL) {
+    allocator->free(allocator->ctx, s, sizeof(*s));
+    return NULL;
+  }
+
+  memset(s->cells, 0, bytes);
+
+  for (int i = 0; i < CITYHASH_STRATA; i++) {
+
+    struct cityhash_iblt* t = &s->stratum[i];
+
+    t->cells = CITYHASH_STRATA_CELLS;
+    t->part = CITYHASH_STRATA_CELLS / CITYHASH_IBLT_HASHES;
+    t->hashes = CITYHASH_IBLT_HASHES;
+    t->seed = seed;
+    t->cell = s->cells + i * CITYHASH_STRATA_CELLS;
+    t->allocator = *allocator;
+  }
+
+  return s;
+}
+
+void cityhash_strata_destroy(struct cityhash_strata* strata) {
+
+  if (strata == NULL)
+    return;
+
+  struct cityhash_allocator a = strata->allocator;
+
+  a.free(a.ctx, strata->cells, KSTRATA_TOTAL * sizeof(struct cell));
+  a.free(a.ctx, strata, sizeof(*strata));
+}
+
+// stratum i takes the keys whose stratum bits end in exactly i zeros
+static void strata_update(struct cityhash_strata* s, uint64_t key,
+                          int64_t sign) {
+
+  uint64_t h = key_hash(key, s->seed);
+  uint64_t z = derive(h, KSTRATUM);
+  int i = z != 0 ? __builtin_ctzll(z) : CITYHASH_STRATA - 1;
+
+  if (i >= CITYHASH_STRATA)
+    i = CITYHASH_STRATA - 1;
+
+  update(&s->stratum[i], key, h, sign);
+}
+
+void cityhash_strata_insert(struct cityhash_strata* strata, uint64_t key) {
+  strata_update(strata, key, 1);
+}
+
+void cityhash_strata_erase(struct cityhash_strata* strata, uint64_t key) {
+  strata_update(strata, key, -1);
+}
+
+int cityhash_strata_subtract(struct cityhash_strata* a,
+                             const struct cityhash_strata* b) {
+
+  if (a->seed != b->seed)
+    return -1;
+
+  for (int i = 0; i < CITYHASH_STRATA; i++)
+    cityhash_iblt_subtract(&a->stratum[i], &b->stratum[i]);
+
+  return 0;
+}
+
+size_t cityhash_strata_estimate(const struct cityhash_strata* strata) {
+
+  struct cell cell[CITYHASH_STRATA_CELLS];
+  size_t stack[CITYHASH_STRATA_CELLS];
+  uint8_t queued[CITYHASH_STRATA_CELLS];
+  size_t count = 0;
+
+  // from the sparsest stratum down; the first that does not peel holds
+  // about as many keys as all the sparser ones together
+  for (int i = CITYHASH_STRATA - 1; i >= 0; i--) {
+
+    struct cityhash_iblt t = strata->stratum[i];
+    size_t no;
+    size_t nt;
+
+    memcpy(cell, t.cell, sizeof(cell));
+    t.cell = cell;
+
+    if (peel(&t, stack, queued, NULL, &no, NULL, &nt, 0))
+      return count << (i + 1);
+
+    count += no + nt;
+  }
+
+  return count;
+}
+
+size_t cityhash_strata_bytes(const struct cityhash_strata* strata) {
+  return KSTRATA_HEADER + KSTRATA_TOTAL * KCELL_BYTES;
+}
+
+void cityhash_strata_serialize(const struct cityhash_strata* strata,
+                               uint8_t* out) {
+
+  put64(out, strata->seed);
+  put_cells(out + KSTRATA_HEADER, strata->cells, KSTRATA_TOTAL);
+}
+
+struct cityhash_strata* cityhash_strata_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator) {
+
+  if (len != KSTRATA_HEADER + KSTRATA_TOTAL * KCELL_BYTES)
+    return NULL;
+
+  struct cityhash_strata* s = cityhash_strata_create(get64(buf), allocator);
+
+  if (s != NULL)
+    get_cells(s->cells, buf + KSTRATA_HEADER, KSTRATA_TOTAL);
+
+  return s;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Invertible Bloom lookup tables for set reconciliation.  Two replicas
+// holding nearly the same set of 64-bit keys each insert their keys into a
+// table of the same shape; one sends its table, the other subtracts it from
+// its own and peels out the keys only one of them has.  A table needs about
+// 2 cells (24 bytes each) per differing key, whatever the size of the sets,
+// so the traffic is proportional to the difference.  Cell indices and the
+// check hash of a key are drawn from one cityhash64_with_seeds() of it.
+// Keys that are strings are reconciled through their cityhash64(); the
+// peeled hashes then name the strings to send.
+//
+// The difference is estimated first with a strata estimator: 32 small
+// tables, where a key goes to stratum i with probability 2^-(i+1).  Both
+// sides fill one with their whole set, one is sent (about 60 KiB) and
+// subtracted from the other, and the strata that still peel give the
+// estimate from which cityhash_iblt_cells() sizes the real table.
+
+#ifndef CITYHASH_IBLT_H
+#define CITYHASH_IBLT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash-arena.h"
+#include "cityhash.h"
+
+// cell indices per key when the caller has no preference
+#define CITYHASH_IBLT_HASHES (4)
+
+// strata and cells per stratum of a strata estimator
+#define CITYHASH_STRATA (32)
+#define CITYHASH_STRATA_CELLS (80)
+
+struct cityhash_iblt;
+struct cityhash_strata;
+
+// cells that decode a difference of difference keys, as estimated by a
+// strata estimator, with high probability
+size_t cityhash_iblt_cells(size_t difference);
+
+// a table of cells cells (rounded up to a multiple of hashes) where every
+// key touches hashes cells (0 for CITYHASH_IBLT_HASHES, at most 8); tables
+// can only be subtracted if they have the same shape and seed; allocator
+// may be NULL for the heap; NULL if the memory cannot be allocated
+struct cityhash_iblt* cityhash_iblt_create(
+    size_t cells, int hashes, uint64_t seed,
+    const struct cityhash_allocator* allocator);
+
+void cityhash_iblt_destroy(struct cityhash_iblt* iblt);
+
+size_t cityhash_iblt_size(const struct cityhash_iblt* iblt);
+
+void cityhash_iblt_insert(struct cityhash_iblt* iblt, uint64_t key);
+void cityhash_iblt_erase(struct cityhash_iblt* iblt, uint64_t key);
+
+// a -= b, cell by cell; -1 if the tables differ in shape or seed
+int cityhash_iblt_subtract(struct cityhash_iblt* a,
+                           const struct cityhash_iblt* b);
+
+// peels the table, which empties it: the keys inserted more often than
+// erased go to ours and the others to theirs, at most max to each (either
+// may be NULL to only count); after a -= b, ours are the keys only in a.
+// Returns 0 if the table peeled completely, -1 if it is too full to (what
+// was peeled is still reported) or an output overflowed.
+int cityhash_iblt_decode(struct cityhash_iblt* iblt, uint64_t* ours,
+                         size_t* nours, uint64_t* theirs, size_t* ntheirs,
+                         size_t max);
+
+// bytes cityhash_iblt_serialize() writes
+size_t cityhash_iblt_bytes(const struct cityhash_iblt* iblt);
+
+// writes the table in a portable (little endian) form to out
+void cityhash_iblt_serialize(const struct cityhash_iblt* iblt, uint8_t* out);
+
+// a table from len bytes of cityhash_iblt_serialize(); NULL if they are
+// malformed or the memory cannot be allocated
+struct cityhash_iblt* cityhash_iblt_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator);
+
+// a strata estimator, see above
+struct cityhash_strata* cityhash_strata_create(
+    uint64_t seed, const struct cityhash_allocator* allocator);
+
+void cityhash_strata_destroy(struct cityhash_strata* strata);
+
+void cityhash_strata_insert(struct cityhash_strata* strata, uint64_t key);
+void cityhash_strata_erase(struct cityhash_strata* strata, uint64_t key);
+
+// a -= b; -1 if the seeds differ
+int cityhash_strata_subtract(struct cityhash_strata* a,
+                             const struct cityhash_strata* b);
+
+// the estimated number of keys in a difference a -= b; a is left as it is
+size_t cityhash_strata_estimate(const struct cityhash_strata* strata);
+
+size_t cityhash_strata_bytes(const struct cityhash_strata* strata);
+void cityhash_strata_serialize(const struct cityhash_strata* strata,
+                               uint8_t* out);
+struct cityhash_strata* cityhash_strata_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator);
+
+#endif // CITYHASH_IBLT_H
@@ -0,0 +1,90 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Interleaved hash-and-probe lookups, see cityhash-lookup.h.
+
+#include "cityhash-lookup.h"
+
+enum slot_state { SLOT_FREE, SLOT_HASH, SLOT_PROBE };
+
+struct slot {
+  enum slot_state state;
+  size_t i;
+  uint64_t hash;
+  const void* at;
+};
+
+void cityhash64_lookup_batch(const struct cityhash_lookup* lookup,
+                             const uint8_t* const* keys, const size_t* lens,
+                             size_t n, int inflight) {
+
+  struct slot slot[CITYHASH_LOOKUP_MAX_INFLIGHT];
+  size_t next = 0;
+  size_t done = 0;
+
+  if (inflight <= 0)
+    inflight = CITYHASH_LOOKUP_INFLIGHT;
+
+  if (inflight > CITYHASH_LOOKUP_MAX_INFLIGHT)
+    inflight = CITYHASH_LOOKUP_MAX_INFLIGHT;
+
+  for (int k = 0; k < inflight; k++)
+    slot[k].state = SLOT_FREE;
+
+  while (done < n) {
+
+    for (int k = 0; k < inflight; k++) {
+
+      struct slot* s = &slot[k];
+
+      switch (s->state) {
+      case SLOT_PROBE:
+        s->at = lookup->probe(lookup->table, s->i, s->hash, s->at);
+
+        if (s->at != NULL) {
+          __builtin_prefetch(s->at, 0, 3);
+          break;
+        }
+
+        done++;
+        s->state = SLOT_FREE;
+        // a finished slot starts the next lookup right away
+        // fall through
+      case SLOT_FREE:
+        if (next == n)
+          break;
+
+        s->i = next++;
+        s->state = SLOT_HASH;
+        __builtin_prefetch(keys[s->i], 0, 3);
+        break;
+
+      case SLOT_HASH:
+        s->hash = cityhash64(keys[s->i], lens[s->i]);
+        s->at = lookup->bucket(lookup->table, s->hash);
+        s->state = SLOT_PROBE;
+        __builtin_prefetch(s->at, 0, 3);
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Batched hash table lookups that keep several lookups in flight
+// (asynchronous memory access chaining, Kocberber et al., VLDB 2015).  A
+// lookup is a small state machine: its key is prefetched, then hashed with
+// cityhash64() and its first bucket prefetched, then the table's probe
+// callback looks at the bucket and either finishes or names the next address
+// to visit, which is prefetched in turn.  The executor moves round-robin
+// over its slots, so while one lookup waits for its bucket the others are
+// hashed and probed, and the cache misses of a batch overlap instead of
+// following each other.  The table layout is the caller's.
+
+#ifndef CITYHASH_LOOKUP_H
+#define CITYHASH_LOOKUP_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash.h"
+
+// lookups in flight when 0 is passed, enough to cover a DRAM miss with a
+// few short keys hashed per lookup
+#define CITYHASH_LOOKUP_INFLIGHT (16)
+
+// most lookups in flight
+#define CITYHASH_LOOKUP_MAX_INFLIGHT (64)
+
+struct cityhash_lookup {
+  void* table;
+
+  // address of the first bucket of hash
+  const void* (*bucket)(void* table, uint64_t hash);
+
+  // looks at the bucket at for key i, the one that hashes to hash; returns
+  // the address to look at next or NULL once lookup i is finished, results
+  // are for the callback to store
+  const void* (*probe)(void* table, size_t i, uint64_t hash, const void* at);
+};
+
+// looks up keys[i] of lens[i] bytes for i < n with up to inflight lookups
+// (0 for CITYHASH_LOOKUP_INFLIGHT) interleaved; probe is called for the
+// buckets of each lookup in order, lookups finish out of order
+void cityhash64_lookup_batch(const struct cityhash_lookup* lookup,
+                             const uint8_t* const* keys, const size_t* lens,
+                             size_t n, int inflight);
+
+#endif // CITYHASH_LOOKUP_H
@@ -0,0 +1,398 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// NUMA-aware parallel column hashing, see cityhash-numa.h.
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cityhash-numa.h"
+#include "cityhash.h"
+
+// rows per chunk, the unit that is located and handed to a thread
+#define KCHUNK_ROWS (16384)
+
+#define KMAX_CPUS (4096)
+
+struct topology {
+  int nodes;
+  int id[CITYHASH_NUMA_MAX_NODES];
+  int cpus[CITYHASH_NUMA_MAX_NODES];
+#if defined(__linux__)
+  int pinned;
+  cpu_set_t cpuset[CITYHASH_NUMA_MAX_NODES];
+#endif
+};
+
+static struct topology topo;
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+// reads a sysfs list such as "0-3,8,10-11" into ids, returns the number of
+// entries or -1 if the file cannot be read
+static int read_list(const char* path, int* ids, int max) {
+
+  FILE* f = fopen(path, "r");
+  char line[4096];
+  int n = 0;
+
+  if (f == NULL)
+    return -1;
+
+  if (fgets(line, sizeof(line), f) == NULL) {
+    fclose(f);
+    return -1;
+  }
+
+  fclose(f);
+
+  for (char* p = line; *p >= '0' && *p <= '9';) {
+
+    long lo = strtol(p, &p, 10);
+    long hi = lo;
+
+    if (*p == '-')
+      hi = strtol(p + 1, &p, 10);
+
+    for (long i = lo; i <= hi && n < max; i++)
+      ids[n++] = (int)i;
+
+    if (*p == ',')
+      p++;
+  }
+
+  return n;
+}
+
+static void discover_topology(void) {
+
+  static int cpus[KMAX_CPUS];
+  int ids[CITYHASH_NUMA_MAX_NODES];
+  int n = read_list("/sys/devices/system/node/online", ids,
+                    CITYHASH_NUMA_MAX_NODES);
+
+  for (int i = 0; i < n; i++) {
+
+    char path[64];
+    int m;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             ids[i]);
+    m = read_list(path, cpus, KMAX_CPUS);
+
+    // memory-only nodes get no threads
+    if (m <= 0)
+      continue;
+
+    topo.id[topo.nodes] = ids[i];
+    topo.cpus[topo.nodes] = m;
+
+#if defined(__linux__)
+    CPU_ZERO(&topo.cpuset[topo.nodes]);
+
+    for (int c = 0; c < m; c++) {
+      if (cpus[c] < CPU_SETSIZE)
+        CPU_SET(cpus[c], &topo.cpuset[topo.nodes]);
+    }
+
+    topo.pinned = 1;
+#endif
+
+    topo.nodes++;
+  }
+
+  if (topo.nodes == 0) {
+
+    long m = sysconf(_SC_NPROCESSORS_ONLN);
+
+    topo.nodes = 1;
+    topo.id[0] = 0;
+    topo.cpus[0] = m > 0 ? (int)m : 1;
+  }
+}
+
+static const struct topology* topology(void) {
+
+  pthread_once(&topo_once, discover_topology);
+
+  return &topo;
+}
+
+int cityhash_numa_nodes(void) { return topology()->nodes; }
+
+// topology index of the node that holds the first key byte of every chunk;
+// chunks whose pages cannot be located are spread over the nodes
+static void locate_chunks(const struct topology* t, const uint8_t* data,
+                          const uint32_t* offsets, size_t nchunks,
+                          int* where) {
+
+  for (size_t c = 0; c < nchunks; c++)
+    where[c] = (int)(c % t->nodes);
+
+#if defined(__linux__) && defined(SYS_move_pages)
+  if (t->nodes < 2)
+    return;
+
+  void** pages = malloc(nchunks * sizeof(void*));
+  int* status = malloc(nchunks * sizeof(int));
+  uintptr_t mask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+
+  if (pages != NULL && status != NULL) {
+
+    for (size_t c = 0; c < nchunks; c++)
+      pages[c] = (void*)((uintptr_t)(data + offsets[c * KCHUNK_ROWS]) & mask);
+
+    // with nodes == NULL move_pages() moves nothing and only reports the
+    // node of every page, or a negative errno for pages not faulted in yet
+    if (syscall(SYS_move_pages, 0, nchunks, pages, NULL, status, 0) == 0) {
+      for (size_t c = 0; c < nchunks; c++) {
+        for (int k = 0; k < t->nodes; k++) {
+          if (status[c] == t->id[k])
+            where[c] = k;
+        }
+      }
+    }
+  }
+
+  free(status);
+  free(pages);
+#else
+  (void)data;
+  (void)offsets;
+#endif
+}
+
+// chunks of one node, taken from next on by the threads of every node
+struct node_queue {
+  size_t next;
+  size_t end;
+} __attribute__((aligned(64)));
+
+struct job {
+  const uint8_t* data;
+  const uint32_t* offsets;
+  size_t n;
+  uint64_t* out;
+  int nodes;
+  const size_t* chunks;
+  struct node_queue* queue;
+};
+
+struct worker {
+  pthread_t thread;
+  const struct job* job;
+  int node;
+  int started;
+  uint64_t rows;
+  uint64_t bytes;
+  uint64_t local_bytes;
+  double done;
+} __attribute__((aligned(64)));
+
+static double now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void* worker_main(void* p) {
+
+  struct worker* w = p;
+  const struct job* job = w->job;
+
+  // own node first, then help the others in turn
+  for (int i = 0; i < job->nodes; i++) {
+
+    int k = (w->node + i) % job->nodes;
+    struct node_queue* q = &job->queue[k];
+
+    for (;;) {
+
+      size_t at = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+
+      if (at >= q->end)
+        break;
+
+      size_t first = job->chunks[at] * KCHUNK_ROWS;
+      size_t rows = job->n - first < KCHUNK_ROWS ? job->n - first : KCHUNK_ROWS;
+      uint64_t bytes = job->offsets[first + rows] - job->offsets[first];
+
+      cityhash64_batch_offsets(job->data, job->offsets + first, rows,
+                               job->out + first);
+
+      w->rows += rows;
+      w->bytes += bytes;
+
+      if (k == w->node)
+        w->local_bytes += bytes;
+    }
+  }
+
+  w->done = now_ns();
+
+  return NULL;
+}
+
+// starts the threads of every node on job and waits for them
+static void run_workers(const struct topology* t, const struct job* job,
+                        struct worker* workers, int threads_per_node,
+                        struct cityhash_numa_report* report) {
+
+  int nthreads = 0;
+  int started = 0;
+  double t0 = now_ns();
+
+  for (int k = 0; k < t->nodes; k++) {
+
+    int m = threads_per_node > 0 ? threads_per_node : t->cpus[k];
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+
+#if defined(__linux__)
+    if (t->pinned)
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &t->cpuset[k]);
+#endif
+
+    for (int j = 0; j < m; j++, nthreads++) {
+
+      struct worker* w = &workers[nthreads];
+
+      memset(w, 0, sizeof(*w));
+      w->job = job;
+      w->node = k;
+      w->started = pthread_create(&w->thread, &attr, worker_main, w) == 0;
+      started += w->started;
+    }
+
+    pthread_attr_destroy(&attr);
+  }
+
+  // no thread could be started, the calling thread does all the work
+  if (started == 0)
+    worker_main(&workers[0]);
+
+  for (int i = 0; i < nthreads; i++) {
+    if (workers[i].started)
+      pthread_join(workers[i].thread, NULL);
+  }
+
+  if (report == NULL)
+    return;
+
+  for (int i = 0; i < nthreads; i++) {
+
+    struct cityhash_numa_node* r = &report->node[workers[i].node];
+    double seconds = (workers[i].done - t0) / 1e9;
+
+    r->threads += workers[i].started;
+    r->rows += workers[i].rows;
+    r->bytes += workers[i].bytes;
+    r->local_bytes += workers[i].local_bytes;
+
+    if (workers[i].done > 0 && seconds > r->seconds)
+      r->seconds = seconds;
+  }
+}
+
+void cityhash64_numa_batch_offsets(const uint8_t* data,
+                                   const uint32_t* offsets, size_t n,
+                                   uint64_t* out, int threads_per_node,
+                                   struct cityhash_numa_report* report) {
+
+  const struct topology* t = topology();
+  size_t nchunks = (n + KCHUNK_ROWS - 1) / KCHUNK_ROWS;
+  int nthreads = 0;
+
+  for (int k = 0; k < t->nodes; k++)
+    nthreads += threads_per_node > 0 ? threads_per_node : t->cpus[k];
+
+  int* where = malloc((nchunks + 1) * sizeof(int));
+  size_t* chunks = malloc((nchunks + 1) * sizeof(size_t));
+  struct node_queue* queue = NULL;
+  struct worker* workers = NULL;
+
+  if (posix_memalign((void**)&queue, 64, t->nodes * sizeof(*queue)) != 0)
+    queue = NULL;
+
+  if (posix_memalign((void**)&workers, 64, nthreads * sizeof(*workers)) != 0)
+    workers = NULL;
+
+  if (report != NULL) {
+
+    memset(report, 0, sizeof(*report));
+    report->nodes = t->nodes;
+
+    for (int k = 0; k < t->nodes; k++)
+      report->node[k].node = t->id[k];
+  }
+
+  if (where != NULL && chunks != NULL && queue != NULL && workers != NULL) {
+
+    locate_chunks(t, data, offsets, nchunks, where);
+
+    // group the chunks by node, in column order within a node
+    size_t at = 0;
+
+    for (int k = 0; k < t->nodes; k++) {
+
+      queue[k].next = at;
+
+      for (size_t c = 0; c < nchunks; c++) {
+        if (where[c] == k)
+          chunks[at++] = c;
+      }
+
+      queue[k].end = at;
+    }
+
+    struct job job = {data, offsets, n, out, t->nodes, chunks, queue};
+
+    run_workers(t, &job, workers, threads_per_node, report);
+
+  } else {
+
+    // out of memory, hash the column on the calling thread
+    cityhash64_batch_offsets(data, offsets, n, out);
+
+    if (report != NULL) {
+      report->node[0].rows = n;
+      report->node[0].bytes = offsets[n] - offsets[0];
+    }
+  }
+
+  free(workers);
+  free(queue);
+  free(chunks);
+  free(where);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// NUMA-aware parallel hashing of a string column.  The column is cut into
+// chunks of consecutive rows, the node that holds each chunk's key bytes is
+// looked up with move_pages(2), and every chunk is hashed by a thread pinned
+// to that node; a node's threads help the other nodes once their own chunks
+// are done.  Rows are written to out by the thread that hashes them, so out
+// pages that have not been touched yet are placed on the node of their keys.
+// Topology comes from /sys/devices/system/node; without it (or outside
+// Linux) the whole machine is treated as one node.
+
+#ifndef CITYHASH_NUMA_H
+#define CITYHASH_NUMA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CITYHASH_NUMA_MAX_NODES (64)
+
+// what the threads of one node did during a call
+struct cityhash_numa_node {
+  int node;             // node id as in /sys/devices/system/node
+  int threads;          // threads pinned to the node
+  uint64_t rows;        // rows hashed by those threads
+  uint64_t bytes;       // key bytes hashed by those threads
+  uint64_t local_bytes; // part of bytes that was stored on the node
+  double seconds;       // from the start until the node's last thread is done
+};
+
+struct cityhash_numa_report {
+  int nodes;
+  struct cityhash_numa_node node[CITYHASH_NUMA_MAX_NODES];
+};
+
+// number of NUMA nodes with CPUs, at least 1
+int cityhash_numa_nodes(void);
+
+// cityhash64_batch_offsets() of a column with threads_per_node threads on
+// every node, 0 meaning one per CPU of the node; report, if not NULL,
+// receives per-node row and byte counts and timings
+void cityhash64_numa_batch_offsets(const uint8_t* data,
+                                   const uint32_t* offsets, size_t n,
+                                   uint64_t* out, int threads_per_node,
+                                   struct cityhash_numa_report* report);
+
+#endif // CITYHASH_NUMA_H
@@ -0,0 +1,500 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Work-stealing parallel hashing, see cityhash-parallel.h.
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cityhash-parallel.h"
+
+// tasks a deque can hold; splitting halves a task, so a deque never holds
+// more than one task per bit of size_t plus the rest of a task cut at a huge
+// key, and a push into a full deque just hashes the task in place
+#define KDEQUE (128)
+
+// keys of an offsets job handed to cityhash128_batch() at a time
+#define KOFFSETS_CHUNK (64)
+
+struct task {
+  size_t lo;
+  size_t hi;
+};
+
+// Chase-Lev deque: the owner pushes and pops at bottom, thieves take from
+// top; fields are accessed with atomics so that a thief's read of a slot
+// the owner is overwriting is merely discarded when its CAS on top fails
+// (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for
+// Weak Memory Models", PPoPP 2013)
+struct deque {
+  long top __attribute__((aligned(64)));
+  long bottom __attribute__((aligned(64)));
+  struct task slot[KDEQUE];
+};
+
+static int deque_push(struct deque* d, struct task t) {
+
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  struct task* s = &d->slot[b & (KDEQUE - 1)];
+
+  if (b - top >= KDEQUE)
+    return 0;
+
+  __atomic_store_n(&s->lo, t.lo, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->hi, t.hi, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+  return 1;
+}
+
+static int deque_pop(struct deque* d, struct task* t) {
+
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  long top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+  if (top > b) {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  struct task* s = &d->slot[b & (KDEQUE - 1)];
+
+  t->lo = __atomic_load_n(&s->lo, __ATOMIC_RELAXED);
+  t->hi = __atomic_load_n(&s->hi, __ATOMIC_RELAXED);
+
+  if (top < b)
+    return 1;
+
+  // last task, race the thieves for it
+  int won = __atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+  return won;
+}
+
+static int deque_steal(struct deque* d, struct task* t) {
+
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+  if (top >= b)
+    return 0;
+
+  struct task* s = &d->slot[top & (KDEQUE - 1)];
+
+  t->lo = __atomic_load_n(&s->lo, __ATOMIC_RELAXED);
+  t->hi = __atomic_load_n(&s->hi, __ATOMIC_RELAXED);
+
+  return __atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+enum job_kind { JOB_64, JOB_128, JOB_64_OFFSETS, JOB_128_OFFSETS };
+
+struct job {
+  enum job_kind kind;
+  const uint8_t* const* bufs;
+  const size_t* lens;
+  const uint8_t* data;
+  const uint32_t* offsets;
+  uint64_t* out64;
+  uint128_t* out128;
+};
+
+struct cityhash_pool {
+  int threads;
+  pthread_t* thread;
+  struct deque* deques;
+
+  // serializes calls
+  pthread_mutex_t call;
+
+  // hands a job to the threads and waits for them to let go of it
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  uint64_t generation;
+  int busy;
+  int stop;
+  const struct job* job;
+
+  // keys not hashed yet, the job is done at 0
+  size_t remaining __attribute__((aligned(64)));
+
+  // tasks taken from another thread's deque since the pool was created
+  uint64_t steals __attribute__((aligned(64)));
+};
+
+struct worker_arg {
+  struct cityhash_pool* pool;
+  int id;
+};
+
+// first key of lo ... hi - 1 that has at least CITYHASH_TASK_BYTES, or hi
+static size_t next_huge(const struct job* job, size_t lo, size_t hi) {
+
+  size_t i = lo;
+
+  if (job->lens != NULL) {
+    while (i < hi && job->lens[i] < CITYHASH_TASK_BYTES)
+      i++;
+  } else {
+    while (i < hi &&
+           job->offsets[i + 1] - job->offsets[i] < CITYHASH_TASK_BYTES)
+      i++;
+  }
+
+  return i;
+}
+
+// keys lo ... hi - 1, through the batch functions where there are some
+static void hash_keys(const struct job* job, size_t lo, size_t hi) {
+
+  switch (job->kind) {
+  case JOB_64:
+    cityhash64_batch(job->bufs + lo, job->lens + lo, hi - lo, job->out64 + lo);
+    break;
+  case JOB_128:
+    cityhash128_batch(job->bufs + lo, job->lens + lo, hi - lo,
+                      job->out128 + lo);
+    break;
+  case JOB_64_OFFSETS:
+    cityhash64_batch_offsets(job->data, job->offsets + lo, hi - lo,
+                             job->out64 + lo);
+    break;
+  case JOB_128_OFFSETS:
+    // there is no offsets variant of cityhash128_batch(), the keys are
+    // turned into pointers and lengths a chunk at a time
+    for (size_t i = lo; i < hi; i += KOFFSETS_CHUNK) {
+
+      const uint8_t* bufs[KOFFSETS_CHUNK];
+      size_t lens[KOFFSETS_CHUNK];
+      size_t n = hi - i < KOFFSETS_CHUNK ? hi - i : KOFFSETS_CHUNK;
+
+      for (size_t j = 0; j < n; j++) {
+        bufs[j] = job->data + job->offsets[i + j];
+        lens[j] = job->offsets[i + j + 1] - job->offsets[i + j];
+      }
+
+      cityhash128_batch(bufs, lens, n, job->out128 + i);
+    }
+    break;
+  }
+}
+
+// a task is split while it has more than CITYHASH_TASK_KEYS keys, or more
+// than CITYHASH_TASK_BYTES key bytes
+static inline int splittable(const struct job* job, struct task t) {
+
+  if (t.hi - t.lo > CITYHASH_TASK_KEYS)
+    return 1;
+
+  if (t.hi - t.lo < 2)
+    return 0;
+
+  if (job->offsets != NULL)
+    return job->offsets[t.hi] - job->offsets[t.lo] > CITYHASH_TASK_BYTES;
+
+  size_t bytes = 0;
+
+  for (size_t i = t.lo; i < t.hi && bytes <= CITYHASH_TASK_BYTES; i++)
+    bytes += job->lens[i];
+
+  return bytes > CITYHASH_TASK_BYTES;
+}
+
+static void run_task(struct cityhash_pool* pool, struct deque* d,
+                     const struct job* job, struct task t) {
+
+  while (splittable(job, t)) {
+
+    struct task rest = {t.lo + (t.hi - t.lo) / 2, t.hi};
+
+    if (!deque_push(d, rest))
+      break;
+
+    t.hi = rest.lo;
+  }
+
+  size_t done = t.hi - t.lo;
+
+  for (size_t i = t.lo; i < t.hi;) {
+
+    size_t huge = next_huge(job, i, t.hi);
+
+    hash_keys(job, i, huge);
+
+    if (huge == t.hi)
+      break;
+
+    // let the keys behind a huge one be stolen while it is hashed
+    if (huge + 1 < t.hi) {
+
+      struct task rest = {huge + 1, t.hi};
+
+      if (deque_push(d, rest)) {
+        done -= t.hi - rest.lo;
+        t.hi = rest.lo;
+      }
+    }
+
+    hash_keys(job, huge, huge + 1);
+    i = huge + 1;
+  }
+
+  __atomic_fetch_sub(&pool->remaining, done, __ATOMIC_RELEASE);
+}
+
+// pop own tasks, steal when there are none, until every key is hashed
+static void run_job(struct cityhash_pool* pool, int id, const struct job* job) {
+
+  struct deque* d = &pool->deques[id];
+  struct task t;
+
+  while (__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) > 0) {
+
+    if (deque_pop(d, &t)) {
+      run_task(pool, d, job, t);
+      continue;
+    }
+
+    int stolen = 0;
+
+    for (int i = 1; i < pool->threads && !stolen; i++)
+      stolen = deque_steal(&pool->deques[(id + i) % pool->threads], &t);
+
+    if (stolen) {
+      __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+      run_task(pool, d, job, t);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+static void* worker_main(void* p) {
+
+  struct worker_arg* arg = p;
+  struct cityhash_pool* pool = arg->pool;
+  int id = arg->id;
+  uint64_t seen = 0;
+
+  free(arg);
+
+  for (;;) {
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->generation == seen && !pool->stop)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+
+    seen = pool->generation;
+
+    const struct job* job = pool->job;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    run_job(pool, id, job);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->idle);
+
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  return NULL;
+}
+
+struct cityhash_pool* cityhash_pool_create(int threads) {
+
+  if (threads <= 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = n > 0 ? (int)n : 1;
+  }
+
+  struct cityhash_pool* pool;
+
+  if (posix_memalign((void**)&pool, 64, sizeof(*pool)) != 0)
+    return NULL;
+
+  memset(pool, 0, sizeof(*pool));
+  pool->thread = malloc(threads * sizeof(pthread_t));
+
+  if (pool->thread == NULL ||
+      posix_memalign((void**)&pool->deques, 64,
+                     threads * sizeof(struct deque)) != 0) {
+    free(pool->thread);
+    free(pool);
+    return NULL;
+  }
+
+  memset(pool->deques, 0, threads * sizeof(struct deque));
+  pthread_mutex_init(&pool->call, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  // slot 0 is the calling thread's, a thread that cannot be started just
+  // leaves the pool smaller
+  pool->threads = 1;
+
+  for (int i = 1; i < threads; i++) {
+
+    struct worker_arg* arg = malloc(sizeof(*arg));
+
+    if (arg == NULL)
+      break;
+
+    arg->pool = pool;
+    arg->id = pool->threads;
+
+    if (pthread_create(&pool->thread[pool->threads], NULL, worker_main, arg) !=
+        0) {
+      free(arg);
+      break;
+    }
+
+    pool->threads++;
+  }
+
+  return pool;
+}
+
+void cityhash_pool_destroy(struct cityhash_pool* pool) {
+
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 1; i < pool->threads; i++)
+    pthread_join(pool->thread[i], NULL);
+
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->call);
+  free(pool->deques);
+  free(pool->thread);
+  free(pool);
+}
+
+int cityhash_pool_threads(const struct cityhash_pool* pool) {
+  return pool != NULL ? pool->threads : 1;
+}
+
+uint64_t cityhash_pool_steals(const struct cityhash_pool* pool) {
+  return pool != NULL ? __atomic_load_n(&pool->steals, __ATOMIC_RELAXED) : 0;
+}
+
+static void run(struct cityhash_pool* pool, const struct job* job, size_t n) {
+
+  struct task all = {0, n};
+
+  // small enough to never be split, so not worth waking the threads for
+  if (pool == NULL || pool->threads == 1 || !splittable(job, all)) {
+    hash_keys(job, 0, n);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->call);
+
+  // the whole job is on the caller's deque before anyone may steal
+  __atomic_store_n(&pool->remaining, n, __ATOMIC_RELAXED);
+  deque_push(&pool->deques[0], all);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->job = job;
+  pool->busy = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  run_job(pool, 0, job);
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->busy > 0)
+    pthread_cond_wait(&pool->idle, &pool->lock);
+
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->call);
+}
+
+void cityhash64_parallel(struct cityhash_pool* pool,
+                         const uint8_t* const* bufs, const size_t* lens,
+                         size_t n, uint64_t* out) {
+
+  struct job job = {JOB_64, bufs, lens, NULL, NULL, out, NULL};
+
+  run(pool, &job, n);
+}
+
+void cityhash128_parallel(struct cityhash_pool* pool,
+                          const uint8_t* const* bufs, const size_t* lens,
+                          size_t n, uint128_t* out) {
+
+  struct job job = {JOB_128, bufs, lens, NULL, NULL, NULL, out};
+
+  run(pool, &job, n);
+}
+
+void cityhash64_parallel_offsets(struct cityhash_pool* pool,
+                                 const uint8_t* data, const uint32_t* offsets,
+                                 size_t n, uint64_t* out) {
+
+  struct job job = {JOB_64_OFFSETS, NULL, NULL, data, offsets, out, NULL};
+
+  run(pool, &job, n);
+}
+
+void cityhash128_parallel_offsets(struct cityhash_pool* pool,
+                                  const uint8_t* data,
+                                  const uint32_t* offsets, size_t n,
+                                  uint128_t* out) {
+
+  struct job job = {JOB_128_OFFSETS, NULL, NULL, data, offsets, NULL, out};
+
+  run(pool, &job, n);
+}
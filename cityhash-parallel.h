@@ -0,0 +1,86 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Parallel hashing of key arrays and string columns on a reusable pool of
+// threads.  A call starts as one task covering every key; a thread splits
+// its task in halves, keeps one and pushes the other on its own Chase-Lev
+// deque, from which idle threads steal, until a task is small enough to hash
+// serially.  A key of at least CITYHASH_TASK_BYTES also pushes the rest of
+// its task before it is hashed, so a few huge keys among many short ones
+// never hold up the keys behind them.  The results are those of the serial
+// functions.
+
+#ifndef CITYHASH_PARALLEL_H
+#define CITYHASH_PARALLEL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash.h"
+
+// keys per task below which a task is no longer split
+#define CITYHASH_TASK_KEYS (1024)
+
+// key bytes per task below which a task is no longer split, about what
+// fits in L2 next to the output
+#define CITYHASH_TASK_BYTES (256 * 1024)
+
+struct cityhash_pool;
+
+// a pool of threads threads including the caller's, 0 meaning one per online
+// CPU; returns NULL if it cannot be allocated, the functions below then hash
+// on the calling thread
+struct cityhash_pool* cityhash_pool_create(int threads);
+
+// stops and joins the threads of pool
+void cityhash_pool_destroy(struct cityhash_pool* pool);
+
+// number of threads that hash in a call, including the caller's
+int cityhash_pool_threads(const struct cityhash_pool* pool);
+
+// tasks the threads of pool have stolen from each other so far
+uint64_t cityhash_pool_steals(const struct cityhash_pool* pool);
+
+// out[i] = cityhash64(bufs[i], lens[i]); calls on the same pool from several
+// threads run one after another
+void cityhash64_parallel(struct cityhash_pool* pool,
+                         const uint8_t* const* bufs, const size_t* lens,
+                         size_t n, uint64_t* out);
+
+// out[i] = cityhash128(bufs[i], lens[i])
+void cityhash128_parallel(struct cityhash_pool* pool,
+                          const uint8_t* const* bufs, const size_t* lens,
+                          size_t n, uint128_t* out);
+
+// cityhash64_batch_offsets() of a column, on the threads of pool
+void cityhash64_parallel_offsets(struct cityhash_pool* pool,
+                                 const uint8_t* data, const uint32_t* offsets,
+                                 size_t n, uint64_t* out);
+
+// cityhash128() of every key of a column, laid out as for
+// cityhash64_batch_offsets(), on the threads of pool
+void cityhash128_parallel_offsets(struct cityhash_pool* pool,
+                                  const uint8_t* data,
+                                  const uint32_t* offsets, size_t n,
+                                  uint128_t* out);
+
+#endif // CITYHASH_PARALLEL_H
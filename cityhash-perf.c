@@ -0,0 +1,139 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// perf_event_open(2) counters for the benchmarks, see cityhash-perf.h.
+
+#if defined(BENCHMARKING)
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cityhash-perf.h"
+
+#define CACHE_MISS(cache)                                                      \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                              \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+const char* perf_counter_names[PERF_NCOUNTERS] = {
+    "cycles",        "instructions", "branches",
+    "branch-misses", "l1d-misses",   "llc-misses",
+    "dtlb-misses",
+};
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} events[PERF_NCOUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+static int perf_event_open(struct perf_event_attr* attr) {
+  return (int)syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+int perf_counters_open(struct perf_counters* pc) {
+
+  int opened = 0;
+
+  // every counter is its own group so that one the PMU cannot schedule
+  // does not take the others down with it
+  for (int i = 0; i < PERF_NCOUNTERS; i++) {
+
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    pc->fd[i] = perf_event_open(&attr);
+
+    if (pc->fd[i] >= 0)
+      opened++;
+  }
+
+  return opened;
+}
+
+void perf_counters_close(struct perf_counters* pc) {
+
+  for (int i = 0; i < PERF_NCOUNTERS; i++) {
+
+    if (pc->fd[i] >= 0)
+      close(pc->fd[i]);
+
+    pc->fd[i] = -1;
+  }
+}
+
+void perf_counters_start(struct perf_counters* pc) {
+
+  for (int i = 0; i < PERF_NCOUNTERS; i++) {
+
+    if (pc->fd[i] >= 0) {
+      ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void perf_counters_stop(struct perf_counters* pc, struct perf_sample* out) {
+
+  for (int i = 0; i < PERF_NCOUNTERS; i++) {
+
+    if (pc->fd[i] >= 0)
+      ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  for (int i = 0; i < PERF_NCOUNTERS; i++) {
+
+    // value, time enabled, time running
+    uint64_t v[3];
+
+    out->value[i] = 0;
+    out->valid[i] = 0;
+
+    if (pc->fd[i] < 0 || read(pc->fd[i], v, sizeof(v)) != sizeof(v))
+      continue;
+
+    // the counter was multiplexed, extrapolate to the full interval
+    if (v[2] > 0 && v[2] < v[1])
+      v[0] = (uint64_t)((double)v[0] * v[1] / v[2]);
+
+    out->value[i] = v[0];
+    out->valid[i] = v[2] > 0;
+  }
+}
+
+#endif // BENCHMARKING
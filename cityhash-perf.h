@@ -0,0 +1,66 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Thin wrapper around perf_event_open(2) used by the benchmarks to read
+// hardware counters around a hashing loop.  Counters that the kernel or the
+// PMU refuses to open are reported as unavailable instead of failing.
+
+#ifndef CITYHASH_PERF_H
+#define CITYHASH_PERF_H
+
+#include <stdint.h>
+
+enum perf_counter_id {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_BRANCHES,
+  PERF_BRANCH_MISSES,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_NCOUNTERS
+};
+
+struct perf_counters {
+  int fd[PERF_NCOUNTERS];
+};
+
+// counter values of one measurement, scaled for multiplexing
+struct perf_sample {
+  uint64_t value[PERF_NCOUNTERS];
+  int valid[PERF_NCOUNTERS];
+};
+
+extern const char* perf_counter_names[PERF_NCOUNTERS];
+
+// open all counters for the calling thread, user space only
+// returns the number of counters that could be opened
+int perf_counters_open(struct perf_counters* pc);
+
+void perf_counters_close(struct perf_counters* pc);
+
+// reset and enable all counters
+void perf_counters_start(struct perf_counters* pc);
+
+// disable all counters and read them into out
+void perf_counters_stop(struct perf_counters* pc, struct perf_sample* out);
+
+#endif // CITYHASH_PERF_H
@@ -0,0 +1,949 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Hash quality harness in the spirit of Austin Appleby's SMHasher.
+//
+// Every variant is put through
+//
+//   avalanche  flipping any input bit flips every output bit with p = 1/2;
+//              the key sizes of SMHasher (4 to 20 bytes) must pass, longer
+//              keys are only reported, because the reference functions
+//              themselves are measurably biased there (e.g. cityhash64 at 32
+//              bytes, cityhash32 from 32 bytes on, cityhash128 at 24-32)
+//   bic        bit independence: output bit flips are pairwise independent
+//   sparse     no excess collisions among keys with very few bits set
+//   cyclic     no excess collisions among keys made of a repeated cycle
+//   diff       no collisions between a key and the key with up to three
+//              nearby bits flipped
+//   check      every alternative implementation registered in alternatives[]
+//              returns exactly what the scalar reference returns, over random
+//              lengths and misaligned offsets
+//
+// Work is split into tasks that are spread over all cores.  -q runs reduced
+// sample counts and is what ctest runs; -n scales the sample counts of a full
+// run.  The exit status is non-zero if any test fails.
+//
+// usage: cityhash_quality [-q] [-n scale] [-j threads] [-v variant] [-T test]
+
+#if defined(UNIT_TESTING)
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cityhash-bench-util.h"
+#include "cityhash.h"
+
+// every variant writes its result as up to four 64-bit words
+typedef void (*quality_fn)(const uint8_t* s, size_t len, uint64_t out[4]);
+
+struct quality_variant {
+  const char* name;
+  quality_fn fn;
+  int bits;
+};
+
+static const uint64_t kseed0 = 1234567;
+static const uint64_t kseed1 = 0xc3a5c85c97cb3127ULL;
+static const uint128_t kseed128 = {1234567, 0xc3a5c85c97cb3127ULL};
+
+static void q_cityhash32(const uint8_t* s, size_t len, uint64_t out[4]) {
+  out[0] = cityhash32(s, len);
+}
+
+static void q_cityhash64(const uint8_t* s, size_t len, uint64_t out[4]) {
+  out[0] = cityhash64(s, len);
+}
+
+static void q_cityhash64_with_seed(const uint8_t* s, size_t len,
+                                   uint64_t out[4]) {
+  out[0] = cityhash64_with_seed(s, len, kseed0);
+}
+
+static void q_cityhash64_with_seeds(const uint8_t* s, size_t len,
+                                    uint64_t out[4]) {
+  out[0] = cityhash64_with_seeds(s, len, kseed0, kseed1);
+}
+
+static void q_cityhash128(const uint8_t* s, size_t len, uint64_t out[4]) {
+  uint128_t h = cityhash128(s, len);
+  out[0] = h.a;
+  out[1] = h.b;
+}
+
+static void q_cityhash128_with_seed(const uint8_t* s, size_t len,
+                                    uint64_t out[4]) {
+  uint128_t h = cityhash128_with_seed(s, len, kseed128);
+  out[0] = h.a;
+  out[1] = h.b;
+}
+
+#if defined(__SSE4_2__) && defined(__x86_64)
+
+static void q_cityhash128_crc(const uint8_t* s, size_t len, uint64_t out[4]) {
+  uint128_t h = cityhash128_crc(s, len);
+  out[0] = h.a;
+  out[1] = h.b;
+}
+
+static void q_cityhash128_crc_with_seed(const uint8_t* s, size_t len,
+                                        uint64_t out[4]) {
+  uint128_t h = cityhash128_crc_with_seed(s, len, kseed128);
+  out[0] = h.a;
+  out[1] = h.b;
+}
+
+static void q_cityhash256_crc(const uint8_t* s, size_t len, uint64_t out[4]) {
+  uint256_t h = cityhash256_crc(s, len);
+  out[0] = h.a;
+  out[1] = h.b;
+  out[2] = h.c;
+  out[3] = h.d;
+}
+
+#endif
+
+static const struct quality_variant variants[] = {
+    {"cityhash32", q_cityhash32, 32},
+    {"cityhash64", q_cityhash64, 64},
+    {"cityhash64_with_seed", q_cityhash64_with_seed, 64},
+    {"cityhash64_with_seeds", q_cityhash64_with_seeds, 64},
+    {"cityhash128", q_cityhash128, 128},
+    {"cityhash128_with_seed", q_cityhash128_with_seed, 128},
+#if defined(__SSE4_2__) && defined(__x86_64)
+    {"cityhash128_crc", q_cityhash128_crc, 128},
+    {"cityhash128_crc_with_seed", q_cityhash128_crc_with_seed, 128},
+    {"cityhash256_crc", q_cityhash256_crc, 256},
+#endif
+};
+
+#define NVARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+// alternative implementations that must be bit-identical to a reference
+// variant; a faster kernel is verified by adding it here
+struct quality_alternative {
+  const char* name;
+  const char* reference;
+  quality_fn fn;
+};
+
+#define KCOPY_MAX (1 << 16)
+
+// hashes a copy of the key placed at an odd address, catches kernels that
+// depend on the alignment of their input
+static __thread uint8_t copy_buf[KCOPY_MAX + 8 + CITYHASH_PADDING];
+
+static void q_cityhash64_copy(const uint8_t* s, size_t len, uint64_t out[4]) {
+  memcpy(copy_buf + 3, s, len);
+  q_cityhash64(copy_buf + 3, len, out);
+}
+
+static void q_cityhash128_copy(const uint8_t* s, size_t len, uint64_t out[4]) {
+  memcpy(copy_buf + 5, s, len);
+  q_cityhash128(copy_buf + 5, len, out);
+}
+
+// the padded entry points on a misaligned copy, the padding holds whatever the
+// previous key left there
+static void q_cityhash32_padded(const uint8_t* s, size_t len, uint64_t out[4]) {
+  memcpy(copy_buf + 1, s, len);
+  out[0] = cityhash32_padded(copy_buf + 1, len);
+}
+
+static void q_cityhash64_padded(const uint8_t* s, size_t len, uint64_t out[4]) {
+  memcpy(copy_buf + 7, s, len);
+  out[0] = cityhash64_padded(copy_buf + 7, len);
+}
+
+// hashes the key in one lane of cityhash128_batch() next to keys of other
+// lengths, so lanes are refilled and finish at different steps
+static void q_cityhash128_batch(const uint8_t* s, size_t len, uint64_t out[4]) {
+
+  const uint8_t* bufs[5] = {s, s + len / 2, s, s + 1, s};
+  size_t lens[5] = {len / 3, len - len / 2, len, len > 0 ? len - 1 : 0,
+                    2 * len / 3};
+  uint128_t h[5];
+
+  cityhash128_batch(bufs, lens, 5, h);
+  out[0] = h[2].a;
+  out[1] = h[2].b;
+}
+
+static const struct quality_alternative alternatives[] = {
+    {"cityhash64 (misaligned copy)", "cityhash64", q_cityhash64_copy},
+    {"cityhash128 (misaligned copy)", "cityhash128", q_cityhash128_copy},
+    {"cityhash128_batch", "cityhash128", q_cityhash128_batch},
+    {"cityhash32_padded", "cityhash32", q_cityhash32_padded},
+    {"cityhash64_padded", "cityhash64", q_cityhash64_padded},
+};
+
+#define NALTERNATIVES (sizeof(alternatives) / sizeof(alternatives[0]))
+
+// sample counts of a full run, divided by KQUICK with -q
+#define KAVALANCHE_KEYS (10000)
+#define KBIC_KEYS (2000)
+#define KCYCLIC_KEYS (200000)
+#define KDIFF_KEYS (1000)
+#define KCHECK_KEYS (1000000)
+#define KQUICK (50)
+
+#define KTASKS (64)
+
+static int nthreads;
+static double scale = 1.0;
+static int quick = 0;
+static int failures = 0;
+
+static size_t samples(size_t full) {
+
+  size_t n = (size_t)(full * scale / (quick ? KQUICK : 1));
+
+  return n > 0 ? n : 1;
+}
+
+static void random_bytes(uint64_t* state, uint8_t* p, size_t len) {
+
+  for (size_t i = 0; i < len; i += 8) {
+
+    uint64_t x = splitmix64(state);
+    size_t n = len - i < 8 ? len - i : 8;
+
+    memcpy(p + i, &x, n);
+  }
+}
+
+static int warnings = 0;
+
+// a failed check that is not gating only counts as a warning
+static void report_result(const char* test, const char* variant,
+                          const char* detail, int ok, int gating) {
+
+  printf("%-10s %-30s %-44s %s\n", test, variant, detail,
+         ok ? "ok" : gating ? "FAIL" : "WARN");
+  fflush(stdout);
+
+  if (!ok && gating)
+    failures++;
+  else if (!ok)
+    warnings++;
+}
+
+static void report(const char* test, const char* variant, const char* detail,
+                   int ok) {
+  report_result(test, variant, detail, ok, 1);
+}
+
+// runs task(ctx, i) for i in [0, ntasks) on nthreads threads
+struct parallel_job {
+  void (*task)(void* ctx, int i);
+  void* ctx;
+  int ntasks;
+  int next;
+};
+
+static void* parallel_worker(void* p) {
+
+  struct parallel_job* job = p;
+  int i;
+
+  while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+         job->ntasks)
+    job->task(job->ctx, i);
+
+  return NULL;
+}
+
+static void parallel_for(void (*task)(void*, int), void* ctx, int ntasks) {
+
+  struct parallel_job job = {task, ctx, ntasks, 0};
+  pthread_t threads[nthreads];
+
+  for (int t = 1; t < nthreads; t++)
+    pthread_create(&threads[t], NULL, parallel_worker, &job);
+
+  parallel_worker(&job);
+
+  for (int t = 1; t < nthreads; t++)
+    pthread_join(threads[t], NULL);
+}
+
+// avalanche
+
+struct avalanche_ctx {
+  const struct quality_variant* v;
+  size_t len;
+  size_t keys;
+  uint32_t* counts[KTASKS];
+};
+
+static void avalanche_task(void* p, int task) {
+
+  struct avalanche_ctx* ctx = p;
+  const struct quality_variant* v = ctx->v;
+  size_t inbits = ctx->len * 8;
+  uint32_t* counts = calloc(inbits * v->bits, sizeof(uint32_t));
+  uint64_t state = 0xa5a5a5a5ULL * (task + 1) + ctx->len;
+  uint8_t key[ctx->len];
+
+  for (size_t k = task; k < ctx->keys; k += KTASKS) {
+
+    uint64_t h0[4] = {0}, h1[4] = {0};
+
+    random_bytes(&state, key, ctx->len);
+    v->fn(key, ctx->len, h0);
+
+    for (size_t i = 0; i < inbits; i++) {
+
+      key[i >> 3] ^= (uint8_t)(1 << (i & 7));
+      v->fn(key, ctx->len, h1);
+      key[i >> 3] ^= (uint8_t)(1 << (i & 7));
+
+      for (int w = 0; w < (v->bits + 63) / 64; w++) {
+
+        uint64_t d = h0[w] ^ h1[w];
+
+        while (d != 0) {
+          counts[i * v->bits + w * 64 + __builtin_ctzll(d)]++;
+          d &= d - 1;
+        }
+      }
+    }
+  }
+
+  ctx->counts[task] = counts;
+}
+
+static void test_avalanche(const struct quality_variant* v) {
+
+  static const size_t lens[] = {4, 5, 6, 7, 8, 10, 12, 16, 20,
+                                24, 32, 48, 64, 128};
+
+  for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+
+    struct avalanche_ctx ctx = {v, lens[l], samples(KAVALANCHE_KEYS), {0}};
+    size_t ncells = lens[l] * 8 * v->bits;
+    double worst = 0;
+    char detail[64];
+
+    parallel_for(avalanche_task, &ctx, KTASKS);
+
+    for (size_t c = 0; c < ncells; c++) {
+
+      uint64_t n = 0;
+
+      for (int t = 0; t < KTASKS; t++)
+        n += ctx.counts[t][c];
+
+      double bias = 2.0 * ((double)n / ctx.keys - 0.5);
+
+      if (bias < 0)
+        bias = -bias;
+
+      if (bias > worst)
+        worst = bias;
+    }
+
+    for (int t = 0; t < KTASKS; t++)
+      free(ctx.counts[t]);
+
+    // the worst of many cells sits several standard errors out
+    double limit = 6.0 / sqrt((double)ctx.keys);
+
+    if (limit < 0.01)
+      limit = 0.01;
+
+    snprintf(detail, sizeof(detail), "len %3zu worst bias %.4f (limit %.4f)",
+             lens[l], worst, limit);
+    report_result("avalanche", v->name, detail, worst <= limit, lens[l] <= 20);
+  }
+}
+
+// bit independence of the first 64 output bits, 8-byte keys
+
+#define BIC_INBITS 64
+#define BIC_OUTBITS 64
+
+struct bic_ctx {
+  const struct quality_variant* v;
+  size_t keys;
+  uint32_t* counts[KTASKS];
+};
+
+static void bic_task(void* p, int task) {
+
+  struct bic_ctx* ctx = p;
+  int outbits = ctx->v->bits < BIC_OUTBITS ? ctx->v->bits : BIC_OUTBITS;
+  uint32_t* counts =
+      calloc((size_t)BIC_INBITS * BIC_OUTBITS * BIC_OUTBITS, sizeof(uint32_t));
+  uint64_t state = 0x5a5a5a5aULL * (task + 1);
+  uint8_t key[BIC_INBITS / 8];
+
+  for (size_t k = task; k < ctx->keys; k += KTASKS) {
+
+    uint64_t h0[4] = {0}, h1[4] = {0};
+
+    random_bytes(&state, key, sizeof(key));
+    ctx->v->fn(key, sizeof(key), h0);
+
+    for (int i = 0; i < BIC_INBITS; i++) {
+
+      key[i >> 3] ^= (uint8_t)(1 << (i & 7));
+      ctx->v->fn(key, sizeof(key), h1);
+      key[i >> 3] ^= (uint8_t)(1 << (i & 7));
+
+      uint64_t d = h0[0] ^ h1[0];
+      uint32_t* row = counts + (size_t)i * BIC_OUTBITS * BIC_OUTBITS;
+
+      // count how often output bits j and k flip differently
+      for (int j = 0; j < outbits; j++) {
+
+        uint64_t x = (d >> j) & 1 ? ~d : d;
+
+        for (int m = j + 1; m < outbits; m++)
+          row[j * BIC_OUTBITS + m] += (uint32_t)((x >> m) & 1);
+      }
+    }
+  }
+
+  ctx->counts[task] = counts;
+}
+
+static void test_bic(const struct quality_variant* v) {
+
+  struct bic_ctx ctx = {v, samples(KBIC_KEYS), {0}};
+  int outbits = v->bits < BIC_OUTBITS ? v->bits : BIC_OUTBITS;
+  double worst = 0;
+  char detail[64];
+
+  parallel_for(bic_task, &ctx, KTASKS);
+
+  for (int i = 0; i < BIC_INBITS; i++) {
+    for (int j = 0; j < outbits; j++) {
+      for (int m = j + 1; m < outbits; m++) {
+
+        size_t c = ((size_t)i * BIC_OUTBITS + j) * BIC_OUTBITS + m;
+        uint64_t n = 0;
+
+        for (int t = 0; t < KTASKS; t++)
+          n += ctx.counts[t][c];
+
+        double bias = 2.0 * ((double)n / ctx.keys - 0.5);
+
+        if (bias < 0)
+          bias = -bias;
+
+        if (bias > worst)
+          worst = bias;
+      }
+    }
+  }
+
+  for (int t = 0; t < KTASKS; t++)
+    free(ctx.counts[t]);
+
+  double limit = 7.0 / sqrt((double)ctx.keys);
+
+  if (limit < 0.01)
+    limit = 0.01;
+
+  snprintf(detail, sizeof(detail), "worst bias %.4f (limit %.4f)", worst,
+           limit);
+  report("bic", v->name, detail, worst <= limit);
+}
+
+// collision counting shared by the keyset tests
+
+static int compare_u64(const void* a, const void* b) {
+
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+static uint64_t count_collisions(uint64_t* h, size_t n) {
+
+  uint64_t collisions = 0;
+
+  qsort(h, n, sizeof(uint64_t), compare_u64);
+
+  for (size_t i = 1; i < n; i++)
+    collisions += h[i] == h[i - 1];
+
+  return collisions;
+}
+
+// collisions of the first 64 output bits and of the low 32 bits of n hashes,
+// compared against the number expected from a random function
+static void report_collisions(const char* test, const struct quality_variant* v,
+                              const char* keyset, uint64_t* h, size_t n) {
+
+  int widths[2] = {v->bits < 64 ? v->bits : 64, 32};
+  char detail[96];
+
+  for (int w = 0; w < (v->bits > 32 ? 2 : 1); w++) {
+
+    double expected = (double)n * (n - 1) / 2 / ldexp(1.0, widths[w]);
+
+    if (widths[w] == 32) {
+      for (size_t i = 0; i < n; i++)
+        h[i] &= 0xffffffffULL;
+    }
+
+    uint64_t got = count_collisions(h, n);
+
+    snprintf(detail, sizeof(detail), "%s %2d-bit: %llu coll (exp %.1f)",
+             keyset, widths[w], (unsigned long long)got, expected);
+    report(test, v->name, detail, got <= 2 * expected + 4);
+  }
+}
+
+// sparse keys: every key of len bytes with at most maxbits bits set
+
+struct sparse_ctx {
+  const struct quality_variant* v;
+  size_t len;
+  int maxbits;
+  uint64_t* hashes;
+  size_t n;
+};
+
+static size_t choose(size_t n, int k) {
+
+  size_t r = 1;
+
+  for (int i = 0; i < k; i++)
+    r = r * (n - i) / (i + 1);
+
+  return r;
+}
+
+// tasks split the keys by the position of their highest set bit
+static void sparse_task(void* p, int task) {
+
+  struct sparse_ctx* ctx = p;
+  size_t inbits = ctx->len * 8;
+  uint8_t key[ctx->len];
+  uint64_t h[4];
+
+  for (size_t top = task; top < inbits; top += KTASKS) {
+
+    // keys below top, then the index of the first key with this top bit
+    size_t base = 1;
+
+    for (int b = 1; b <= ctx->maxbits; b++)
+      base += choose(top, b);
+
+    for (int b = 0; b < ctx->maxbits && b <= (int)top; b++) {
+
+      // enumerate b further bits below top in lexicographic order
+      int pos[8];
+      size_t idx = base;
+
+      for (int i = 0; i < b; i++)
+        pos[i] = i;
+
+      // offset of the keys with b lower bits among those with this top bit
+      for (int c = 0; c < b; c++)
+        idx += choose(top, c);
+
+      for (;;) {
+
+        memset(key, 0, ctx->len);
+        key[top >> 3] |= (uint8_t)(1 << (top & 7));
+
+        for (int i = 0; i < b; i++)
+          key[pos[i] >> 3] |= (uint8_t)(1 << (pos[i] & 7));
+
+        memset(h, 0, sizeof(h));
+        ctx->v->fn(key, ctx->len, h);
+        ctx->hashes[idx++] = h[0];
+
+        int i = b - 1;
+
+        while (i >= 0 && pos[i] == (int)top - b + i)
+          i--;
+
+        if (i < 0)
+          break;
+
+        pos[i]++;
+
+        for (int m = i + 1; m < b; m++)
+          pos[m] = pos[m - 1] + 1;
+      }
+    }
+  }
+}
+
+static void test_sparse(const struct quality_variant* v) {
+
+  static const struct {
+    size_t len;
+    int maxbits;
+  } keysets[] = {{4, 6}, {8, 4}, {16, 3}, {32, 3}, {64, 2}, {128, 2}};
+
+  for (size_t s = 0; s < sizeof(keysets) / sizeof(keysets[0]); s++) {
+
+    struct sparse_ctx ctx = {v, keysets[s].len, keysets[s].maxbits, NULL, 1};
+    char keyset[32];
+    uint64_t h[4] = {0};
+
+    // a quick run only looks at the smaller keysets
+    if (quick && keysets[s].len > 16)
+      continue;
+
+    for (int b = 1; b <= ctx.maxbits; b++)
+      ctx.n += choose(ctx.len * 8, b);
+
+    ctx.hashes = malloc(ctx.n * sizeof(uint64_t));
+
+    // the all-zero key comes first
+    {
+      uint8_t zero[ctx.len];
+
+      memset(zero, 0, ctx.len);
+      v->fn(zero, ctx.len, h);
+      ctx.hashes[0] = h[0];
+    }
+
+    parallel_for(sparse_task, &ctx, KTASKS);
+
+    snprintf(keyset, sizeof(keyset), "%zuB/%db", ctx.len, ctx.maxbits);
+    report_collisions("sparse", v, keyset, ctx.hashes, ctx.n);
+    free(ctx.hashes);
+  }
+}
+
+// cyclic keys: a random cycle of cycle bytes repeated to fill len bytes
+
+struct cyclic_ctx {
+  const struct quality_variant* v;
+  size_t cycle;
+  size_t len;
+  uint64_t* hashes;
+  size_t n;
+};
+
+static void cyclic_task(void* p, int task) {
+
+  struct cyclic_ctx* ctx = p;
+  uint64_t state = 0xc1c1c1c1ULL * (task + 1) + ctx->cycle;
+  uint8_t key[ctx->len];
+  uint64_t h[4] = {0};
+
+  for (size_t k = task; k < ctx->n; k += KTASKS) {
+
+    random_bytes(&state, key, ctx->cycle);
+
+    for (size_t i = ctx->cycle; i < ctx->len; i++)
+      key[i] = key[i - ctx->cycle];
+
+    ctx->v->fn(key, ctx->len, h);
+    ctx->hashes[k] = h[0];
+  }
+}
+
+static void test_cyclic(const struct quality_variant* v) {
+
+  for (size_t cycle = 4; cycle <= 8; cycle++) {
+
+    struct cyclic_ctx ctx = {v, cycle, cycle * 8 + 3, NULL,
+                             samples(KCYCLIC_KEYS)};
+    char keyset[32];
+
+    ctx.hashes = malloc(ctx.n * sizeof(uint64_t));
+
+    parallel_for(cyclic_task, &ctx, KTASKS);
+
+    snprintf(keyset, sizeof(keyset), "%zux8+3", cycle);
+    report_collisions("cyclic", v, keyset, ctx.hashes, ctx.n);
+    free(ctx.hashes);
+  }
+}
+
+// differential: h(k) == h(k ^ d) for d with one to three bits set within a
+// DIFF_WINDOW bit window of a 16-byte key
+
+#define DIFF_LEN 16
+#define DIFF_WINDOW 32
+
+struct diff_ctx {
+  const struct quality_variant* v;
+  size_t keys;
+  uint64_t collisions[KTASKS];
+  uint64_t tried[KTASKS];
+};
+
+static void diff_task(void* p, int task) {
+
+  struct diff_ctx* ctx = p;
+  const struct quality_variant* v = ctx->v;
+  uint64_t state = 0xd1ffULL * (task + 1);
+  uint8_t key[DIFF_LEN];
+  uint64_t h0[4] = {0}, h1[4] = {0};
+  uint64_t collisions = 0, tried = 0;
+
+  for (size_t k = task; k < ctx->keys; k += KTASKS) {
+
+    // slide the window over the key from one key to the next
+    size_t shift = (k * 8) % (DIFF_LEN * 8 - DIFF_WINDOW + 1);
+
+    random_bytes(&state, key, DIFF_LEN);
+    v->fn(key, DIFF_LEN, h0);
+
+    for (int a = 0; a < DIFF_WINDOW; a++) {
+      for (int b = a; b < DIFF_WINDOW; b++) {
+        for (int c = b; c < DIFF_WINDOW; c++) {
+
+          // a == b == c is a one-bit, b == c a two-bit difference
+          if (a == b && b != c)
+            continue;
+
+          uint8_t d[DIFF_LEN];
+
+          memcpy(d, key, DIFF_LEN);
+          d[(shift + a) >> 3] ^= (uint8_t)(1 << ((shift + a) & 7));
+
+          if (b != a)
+            d[(shift + b) >> 3] ^= (uint8_t)(1 << ((shift + b) & 7));
+
+          if (c != b)
+            d[(shift + c) >> 3] ^= (uint8_t)(1 << ((shift + c) & 7));
+
+          v->fn(d, DIFF_LEN, h1);
+          collisions += memcmp(h0, h1, sizeof(h0)) == 0;
+          tried++;
+        }
+      }
+    }
+  }
+
+  ctx->collisions[task] = collisions;
+  ctx->tried[task] = tried;
+}
+
+static void test_diff(const struct quality_variant* v) {
+
+  struct diff_ctx ctx = {v, samples(KDIFF_KEYS), {0}, {0}};
+  uint64_t collisions = 0, tried = 0;
+  char detail[96];
+
+  parallel_for(diff_task, &ctx, KTASKS);
+
+  for (int t = 0; t < KTASKS; t++) {
+    collisions += ctx.collisions[t];
+    tried += ctx.tried[t];
+  }
+
+  double expected = tried / ldexp(1.0, v->bits);
+
+  snprintf(detail, sizeof(detail), "%llu diffs: %llu coll (exp %.3f)",
+           (unsigned long long)tried, (unsigned long long)collisions,
+           expected);
+  report("diff", v->name, detail, collisions <= 2 * expected + 2);
+}
+
+// differential check of alternative implementations
+
+#define KCHECK_BUF (KCOPY_MAX + 64)
+
+struct check_ctx {
+  const struct quality_alternative* alt;
+  const struct quality_variant* ref;
+  const uint8_t* buf;
+  size_t keys;
+  uint64_t mismatches[KTASKS];
+  size_t first_len[KTASKS];
+  size_t first_off[KTASKS];
+};
+
+// mostly short keys, some up to KCOPY_MAX bytes
+static size_t random_len(uint64_t* state) {
+
+  uint64_t x = splitmix64(state);
+
+  switch (x & 3) {
+  case 0:
+  case 1:
+    return (x >> 8) % 129;
+  case 2:
+    return (x >> 8) % 1025;
+  default:
+    return (x >> 8) % (KCOPY_MAX + 1);
+  }
+}
+
+static void check_task(void* p, int task) {
+
+  struct check_ctx* ctx = p;
+  uint64_t state = 0xcec0ULL * (task + 1);
+  uint64_t mismatches = 0;
+
+  ctx->first_len[task] = (size_t)-1;
+
+  for (size_t k = task; k < ctx->keys; k += KTASKS) {
+
+    size_t len = random_len(&state);
+    size_t off = splitmix64(&state) & 63;
+    uint64_t want[4] = {0}, got[4] = {0};
+
+    ctx->ref->fn(ctx->buf + off, len, want);
+    ctx->alt->fn(ctx->buf + off, len, got);
+
+    if (memcmp(want, got, sizeof(want)) != 0) {
+
+      if (mismatches++ == 0) {
+        ctx->first_len[task] = len;
+        ctx->first_off[task] = off;
+      }
+    }
+  }
+
+  ctx->mismatches[task] = mismatches;
+}
+
+static void test_check(const struct quality_alternative* alt,
+                       const uint8_t* buf) {
+
+  const struct quality_variant* ref = NULL;
+  char detail[96];
+
+  for (size_t v = 0; v < NVARIANTS; v++) {
+    if (strcmp(variants[v].name, alt->reference) == 0)
+      ref = &variants[v];
+  }
+
+  if (ref == NULL)
+    return;
+
+  struct check_ctx ctx = {alt, ref, buf, samples(KCHECK_KEYS), {0}, {0}, {0}};
+  uint64_t mismatches = 0;
+  size_t len = 0, off = 0;
+
+  parallel_for(check_task, &ctx, KTASKS);
+
+  for (int t = 0; t < KTASKS; t++) {
+
+    if (ctx.mismatches[t] != 0 && mismatches == 0) {
+      len = ctx.first_len[t];
+      off = ctx.first_off[t];
+    }
+
+    mismatches += ctx.mismatches[t];
+  }
+
+  if (mismatches == 0)
+    snprintf(detail, sizeof(detail), "%zu keys identical", ctx.keys);
+  else
+    snprintf(detail, sizeof(detail), "%llu mismatches, first len %zu off %zu",
+             (unsigned long long)mismatches, len, off);
+
+  report("check", alt->name, detail, mismatches == 0);
+}
+
+static int wanted(const char* filter, const char* name) {
+  return filter == NULL || strcmp(filter, name) == 0;
+}
+
+int main(int argc, char* argv[]) {
+
+  const char* only = NULL;
+  const char* test = NULL;
+  int opt;
+
+  nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((opt = getopt(argc, argv, "qn:j:v:T:h")) != -1) {
+    switch (opt) {
+    case 'q':
+      quick = 1;
+      break;
+    case 'n':
+      scale = atof(optarg);
+      break;
+    case 'j':
+      nthreads = atoi(optarg);
+      break;
+    case 'v':
+      only = optarg;
+      break;
+    case 'T':
+      test = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-q] [-n scale] [-j threads] [-v variant] [-T test]\n"
+              "tests: avalanche bic sparse cyclic diff check\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (nthreads < 1)
+    nthreads = 1;
+
+  for (size_t v = 0; v < NVARIANTS; v++) {
+
+    if (!wanted(only, variants[v].name))
+      continue;
+
+    if (wanted(test, "avalanche"))
+      test_avalanche(&variants[v]);
+
+    if (wanted(test, "bic"))
+      test_bic(&variants[v]);
+
+    if (wanted(test, "sparse"))
+      test_sparse(&variants[v]);
+
+    if (wanted(test, "cyclic"))
+      test_cyclic(&variants[v]);
+
+    if (wanted(test, "diff"))
+      test_diff(&variants[v]);
+  }
+
+  if (wanted(test, "check")) {
+
+    uint8_t* buf = malloc(KCHECK_BUF);
+    uint64_t state = 777;
+
+    random_bytes(&state, buf, KCHECK_BUF);
+
+    for (size_t a = 0; a < NALTERNATIVES; a++) {
+      if (only == NULL || strcmp(only, alternatives[a].reference) == 0)
+        test_check(&alternatives[a], buf);
+    }
+
+    free(buf);
+  }
+
+  printf("%d failure(s), %d warning(s)\n", failures, warnings);
+
+  return failures > 0;
+}
+
+#endif // UNIT_TESTING
@@ -0,0 +1,371 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Throughput benchmark for the thread-per-core key router.
+//
+// One thread per core (-n, a list of core counts) loops over a pool of
+// random keys of -l bytes, routes them -b at a time with
+// cityhash_router_send() and drains its own inbox with
+// cityhash_router_receive() after every batch, and also whenever a send
+// stops early on a full ring.  Reported are the messages delivered per
+// second over all cores, the part of them that crossed from one core to
+// another, and the per core rate.  Threads are not pinned; with more
+// threads than CPUs they yield when they make no progress, so the numbers
+// then measure the rings under time sharing rather than in parallel.
+//
+// usage: cityhash_route [-n 8,16,32,64] [-b batch] [-l key_len]
+//                       [-r ring_size] [-t seconds] [-j out.json]
+//                       [-c out.csv]
+
+#if defined(BENCHMARKING)
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cityhash-bench-util.h"
+#include "cityhash-router.h"
+#include "cityhash.h"
+
+#define KBATCH (64)
+#define KKEY_LEN (16)
+#define KRING_SIZE (1024)
+#define KSECONDS (2.0)
+#define KPOOL (4096)
+#define KMAX_RUNS (16)
+
+struct run_result {
+  int cores;
+  double seconds;
+  uint64_t delivered;
+  uint64_t cross;
+};
+
+struct core {
+  pthread_t thread;
+  struct cityhash_router* router;
+  int id;
+  size_t batch;
+  const uint8_t* const* keys;
+  const size_t* lens;
+  void** args;
+  uint64_t delivered;
+  uint64_t cross;
+};
+
+static int stop = 0;
+
+static size_t drain(struct core* c, struct cityhash_route_msg* msgs,
+                    size_t max) {
+
+  size_t got = cityhash_router_receive(c->router, c->id, msgs, max);
+
+  // every message carries its source core as arg
+  for (size_t i = 0; i < got; i++)
+    c->cross += (int)(uintptr_t)msgs[i].arg != c->id;
+
+  c->delivered += got;
+
+  return got;
+}
+
+static void* core_main(void* p) {
+
+  struct core* c = p;
+  struct cityhash_route_msg* msgs = malloc(c->batch * sizeof(*msgs));
+  size_t pos = 0;
+
+  if (msgs == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < KPOOL; i++)
+    c->args[i] = (void*)(uintptr_t)c->id;
+
+  // start each core at a different place in the pool
+  pos = ((size_t)c->id * 97) % (KPOOL - c->batch + 1);
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+
+    size_t sent = cityhash_router_send(c->router, c->id, c->keys + pos,
+                                       c->lens + pos,
+                                       (void* const*)c->args + pos, c->batch);
+    size_t got = drain(c, msgs, c->batch);
+
+    while (sent < c->batch && !__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+
+      size_t k = cityhash_router_send(c->router, c->id, c->keys + pos + sent,
+                                      c->lens + pos + sent,
+                                      (void* const*)c->args + pos + sent,
+                                      c->batch - sent);
+
+      sent += k;
+      got = drain(c, msgs, c->batch);
+
+      // the rings are full and the inbox empty: the other cores have to run
+      if (k == 0 && got == 0)
+        sched_yield();
+    }
+
+    pos += c->batch;
+
+    if (pos + c->batch > KPOOL)
+      pos = 0;
+  }
+
+  free(msgs);
+
+  return NULL;
+}
+
+static int run(int cores, size_t batch, size_t ring_size, double seconds,
+               const uint8_t* const* keys, const size_t* lens,
+               struct run_result* out) {
+
+  struct cityhash_router* router = cityhash_router_create(cores, ring_size);
+  struct core* c = calloc(cores, sizeof(struct core));
+  void** args = malloc((size_t)cores * KPOOL * sizeof(void*));
+  struct timespec wait = {(time_t)seconds,
+                          (long)((seconds - (time_t)seconds) * 1e9)};
+
+  if (router == NULL || c == NULL || args == NULL) {
+    cityhash_router_destroy(router);
+    free(c);
+    free(args);
+    return -1;
+  }
+
+  __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+
+  double t0 = wall_ns();
+
+  for (int i = 0; i < cores; i++) {
+    c[i].router = router;
+    c[i].id = i;
+    c[i].batch = batch;
+    c[i].keys = keys;
+    c[i].lens = lens;
+    c[i].args = args + (size_t)i * KPOOL;
+    pthread_create(&c[i].thread, NULL, core_main, &c[i]);
+  }
+
+  nanosleep(&wait, NULL);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+  out->cores = cores;
+  out->delivered = 0;
+  out->cross = 0;
+
+  for (int i = 0; i < cores; i++) {
+    pthread_join(c[i].thread, NULL);
+    out->delivered += c[i].delivered;
+    out->cross += c[i].cross;
+  }
+
+  out->seconds = (wall_ns() - t0) / 1e9;
+
+  cityhash_router_destroy(router);
+  free(c);
+  free(args);
+
+  return 0;
+}
+
+static double mps(uint64_t n, const struct run_result* r) {
+  return r->seconds > 0 ? n / r->seconds / 1e6 : 0.0;
+}
+
+static void write_csv(const char* path, const struct run_result* r, int n,
+                      size_t batch, size_t key_len) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "cores,batch,key_len,mmsg_per_s,cross_mmsg_per_s,"
+             "per_core_mmsg_per_s\n");
+
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%d,%zu,%zu,%.4f,%.4f,%.4f\n", r[i].cores, batch, key_len,
+            mps(r[i].delivered, &r[i]), mps(r[i].cross, &r[i]),
+            mps(r[i].delivered, &r[i]) / r[i].cores);
+
+  fclose(f);
+}
+
+static void write_json(const char* path, const struct run_result* r, int n,
+                       size_t batch, size_t key_len, size_t ring_size) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f,
+          "{\n  \"batch\": %zu,\n  \"key_len\": %zu,\n"
+          "  \"ring_size\": %zu,\n  \"results\": [\n",
+          batch, key_len, ring_size);
+
+  for (int i = 0; i < n; i++)
+    fprintf(f,
+            "    {\"cores\": %d, \"mmsg_per_s\": %.4f, "
+            "\"cross_mmsg_per_s\": %.4f, \"per_core_mmsg_per_s\": %.4f}%s\n",
+            r[i].cores, mps(r[i].delivered, &r[i]), mps(r[i].cross, &r[i]),
+            mps(r[i].delivered, &r[i]) / r[i].cores, i + 1 < n ? "," : "");
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static void usage(const char* prog) {
+
+  fprintf(stderr,
+          "usage: %s [-n 8,16,32,64] [-b batch] [-l key_len]\n"
+          "       [-r ring_size] [-t seconds] [-j out.json] [-c out.csv]\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+
+  size_t batch = KBATCH;
+  size_t key_len = KKEY_LEN;
+  size_t ring_size = KRING_SIZE;
+  double seconds = KSECONDS;
+  const char* cores_arg = "8,16,32,64";
+  const char* json_path = NULL;
+  const char* csv_path = NULL;
+  int cores[KMAX_RUNS];
+  int nruns = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:b:l:r:t:j:c:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      cores_arg = optarg;
+      break;
+    case 'b':
+      batch = strtoull(optarg, NULL, 0);
+      break;
+    case 'l':
+      key_len = strtoull(optarg, NULL, 0);
+      break;
+    case 'r':
+      ring_size = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 'j':
+      json_path = optarg;
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (const char* p = cores_arg; *p != '\0' && nruns < KMAX_RUNS;) {
+
+    char* end;
+    long n = strtol(p, &end, 10);
+
+    if (end == p || n < 1) {
+      fprintf(stderr, "error: bad core list '%s'\n", cores_arg);
+      return 1;
+    }
+
+    cores[nruns++] = (int)n;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  if (batch < 1 || batch > KPOOL || seconds <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint8_t* pool = malloc(KPOOL * (key_len > 0 ? key_len : 1));
+  const uint8_t** keys = malloc(KPOOL * sizeof(uint8_t*));
+  size_t* lens = malloc(KPOOL * sizeof(size_t));
+  struct run_result results[KMAX_RUNS];
+  uint64_t state = 7;
+
+  if (pool == NULL || keys == NULL || lens == NULL) {
+    fprintf(stderr, "error: cannot allocate the key pool\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < KPOOL * key_len; i += 8) {
+    uint64_t x = splitmix64(&state);
+    memcpy(pool + i, &x, KPOOL * key_len - i < 8 ? KPOOL * key_len - i : 8);
+  }
+
+  for (size_t i = 0; i < KPOOL; i++) {
+    keys[i] = pool + i * key_len;
+    lens[i] = key_len;
+  }
+
+  printf("# %zu byte keys, batches of %zu, rings of %zu messages\n", key_len,
+         batch, ring_size);
+  printf("%6s %12s %12s %12s\n", "cores", "Mmsg/s", "cross Mmsg/s",
+         "Mmsg/s/core");
+
+  for (int i = 0; i < nruns; i++) {
+
+    struct run_result* r = &results[i];
+
+    if (run(cores[i], batch, ring_size, seconds, keys, lens, r)) {
+      fprintf(stderr, "error: cannot create a router for %d cores\n",
+              cores[i]);
+      return 1;
+    }
+
+    printf("%6d %12.2f %12.2f %12.3f\n", r->cores, mps(r->delivered, r),
+           mps(r->cross, r), mps(r->delivered, r) / r->cores);
+    fflush(stdout);
+  }
+
+  if (csv_path != NULL)
+    write_csv(csv_path, results, nruns, batch, key_len);
+
+  if (json_path != NULL)
+    write_json(json_path, results, nruns, batch, key_len, ring_size);
+
+  free(lens);
+  free(keys);
+  free(pool);
+
+  return 0;
+}
+
+#endif // BENCHMARKING
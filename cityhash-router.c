@@ -0,0 +1,228 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Thread-per-core key router, see cityhash-router.h.
+
+#include <string.h>
+
+#include "cityhash-router.h"
+
+// keys hashed at a time by cityhash_router_send()
+#define KSEND_BATCH (64)
+
+struct ring {
+  // written by the producer: the published tail, the one being filled and
+  // the last head it read
+  size_t tail __attribute__((aligned(64)));
+  size_t next;
+  size_t head_cache;
+
+  // written by the consumer: the published head and the last tail it read
+  size_t head __attribute__((aligned(64)));
+  size_t tail_cache;
+
+  struct cityhash_route_msg* slot __attribute__((aligned(64)));
+  size_t mask;
+};
+
+// consumer state of a core, a cache line of its own
+struct inbox {
+  int next_src __attribute__((aligned(64)));
+};
+
+struct cityhash_router {
+  int cores;
+  size_t size;
+  struct ring* rings; // rings[src * cores + dst]
+  struct inbox* inbox;
+  struct cityhash_route_msg* slots;
+};
+
+struct cityhash_router* cityhash_router_create(int cores, size_t ring_size) {
+
+  if (cores <= 0)
+    return NULL;
+
+  if (ring_size == 0)
+    ring_size = 1024;
+
+  size_t size = 2;
+
+  while (size < ring_size)
+    size <<= 1;
+
+  size_t nrings = (size_t)cores * cores;
+  struct cityhash_router* r = malloc(sizeof(*r));
+
+  if (r == NULL)
+    return NULL;
+
+  r->cores = cores;
+  r->size = size;
+
+  if (posix_memalign((void**)&r->rings, 64, nrings * sizeof(struct ring)))
+    r->rings = NULL;
+
+  if (posix_memalign((void**)&r->inbox, 64, cores * sizeof(struct inbox)))
+    r->inbox = NULL;
+
+  if (posix_memalign((void**)&r->slots, 64,
+                     nrings * size * sizeof(struct cityhash_route_msg)))
+    r->slots = NULL;
+
+  if (r->rings == NULL || r->inbox == NULL || r->slots == NULL) {
+    cityhash_router_destroy(r);
+    return NULL;
+  }
+
+  memset(r->rings, 0, nrings * sizeof(struct ring));
+  memset(r->inbox, 0, cores * sizeof(struct inbox));
+
+  for (size_t i = 0; i < nrings; i++) {
+    r->rings[i].slot = r->slots + i * size;
+    r->rings[i].mask = size - 1;
+  }
+
+  return r;
+}
+
+void cityhash_router_destroy(struct cityhash_router* router) {
+
+  if (router == NULL)
+    return;
+
+  free(router->slots);
+  free(router->inbox);
+  free(router->rings);
+  free(router);
+}
+
+int cityhash_router_cores(const struct cityhash_router* router) {
+  return router->cores;
+}
+
+int cityhash_router_owner(const struct cityhash_router* router,
+                          uint64_t hash) {
+  return (int)(hash % (uint64_t)router->cores);
+}
+
+// publishes what src has filled since its last publication
+static void publish(struct cityhash_router* router, int src) {
+
+  struct ring* row = &router->rings[(size_t)src * router->cores];
+
+  for (int d = 0; d < router->cores; d++) {
+    if (row[d].next != row[d].tail)
+      __atomic_store_n(&row[d].tail, row[d].next, __ATOMIC_RELEASE);
+  }
+}
+
+size_t cityhash_router_send(struct cityhash_router* router, int src,
+                            const uint8_t* const* keys, const size_t* lens,
+                            void* const* args, size_t n) {
+
+  struct ring* row = &router->rings[(size_t)src * router->cores];
+  uint64_t hash[KSEND_BATCH];
+  size_t sent = 0;
+
+  while (sent < n) {
+
+    size_t m = n - sent < KSEND_BATCH ? n - sent : KSEND_BATCH;
+
+    cityhash64_batch(keys + sent, lens + sent, m, hash);
+
+    for (size_t i = 0; i < m; i++) {
+
+      struct ring* ring = &row[cityhash_router_owner(router, hash[i])];
+
+      if (ring->next - ring->head_cache == router->size) {
+
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        if (ring->next - ring->head_cache == router->size) {
+          publish(router, src);
+          return sent + i;
+        }
+      }
+
+      struct cityhash_route_msg* msg = &ring->slot[ring->next & ring->mask];
+
+      msg->hash = hash[i];
+      msg->key = keys[sent + i];
+      msg->len = lens[sent + i];
+      msg->arg = args != NULL ? args[sent + i] : NULL;
+      ring->next++;
+    }
+
+    sent += m;
+  }
+
+  publish(router, src);
+
+  return sent;
+}
+
+size_t cityhash_router_receive(struct cityhash_router* router, int dst,
+                               struct cityhash_route_msg* out, size_t max) {
+
+  struct inbox* inbox = &router->inbox[dst];
+  int cores = router->cores;
+  int src = inbox->next_src;
+  size_t got = 0;
+
+  for (int k = 0; k < cores && got < max; k++) {
+
+    struct ring* ring = &router->rings[(size_t)src * cores + dst];
+    size_t head = ring->head;
+
+    if (ring->tail_cache == head)
+      ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    size_t avail = ring->tail_cache - head;
+
+    if (avail > max - got)
+      avail = max - got;
+
+    // at most two runs, before and after the end of the slots
+    size_t first = ring->mask + 1 - (head & ring->mask);
+
+    if (first > avail)
+      first = avail;
+
+    memcpy(out + got, &ring->slot[head & ring->mask],
+           first * sizeof(struct cityhash_route_msg));
+    memcpy(out + got + first, ring->slot,
+           (avail - first) * sizeof(struct cityhash_route_msg));
+
+    if (avail > 0)
+      __atomic_store_n(&ring->head, head + avail, __ATOMIC_RELEASE);
+
+    got += avail;
+
+    if (++src == cores)
+      src = 0;
+  }
+
+  inbox->next_src = src;
+
+  return got;
+}
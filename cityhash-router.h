@@ -0,0 +1,77 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Key router for shared-nothing, thread-per-core servers, where a key is
+// handled by the core that owns cityhash64(key) % cores.  Every pair of
+// cores has a single-producer/single-consumer ring, so no two threads ever
+// write the same index: core src hashes a batch of keys, appends every
+// message to the ring towards its owner and publishes each ring's tail once
+// at the end of the batch; core dst drains its rings in bulk and publishes
+// each ring's head once per ring.  Producer and consumer indices live in
+// cache lines of their own, and each side keeps a cached copy of the other
+// side's index, so the lines only move between cores once per batch.
+
+#ifndef CITYHASH_ROUTER_H
+#define CITYHASH_ROUTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash.h"
+
+struct cityhash_route_msg {
+  uint64_t hash;
+  const uint8_t* key;
+  size_t len;
+  void* arg;
+};
+
+struct cityhash_router;
+
+// a router between cores cores with rings of ring_size messages (0 for
+// 1024, rounded up to a power of two); NULL if it cannot be allocated
+struct cityhash_router* cityhash_router_create(int cores, size_t ring_size);
+
+void cityhash_router_destroy(struct cityhash_router* router);
+
+int cityhash_router_cores(const struct cityhash_router* router);
+
+// owner of a key of hash hash
+int cityhash_router_owner(const struct cityhash_router* router,
+                          uint64_t hash);
+
+// called only from core src: routes keys[i] of lens[i] bytes with args[i]
+// (args may be NULL) for i < n, in order, stopping at the first key whose
+// ring is full; returns the number of keys routed.  A core that cannot
+// route everything should receive before trying again, as the core it waits
+// for may be waiting for it.
+size_t cityhash_router_send(struct cityhash_router* router, int src,
+                            const uint8_t* const* keys, const size_t* lens,
+                            void* const* args, size_t n);
+
+// called only from core dst: moves up to max messages for dst into out,
+// visiting the source cores round-robin, and returns their number; messages
+// from one source arrive in the order they were sent
+size_t cityhash_router_receive(struct cityhash_router* router, int dst,
+                               struct cityhash_route_msg* out, size_t max);
+
+#endif // CITYHASH_ROUTER_H
@@ -0,0 +1,182 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Multi-column row hashing, see cityhash-rows.h.
+
+#include <string.h>
+
+#include "cityhash-rows.h"
+
+// rows hashed per column before moving to the next column, small enough for
+// the block's row and column hashes to stay in L1
+#define KBLOCK (1024)
+
+static uint64_t value_hash(const struct cityhash_column* col, size_t row) {
+
+  if (col->offsets != NULL)
+    return cityhash64(col->data + col->offsets[row],
+                      col->offsets[row + 1] - col->offsets[row]);
+
+  return cityhash64(col->data + row * col->width, col->width);
+}
+
+static void column_hash(const struct cityhash_column* col, size_t lo,
+                        size_t n, uint64_t* out) {
+
+  if (col->offsets != NULL)
+    cityhash64_batch_offsets(col->data, col->offsets + lo, n, out);
+  else
+    cityhash64_batch_fixed(col->data + lo * col->width, col->width, n, out);
+}
+
+uint64_t cityhash64_row(const struct cityhash_column* cols, size_t ncols,
+                        size_t row, enum cityhash_nulls nulls, int* is_null) {
+
+  uint64_t h = CITYHASH_NULL_HASH;
+  int started = 0;
+
+  if (is_null != NULL)
+    *is_null = 0;
+
+  for (size_t c = 0; c < ncols; c++) {
+
+    const struct cityhash_column* col = &cols[c];
+    uint64_t v;
+
+    if (col->nulls != NULL && col->nulls[row]) {
+
+      if (nulls == CITYHASH_NULLS_SKIP)
+        continue;
+
+      if (nulls == CITYHASH_NULLS_PROPAGATE) {
+        if (is_null != NULL)
+          *is_null = 1;
+        return CITYHASH_NULL_HASH;
+      }
+
+      v = CITYHASH_NULL_HASH;
+    } else {
+      v = value_hash(col, row);
+    }
+
+    if (started) {
+      uint128_t u = {h, v};
+      h = hash_128_to_64(u);
+    } else {
+      h = v;
+      started = 1;
+    }
+  }
+
+  return h;
+}
+
+static void hash_block(const struct cityhash_column* cols, size_t ncols,
+                       size_t lo, size_t n, enum cityhash_nulls nulls,
+                       uint64_t* h, uint8_t* out_nulls) {
+
+  uint64_t v[KBLOCK];
+  uint8_t started[KBLOCK];
+  uint8_t null_row[KBLOCK];
+  int partial = 0;
+  int any_null = 0;
+
+  if (ncols == 0) {
+    for (size_t i = 0; i < n; i++)
+      h[i] = CITYHASH_NULL_HASH;
+  }
+
+  memset(null_row, 0, n);
+
+  for (size_t c = 0; c < ncols; c++) {
+
+    const struct cityhash_column* col = &cols[c];
+    const uint8_t* cn = col->nulls != NULL ? col->nulls + lo : NULL;
+    uint64_t* dst = c == 0 ? h : v;
+
+    column_hash(col, lo, n, dst);
+
+    if (cn != NULL) {
+      switch (nulls) {
+      case CITYHASH_NULLS_HASH:
+        for (size_t i = 0; i < n; i++)
+          dst[i] = cn[i] ? CITYHASH_NULL_HASH : dst[i];
+        break;
+      case CITYHASH_NULLS_PROPAGATE:
+        for (size_t i = 0; i < n; i++)
+          null_row[i] |= cn[i] != 0;
+        any_null = 1;
+        break;
+      case CITYHASH_NULLS_SKIP:
+        // from here on rows may differ in whether they have a value yet
+        if (!partial)
+          memset(started, c > 0, n);
+        partial = 1;
+        break;
+      }
+    }
+
+    // rows that skipped every column so far take the value as it is
+    if (partial) {
+      for (size_t i = 0; i < n; i++) {
+
+        if (cn != NULL && cn[i]) {
+          if (c == 0)
+            h[i] = CITYHASH_NULL_HASH;
+          continue;
+        }
+
+        if (started[i] && c > 0) {
+          uint128_t u = {h[i], v[i]};
+          h[i] = hash_128_to_64(u);
+        } else if (c > 0) {
+          h[i] = v[i];
+        }
+
+        started[i] = 1;
+      }
+    } else if (c > 0) {
+      cityhash64_combine(h, v, n);
+    }
+  }
+
+  if (any_null) {
+    for (size_t i = 0; i < n; i++)
+      h[i] = null_row[i] ? CITYHASH_NULL_HASH : h[i];
+  }
+
+  if (out_nulls != NULL)
+    memcpy(out_nulls, null_row, n);
+}
+
+void cityhash64_rows(const struct cityhash_column* cols, size_t ncols,
+                     size_t rows, enum cityhash_nulls nulls, uint64_t* out,
+                     uint8_t* out_nulls) {
+
+  for (size_t lo = 0; lo < rows; lo += KBLOCK) {
+
+    size_t n = rows - lo < KBLOCK ? rows - lo : KBLOCK;
+
+    hash_block(cols, ncols, lo, n, nulls, out + lo,
+               out_nulls != NULL ? out_nulls + lo : NULL);
+  }
+}
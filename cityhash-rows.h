@@ -0,0 +1,69 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Row hashes over several columns, as used for group-by keys and sharding.
+// The hash of a row is the hash of its first column, folded with the hash of
+// every further column as h = hash_128_to_64({h, v}), the way ClickHouse's
+// cityHash64(a, b, c) combines its arguments.  cityhash64_rows() computes
+// it one column at a time over blocks of rows: a column is hashed in a
+// tight loop (fixed-width values with cityhash64_batch_fixed(), strings with
+// cityhash64_batch_offsets()) and folded into the block's row hashes with
+// cityhash64_combine(), so the result is that of cityhash64_row() for every
+// row at the speed of the column loops.
+
+#ifndef CITYHASH_ROWS_H
+#define CITYHASH_ROWS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash.h"
+
+// what a null value hashes to with CITYHASH_NULLS_HASH, and the hash of a
+// null row or of a row without values
+#define CITYHASH_NULL_HASH (0x5bd1e9955bd1e995ULL)
+
+enum cityhash_nulls {
+  CITYHASH_NULLS_HASH,      // a null value hashes to CITYHASH_NULL_HASH
+  CITYHASH_NULLS_SKIP,      // a null value is left out of its row
+  CITYHASH_NULLS_PROPAGATE, // a row with a null value is null
+};
+
+struct cityhash_column {
+  const uint8_t* data;
+  const uint32_t* offsets; // rows + 1 offsets into data for strings, or NULL
+  size_t width;            // bytes per value when offsets is NULL
+  const uint8_t* nulls;    // nulls[row] != 0 marks a null value, or NULL
+};
+
+// hash of row row of ncols columns; is_null, if not NULL, is set to whether
+// the row is null, which only CITYHASH_NULLS_PROPAGATE makes it
+uint64_t cityhash64_row(const struct cityhash_column* cols, size_t ncols,
+                        size_t row, enum cityhash_nulls nulls, int* is_null);
+
+// out[row] = cityhash64_row(cols, ncols, row, nulls, ...) for row < rows;
+// out_nulls, if not NULL, receives whether each row is null
+void cityhash64_rows(const struct cityhash_column* cols, size_t ncols,
+                     size_t rows, enum cityhash_nulls nulls, uint64_t* out,
+                     uint8_t* out_nulls);
+
+#endif // CITYHASH_ROWS_H
@@ -0,0 +1,388 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Asynchronous hashing service, see cityhash-service.h.
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "cityhash-service.h"
+
+// empty polls of its ring a worker makes, yielding in between, before it
+// goes to sleep
+#define KSPIN (16)
+
+// bounded queue with a sequence number per cell (Vyukov); producers claim
+// a cell with a CAS on tail, the worker is the only consumer
+struct cell {
+  size_t seq;
+  struct cityhash_request* req;
+};
+
+struct ring {
+  size_t head __attribute__((aligned(64)));
+  size_t tail __attribute__((aligned(64)));
+  size_t mask;
+  struct cell* cells;
+};
+
+static int ring_init(struct ring* r, size_t size) {
+
+  r->cells = malloc(size * sizeof(struct cell));
+
+  if (r->cells == NULL)
+    return -1;
+
+  for (size_t i = 0; i < size; i++)
+    r->cells[i].seq = i;
+
+  r->head = 0;
+  r->tail = 0;
+  r->mask = size - 1;
+
+  return 0;
+}
+
+static int ring_push(struct ring* r, struct cityhash_request* req) {
+
+  size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  struct cell* c;
+
+  for (;;) {
+    c = &r->cells[pos & r->mask];
+
+    size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      return -1;
+    } else {
+      pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  c->req = req;
+  __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+static size_t ring_pop(struct ring* r, struct cityhash_request** out,
+                       size_t n) {
+
+  size_t pos = r->head;
+  size_t i;
+
+  for (i = 0; i < n; i++, pos++) {
+    struct cell* c = &r->cells[pos & r->mask];
+
+    if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != pos + 1)
+      break;
+
+    out[i] = c->req;
+    __atomic_store_n(&c->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+  }
+
+  r->head = pos;
+
+  return i;
+}
+
+struct worker {
+  struct ring ring;
+  struct cityhash_service* svc;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int sleeping;
+  int stop;
+};
+
+struct cityhash_service {
+  struct worker* workers;
+  int nworkers;
+  int fd;
+};
+
+// ring a thread submits to next, so that the producers spread over the
+// workers without sharing a counter
+static __thread unsigned next_ring;
+
+static void complete(struct cityhash_service* svc,
+                     struct cityhash_request** reqs, size_t n) {
+
+  const uint8_t* bufs64[CITYHASH_SERVICE_BATCH];
+  size_t lens64[CITYHASH_SERVICE_BATCH];
+  uint64_t out64[CITYHASH_SERVICE_BATCH];
+  size_t idx64[CITYHASH_SERVICE_BATCH];
+  const uint8_t* bufs128[CITYHASH_SERVICE_BATCH];
+  size_t lens128[CITYHASH_SERVICE_BATCH];
+  uint128_t out128[CITYHASH_SERVICE_BATCH];
+  size_t idx128[CITYHASH_SERVICE_BATCH];
+  size_t n64 = 0;
+  size_t n128 = 0;
+
+  // gather the keys of each algorithm so the batch kernels see them together
+  for (size_t i = 0; i < n; i++) {
+    struct cityhash_request* req = reqs[i];
+
+    switch (req->algorithm) {
+    case CITYHASH_ALG_64:
+      bufs64[n64] = req->buf;
+      lens64[n64] = req->len;
+      idx64[n64++] = i;
+      break;
+    case CITYHASH_ALG_128:
+      bufs128[n128] = req->buf;
+      lens128[n128] = req->len;
+      idx128[n128++] = i;
+      break;
+    default:
+      req->result.a = cityhash32(req->buf, req->len);
+      req->result.b = 0;
+      break;
+    }
+  }
+
+  cityhash64_batch(bufs64, lens64, n64, out64);
+  cityhash128_batch(bufs128, lens128, n128, out128);
+
+  for (size_t i = 0; i < n64; i++) {
+    reqs[idx64[i]]->result.a = out64[i];
+    reqs[idx64[i]]->result.b = 0;
+  }
+
+  for (size_t i = 0; i < n128; i++)
+    reqs[idx128[i]]->result = out128[i];
+
+  // a request with a callback belongs to the callback once it is called
+  for (size_t i = 0; i < n; i++) {
+    struct cityhash_request* req = reqs[i];
+
+    if (req->callback != NULL)
+      req->callback(req);
+    else
+      __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+  }
+
+#if defined(__linux__)
+  if (svc->fd >= 0) {
+    uint64_t count = n;
+    ssize_t r = write(svc->fd, &count, sizeof(count));
+    (void)r;
+  }
+#endif
+}
+
+static void* worker_main(void* p) {
+
+  struct worker* w = p;
+  struct cityhash_request* reqs[CITYHASH_SERVICE_BATCH];
+  int idle = 0;
+
+  for (;;) {
+
+    size_t n = ring_pop(&w->ring, reqs, CITYHASH_SERVICE_BATCH);
+
+    if (n > 0) {
+      complete(w->svc, reqs, n);
+      idle = 0;
+      continue;
+    }
+
+    if (++idle < KSPIN) {
+      sched_yield();
+      continue;
+    }
+
+    // a producer reads sleeping after its push, the worker looks at the ring
+    // after setting it, so one of them sees the other
+    pthread_mutex_lock(&w->lock);
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    size_t head = w->ring.head;
+    int empty = __atomic_load_n(&w->ring.cells[head & w->ring.mask].seq,
+                                __ATOMIC_ACQUIRE) != head + 1;
+
+    if (empty && w->stop) {
+      pthread_mutex_unlock(&w->lock);
+      break;
+    }
+
+    if (empty)
+      pthread_cond_wait(&w->wake, &w->lock);
+
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+    idle = 0;
+  }
+
+  return NULL;
+}
+
+struct cityhash_service* cityhash_service_create(int workers,
+                                                 size_t ring_size) {
+
+  if (workers <= 0)
+    workers = 1;
+
+  if (ring_size == 0)
+    ring_size = 4096;
+
+  size_t size = 2;
+
+  while (size < ring_size)
+    size <<= 1;
+
+  struct cityhash_service* svc = malloc(sizeof(*svc));
+
+  if (svc == NULL)
+    return NULL;
+
+  if (posix_memalign((void**)&svc->workers, 64,
+                     workers * sizeof(struct worker)) != 0) {
+    free(svc);
+    return NULL;
+  }
+
+  memset(svc->workers, 0, workers * sizeof(struct worker));
+  svc->nworkers = 0;
+
+#if defined(__linux__)
+  svc->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+  svc->fd = -1;
+#endif
+
+  for (int i = 0; i < workers; i++) {
+    struct worker* w = &svc->workers[i];
+
+    w->svc = svc;
+
+    if (ring_init(&w->ring, size) != 0)
+      break;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+      pthread_cond_destroy(&w->wake);
+      pthread_mutex_destroy(&w->lock);
+      free(w->ring.cells);
+      break;
+    }
+
+    svc->nworkers++;
+  }
+
+  // unlike a pool, a service cannot fall back to the caller's thread
+  if (svc->nworkers == 0) {
+    if (svc->fd >= 0)
+      close(svc->fd);
+    free(svc->workers);
+    free(svc);
+    return NULL;
+  }
+
+  return svc;
+}
+
+void cityhash_service_destroy(struct cityhash_service* svc) {
+
+  if (svc == NULL)
+    return;
+
+  for (int i = 0; i < svc->nworkers; i++) {
+    struct worker* w = &svc->workers[i];
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  for (int i = 0; i < svc->nworkers; i++) {
+    struct worker* w = &svc->workers[i];
+
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+    free(w->ring.cells);
+  }
+
+  if (svc->fd >= 0)
+    close(svc->fd);
+
+  free(svc->workers);
+  free(svc);
+}
+
+int cityhash_service_submit(struct cityhash_service* svc,
+                            struct cityhash_request* req) {
+
+  req->done = 0;
+
+  // a full ring sends the request on to the next worker
+  for (int i = 0; i < svc->nworkers; i++) {
+    struct worker* w = &svc->workers[next_ring++ % svc->nworkers];
+
+    if (ring_push(&w->ring, req) != 0)
+      continue;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&w->sleeping, __ATOMIC_RELAXED)) {
+      pthread_mutex_lock(&w->lock);
+      pthread_cond_signal(&w->wake);
+      pthread_mutex_unlock(&w->lock);
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+int cityhash_service_fd(const struct cityhash_service* svc) {
+  return svc->fd;
+}
+
+int cityhash_request_done(const struct cityhash_request* req) {
+  return __atomic_load_n(&req->done, __ATOMIC_ACQUIRE);
+}
+
+void cityhash_request_wait(const struct cityhash_request* req) {
+
+  while (!cityhash_request_done(req))
+    sched_yield();
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Asynchronous hashing service.  Threads that must not spend time hashing
+// submit requests (buffer, length, algorithm, optional callback) to lock-free
+// multi-producer rings, one per worker thread.  Each worker drains its ring
+// in batches, runs the keys of a batch through cityhash64_batch() and
+// cityhash128_batch() (the AVX2 lanes when built for them), stores the
+// results, calls the callbacks and then adds the batch size to an eventfd,
+// so completions can be waited for with poll/epoll next to sockets.  A
+// request is owned by the caller and must stay valid until it completes.
+
+#ifndef CITYHASH_SERVICE_H
+#define CITYHASH_SERVICE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash.h"
+
+// requests a worker takes from its ring at a time
+#define CITYHASH_SERVICE_BATCH (64)
+
+enum cityhash_algorithm {
+  CITYHASH_ALG_32 = 0,
+  CITYHASH_ALG_64,
+  CITYHASH_ALG_128,
+};
+
+struct cityhash_request;
+
+typedef void (*cityhash_callback)(struct cityhash_request* req);
+
+struct cityhash_request {
+  const uint8_t* buf;
+  size_t len;
+  enum cityhash_algorithm algorithm;
+  // called on the worker thread with the result in place, from then on
+  // the callback owns req; NULL to wait for done instead
+  cityhash_callback callback;
+  void* user;
+
+  // set by the service: result.a holds 32- and 64-bit hashes
+  uint128_t result;
+  int done;
+};
+
+struct cityhash_service;
+
+// a service with workers threads (0 for 1) and rings of ring_size requests
+// each (0 for 4096, rounded up to a power of two); NULL if it cannot be set up
+struct cityhash_service* cityhash_service_create(int workers,
+                                                 size_t ring_size);
+
+// hashes what has been submitted, then stops and joins the workers
+void cityhash_service_destroy(struct cityhash_service* svc);
+
+// queues req, returns 0, or -1 if the ring is full and req was not queued
+int cityhash_service_submit(struct cityhash_service* svc,
+                            struct cityhash_request* req);
+
+// eventfd that every completed batch adds its number of requests to, or -1
+// where eventfd is not available
+int cityhash_service_fd(const struct cityhash_service* svc);
+
+// non-zero once the result of req, submitted without a callback, is valid
+int cityhash_request_done(const struct cityhash_request* req);
+
+// waits until req is done
+void cityhash_request_wait(const struct cityhash_request* req);
+
+#endif // CITYHASH_SERVICE_H
@@ -0,0 +1,193 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Per-thread call statistics, see cityhash-stats.h.
+
+#include <string.h>
+
+#include "cityhash-stats.h"
+
+static const char* variant_names[CITYHASH_STATS_VARIANTS] = {
+    "cityhash32",
+    "cityhash64",
+    "cityhash64_with_seed",
+    "cityhash64_with_seeds",
+    "cityhash128",
+    "cityhash128_with_seed",
+    "cityhash128_crc",
+    "cityhash128_crc_with_seed",
+    "cityhash256_crc",
+};
+
+const char* cityhash_stats_variant_name(enum cityhash_stats_variant v) {
+  return v < CITYHASH_STATS_VARIANTS ? variant_names[v] : "unknown";
+}
+
+size_t cityhash_stats_bucket_min(int b) {
+  return b == 0 ? 0 : (size_t)1 << (b - 1);
+}
+
+void cityhash_stats_merge(struct cityhash_stats* dst,
+                          const struct cityhash_stats* src) {
+
+  for (int v = 0; v < CITYHASH_STATS_VARIANTS; v++) {
+    for (int b = 0; b < CITYHASH_STATS_BUCKETS; b++) {
+      dst->counts[v][b].calls += src->counts[v][b].calls;
+      dst->counts[v][b].bytes += src->counts[v][b].bytes;
+    }
+  }
+}
+
+#if defined(CITYHASH_STATS)
+
+#include <pthread.h>
+
+// one block per thread, aligned so that no two threads share a cache line
+struct stats_block {
+  struct cityhash_stats stats;
+  struct stats_block* next;
+  struct stats_block* prev;
+} __attribute__((aligned(64)));
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t registry_key;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+// blocks of live threads
+static struct stats_block* registry;
+
+// counters of threads that have exited
+static struct cityhash_stats retired;
+
+static __thread struct stats_block* local;
+
+// fold the counters of an exiting thread into retired
+static void retire_block(void* p) {
+
+  struct stats_block* block = p;
+
+  pthread_mutex_lock(&registry_lock);
+
+  cityhash_stats_merge(&retired, &block->stats);
+
+  if (block->prev != NULL)
+    block->prev->next = block->next;
+  else
+    registry = block->next;
+
+  if (block->next != NULL)
+    block->next->prev = block->prev;
+
+  pthread_mutex_unlock(&registry_lock);
+
+  local = NULL;
+  free(block);
+}
+
+static void registry_init(void) {
+  pthread_key_create(&registry_key, retire_block);
+}
+
+static struct stats_block* register_thread(void) {
+
+  struct stats_block* block;
+
+  if (posix_memalign((void**)&block, 64, sizeof(*block)) != 0)
+    abort();
+
+  memset(block, 0, sizeof(*block));
+
+  pthread_once(&registry_once, registry_init);
+  pthread_mutex_lock(&registry_lock);
+
+  block->next = registry;
+
+  if (registry != NULL)
+    registry->prev = block;
+
+  registry = block;
+
+  pthread_mutex_unlock(&registry_lock);
+  pthread_setspecific(registry_key, block);
+
+  local = block;
+
+  return block;
+}
+
+static int length_bucket(size_t len) {
+
+  if (len == 0)
+    return 0;
+
+  int b = 64 - __builtin_clzll((unsigned long long)len);
+
+  return b < CITYHASH_STATS_BUCKETS ? b : CITYHASH_STATS_BUCKETS - 1;
+}
+
+// only the owning thread writes a block, the relaxed atomics merely keep
+// concurrent snapshots well defined and compile to plain loads and stores
+#define BUMP(x, n)                                                             \
+  __atomic_store_n(&(x), __atomic_load_n(&(x), __ATOMIC_RELAXED) + (n),        \
+                   __ATOMIC_RELAXED)
+
+void cityhash_stats_record(enum cityhash_stats_variant v, size_t len) {
+
+  struct stats_block* block = local;
+
+  if (__builtin_expect(block == NULL, 0))
+    block = register_thread();
+
+  struct cityhash_stats_count* c = &block->stats.counts[v][length_bucket(len)];
+
+  BUMP(c->calls, 1);
+  BUMP(c->bytes, len);
+}
+
+int cityhash_stats_enabled(void) { return 1; }
+
+void cityhash_stats_snapshot(struct cityhash_stats* out) {
+
+  pthread_mutex_lock(&registry_lock);
+
+  *out = retired;
+
+  for (struct stats_block* b = registry; b != NULL; b = b->next) {
+    for (int v = 0; v < CITYHASH_STATS_VARIANTS; v++) {
+      for (int i = 0; i < CITYHASH_STATS_BUCKETS; i++) {
+        struct cityhash_stats_count* c = &b->stats.counts[v][i];
+        out->counts[v][i].calls += __atomic_load_n(&c->calls, __ATOMIC_RELAXED);
+        out->counts[v][i].bytes += __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
+
+#else
+
+int cityhash_stats_enabled(void) { return 0; }
+
+void cityhash_stats_snapshot(struct cityhash_stats* out) {
+  memset(out, 0, sizeof(*out));
+}
+
+#endif // CITYHASH_STATS
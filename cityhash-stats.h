@@ -0,0 +1,89 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+// Opt-in call statistics.  When the library is built with CITYHASH_STATS
+// defined, every public entry point counts its calls and hashed bytes per
+// power-of-two length bucket in a per-thread, cache line aligned block, so
+// recording never contends with other threads.  Without CITYHASH_STATS the
+// recording macro expands to nothing and snapshots are all zero.
+
+#ifndef CITYHASH_STATS_H
+#define CITYHASH_STATS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+enum cityhash_stats_variant {
+  CITYHASH_STATS_32 = 0,
+  CITYHASH_STATS_64,
+  CITYHASH_STATS_64_WITH_SEED,
+  CITYHASH_STATS_64_WITH_SEEDS,
+  CITYHASH_STATS_128,
+  CITYHASH_STATS_128_WITH_SEED,
+  CITYHASH_STATS_128_CRC,
+  CITYHASH_STATS_128_CRC_WITH_SEED,
+  CITYHASH_STATS_256_CRC,
+  CITYHASH_STATS_VARIANTS
+};
+
+// bucket 0 holds len == 0, bucket b > 0 holds 2^(b-1) <= len < 2^b, the
+// last bucket also holds everything longer
+#define CITYHASH_STATS_BUCKETS 34
+
+struct cityhash_stats_count {
+  uint64_t calls;
+  uint64_t bytes;
+};
+
+struct cityhash_stats {
+  struct cityhash_stats_count
+      counts[CITYHASH_STATS_VARIANTS][CITYHASH_STATS_BUCKETS];
+};
+
+// non-zero if the library was built with CITYHASH_STATS
+int cityhash_stats_enabled(void);
+
+// name of a variant, e.g. "cityhash64"
+const char* cityhash_stats_variant_name(enum cityhash_stats_variant v);
+
+// smallest length counted in bucket b
+size_t cityhash_stats_bucket_min(int b);
+
+// sum of the counters of all threads, including threads that have exited
+void cityhash_stats_snapshot(struct cityhash_stats* out);
+
+// add the counters of src to dst, e.g. to aggregate snapshots of processes
+void cityhash_stats_merge(struct cityhash_stats* dst,
+                          const struct cityhash_stats* src);
+
+#if defined(CITYHASH_STATS)
+
+void cityhash_stats_record(enum cityhash_stats_variant v, size_t len);
+
+#define CITYHASH_STATS_RECORD(v, len) cityhash_stats_record((v), (len))
+
+#else
+
+#define CITYHASH_STATS_RECORD(v, len) ((void)0)
+
+#endif
+
+#endif // CITYHASH_STATS_H
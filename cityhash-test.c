@@ -20,10 +20,25 @@
 
 #if defined(UNIT_TESTING)
 
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "cityhash-arena.h"
+#include "cityhash-iblt.h"
+#include "cityhash-lookup.h"
+#include "cityhash-numa.h"
+#include "cityhash-parallel.h"
+#include "cityhash-router.h"
+#include "cityhash-rows.h"
+#include "cityhash-service.h"
+#include "cityhash-stats.h"
+#include "cityhash-theta.h"
 #include "cityhash.h"
 
 #define KSEED_0 (1234567)
@@ -1276,6 +1291,7 @@ void test(const uint64_t expected[16], int offset, int len) {
 
   const uint128_t u = cityhash128(data + offset, len);
   const uint128_t v = cityhash128_with_seed(data + offset, len, kseed128);
+  const uint128_t w = cityhash128_stream(data + offset, len, len % 3 * 256);
 
   check(expected[0], cityhash64(data + offset, len));
   check(expected[15], cityhash32(data + offset, len));
@@ -1285,6 +1301,13 @@ void test(const uint64_t expected[16], int offset, int len) {
   check(expected[4], u.b);
   check(expected[5], v.a);
   check(expected[6], v.b);
+  check(expected[3], w.a);
+  check(expected[4], w.b);
+
+  if (offset + len + CITYHASH_PADDING <= kdata_size) {
+    check(expected[0], cityhash64_padded(data + offset, len));
+    check(expected[15], cityhash32_padded(data + offset, len));
+  }
 
 #ifdef __SSE4_2__
 
@@ -1292,6 +1315,8 @@ void test(const uint64_t expected[16], int offset, int len) {
   const uint128_t z = cityhash128_crc_with_seed(data + offset, len, kseed128);
 
   uint256_t results = cityhash256_crc(data + offset, len);
+  uint256_t streamed =
+      cityhash256_crc_stream(data + offset, len, len % 3 * 256);
 
   check(expected[7], y.a);
   check(expected[8], y.b);
@@ -1303,7 +1328,990 @@ void test(const uint64_t expected[16], int offset, int len) {
   check(expected[13], results.c);
   check(expected[14], results.d);
 
+  check(expected[11], streamed.a);
+  check(expected[12], streamed.b);
+  check(expected[13], streamed.c);
+  check(expected[14], streamed.d);
+
+#endif
+}
+
+// cityhash128_batch() of every test key at once, then of long keys of mixed
+// lengths against cityhash128(), so lanes are refilled and drained
+void test_batch() {
+
+  static const uint8_t* bufs[KTEST_SIZE];
+  static size_t lens[KTEST_SIZE];
+  static uint128_t out[KTEST_SIZE];
+
+  for (int i = 0; i < ktest_size - 1; i++) {
+    bufs[i] = data + i * i;
+    lens[i] = i;
+  }
+
+  bufs[ktest_size - 1] = data;
+  lens[ktest_size - 1] = kdata_size;
+
+  cityhash128_batch(bufs, lens, ktest_size, out);
+
+  for (int i = 0; i < ktest_size; i++) {
+    check(testdata[i][3], out[i].a);
+    check(testdata[i][4], out[i].b);
+  }
+
+  for (int i = 0; i < ktest_size; i++) {
+    bufs[i] = data + i * i;
+    lens[i] = (i * 7919) % 9000;
+  }
+
+  cityhash128_batch(bufs, lens, ktest_size, out);
+
+  for (int i = 0; i < ktest_size; i++) {
+
+    const uint128_t u = cityhash128(bufs[i], lens[i]);
+
+    check(u.a, out[i].a);
+    check(u.b, out[i].b);
+  }
+}
+
+#if defined(CITYHASH_STATS)
+
+enum { kstats_calls = 10, kstats_len = 100, kstats_bucket = 7 };
+
+// calls of v since before, checking that they all went to kstats_bucket
+static uint64_t stats_calls(const struct cityhash_stats* before,
+                            const struct cityhash_stats* after,
+                            enum cityhash_stats_variant v) {
+
+  for (int b = 0; b < CITYHASH_STATS_BUCKETS; b++) {
+    if (b != kstats_bucket)
+      check(before->counts[v][b].calls, after->counts[v][b].calls);
+  }
+
+  check(kstats_len * (after->counts[v][kstats_bucket].calls -
+                      before->counts[v][kstats_bucket].calls),
+        after->counts[v][kstats_bucket].bytes -
+            before->counts[v][kstats_bucket].bytes);
+
+  return after->counts[v][kstats_bucket].calls -
+         before->counts[v][kstats_bucket].calls;
+}
+
+static pthread_barrier_t stats_barrier;
+static volatile uint64_t stats_sink;
+
+static void* stats_thread(void* p) {
+
+  for (int i = 0; i < kstats_calls; i++)
+    stats_sink += cityhash64(data, kstats_len);
+
+  // stays alive until the main thread has taken its snapshot
+  pthread_barrier_wait(&stats_barrier);
+  pthread_barrier_wait(&stats_barrier);
+
+  return p;
+}
+
+// exact call counts per entry point, for a live thread, for threads merged
+// into the snapshot, and for a thread that has been joined
+void test_stats() {
+
+  struct cityhash_stats before;
+  struct cityhash_stats after;
+  struct cityhash_stats joined;
+  uint128_t seed = {KSEED_0, KSEED_1};
+
+  check(1, cityhash_stats_enabled());
+  check(64, cityhash_stats_bucket_min(kstats_bucket));
+
+  // every entry point counts each call once, under its own variant
+  cityhash_stats_snapshot(&before);
+
+  for (int i = 0; i < kstats_calls; i++) {
+    stats_sink += cityhash32(data, kstats_len);
+    stats_sink += cityhash64(data, kstats_len);
+    stats_sink += cityhash64_with_seed(data, kstats_len, KSEED_0);
+    stats_sink += cityhash64_with_seeds(data, kstats_len, KSEED_0, KSEED_1);
+    stats_sink += cityhash128(data, kstats_len).a;
+    stats_sink += cityhash128_with_seed(data, kstats_len, seed).a;
+#if defined(__SSE4_2__) && defined(__x86_64)
+    stats_sink += cityhash128_crc(data, kstats_len).a;
+    stats_sink += cityhash128_crc_with_seed(data, kstats_len, seed).a;
+    stats_sink += cityhash256_crc(data, kstats_len).a;
+#endif
+  }
+
+  cityhash_stats_snapshot(&after);
+
+  for (int v = 0; v < CITYHASH_STATS_VARIANTS; v++) {
+#if !defined(__SSE4_2__) || !defined(__x86_64)
+    if (v >= CITYHASH_STATS_128_CRC) {
+      check(0, stats_calls(&before, &after, v));
+      continue;
+    }
 #endif
+    check(kstats_calls, stats_calls(&before, &after, v));
+  }
+
+  // two threads count in blocks of their own, summed while they run and
+  // kept once they have exited
+  pthread_t thread[2];
+
+  pthread_barrier_init(&stats_barrier, NULL, 3);
+  cityhash_stats_snapshot(&before);
+
+  for (int i = 0; i < 2; i++)
+    pthread_create(&thread[i], NULL, stats_thread, NULL);
+
+  // the threads' calls are done once all three are at the barrier, and
+  // they cannot exit before the second wait
+  pthread_barrier_wait(&stats_barrier);
+  cityhash_stats_snapshot(&after);
+  pthread_barrier_wait(&stats_barrier);
+  check(2 * kstats_calls, stats_calls(&before, &after, CITYHASH_STATS_64));
+
+  for (int i = 0; i < 2; i++)
+    pthread_join(thread[i], NULL);
+
+  pthread_barrier_destroy(&stats_barrier);
+  cityhash_stats_snapshot(&joined);
+  check(2 * kstats_calls, stats_calls(&before, &joined, CITYHASH_STATS_64));
+
+  // merging adds every counter
+  struct cityhash_stats twice = joined;
+
+  cityhash_stats_merge(&twice, &joined);
+
+  for (int v = 0; v < CITYHASH_STATS_VARIANTS; v++) {
+    for (int b = 0; b < CITYHASH_STATS_BUCKETS; b++) {
+      check(2 * joined.counts[v][b].calls, twice.counts[v][b].calls);
+      check(2 * joined.counts[v][b].bytes, twice.counts[v][b].bytes);
+    }
+  }
+}
+
+#else
+
+void test_stats() {
+
+  struct cityhash_stats stats;
+
+  cityhash64(data, 100);
+  cityhash_stats_snapshot(&stats);
+  check(0, cityhash_stats_enabled());
+  check(0, stats.counts[CITYHASH_STATS_64][7].calls);
+}
+
+#endif // CITYHASH_STATS
+
+// cityhash64_numa_batch_offsets() of a column of short keys over the test
+// data against cityhash64_batch_offsets(), with several threads per node
+void test_numa() {
+
+  enum { rows = 100000 };
+
+  static uint32_t offsets[rows + 1];
+  static uint64_t expected[rows];
+  static uint64_t out[rows];
+  struct cityhash_numa_report report;
+
+  for (int i = 0; i < rows; i++)
+    offsets[i + 1] = offsets[i] + (i * 7919) % 19;
+
+  cityhash64_batch_offsets(data, offsets, rows, expected);
+
+  for (int threads = 0; threads <= 3; threads += 3) {
+
+    uint64_t counted = 0;
+
+    memset(out, 0, sizeof(out));
+    cityhash64_numa_batch_offsets(data, offsets, rows, out, threads, &report);
+
+    for (int i = 0; i < rows; i++)
+      check(expected[i], out[i]);
+
+    for (int k = 0; k < report.nodes; k++)
+      counted += report.node[k].rows;
+
+    check(rows, counted);
+  }
+}
+
+// the parallel functions on one pool, reused across calls, against serial
+// hashing of short keys with a few keys as long as the test data mixed in
+void test_parallel() {
+
+  enum { keys = 200000, rows = 50000 };
+
+  static const uint8_t* bufs[keys];
+  static size_t lens[keys];
+  static uint64_t out64[keys];
+  static uint128_t out128[keys];
+  static uint32_t offsets[rows + 1];
+  struct cityhash_pool* pool = cityhash_pool_create(4);
+
+  for (int i = 0; i < keys; i++) {
+    lens[i] = i % 40000 == 7 ? kdata_size : 10;
+    bufs[i] = data + (lens[i] == 10 ? i % (kdata_size - 10) : 0);
+  }
+
+  for (int i = 0; i < rows; i++)
+    offsets[i + 1] = offsets[i] + (i % 20000 == 3 ? 200000 : (i * 7919) % 9);
+
+  for (int round = 0; round < 2; round++) {
+
+    cityhash64_parallel(pool, bufs, lens, keys, out64);
+    cityhash128_parallel(pool, bufs, lens, keys, out128);
+
+    for (int i = 0; i < keys; i++) {
+
+      const uint128_t u = cityhash128(bufs[i], lens[i]);
+
+      check(cityhash64(bufs[i], lens[i]), out64[i]);
+      check(u.a, out128[i].a);
+      check(u.b, out128[i].b);
+    }
+
+    cityhash64_parallel_offsets(pool, data, offsets, rows, out64);
+    cityhash128_parallel_offsets(pool, data, offsets, rows, out128);
+
+    for (int i = 0; i < rows; i++) {
+
+      const uint8_t* key = data + offsets[i];
+      const uint128_t u = cityhash128(key, offsets[i + 1] - offsets[i]);
+
+      check(cityhash64(key, offsets[i + 1] - offsets[i]), out64[i]);
+      check(u.a, out128[i].a);
+      check(u.b, out128[i].b);
+    }
+  }
+
+  // a handful of huge keys is split by bytes: the rest of the caller's task
+  // is pushed before each key, so the other threads steal it (given a few
+  // calls, as on a busy machine they may not run in time)
+  enum { huge_keys = 8, huge_len = 8 << 20 };
+
+  uint8_t* huge = malloc(huge_len);
+
+  for (int i = 0; i < huge_len; i++)
+    huge[i] = (uint8_t)(i * 31 + (i >> 12));
+
+  for (int i = 0; i < huge_keys; i++) {
+    bufs[i] = huge + i;
+    lens[i] = huge_len - i;
+  }
+
+  uint64_t steals = cityhash_pool_steals(pool);
+
+  for (int round = 0; round < 20; round++) {
+
+    cityhash64_parallel(pool, bufs, lens, huge_keys, out64);
+
+    for (int i = 0; i < huge_keys; i++)
+      check(cityhash64(bufs[i], lens[i]), out64[i]);
+
+    if (cityhash_pool_steals(pool) > steals)
+      break;
+  }
+
+  check(1, cityhash_pool_steals(pool) > steals);
+  free(huge);
+
+  cityhash_pool_destroy(pool);
+}
+
+enum { ktable_buckets = 4096, klookup_keys = 5000 };
+
+struct test_bucket {
+  uint64_t hash;
+  int64_t value;
+};
+
+struct test_table {
+  struct test_bucket bucket[ktable_buckets];
+  int64_t found[klookup_keys];
+};
+
+static const void* test_bucket_of(void* table, uint64_t hash) {
+  return &((struct test_table*)table)->bucket[hash % ktable_buckets];
+}
+
+// linear probing, value -1 marks an empty bucket
+static const void* test_probe(void* table, size_t i, uint64_t hash,
+                              const void* at) {
+
+  struct test_table* t = table;
+  const struct test_bucket* b = at;
+
+  if (b->value >= 0 && b->hash != hash)
+    return &t->bucket[(b - t->bucket + 1) % ktable_buckets];
+
+  t->found[i] = b->value;
+
+  return NULL;
+}
+
+void test_lookup() {
+
+  static struct test_table table;
+  static const uint8_t* keys[klookup_keys];
+  static size_t lens[klookup_keys];
+  const struct cityhash_lookup lookup = {&table, test_bucket_of, test_probe};
+
+  for (int i = 0; i < ktable_buckets; i++)
+    table.bucket[i].value = -1;
+
+  // the even keys go in the table, half full so that some chains are long
+  for (int i = 0; i < klookup_keys; i++) {
+
+    lens[i] = 8 + i % 61;
+    keys[i] = data + i;
+
+    if (i % 2 == 0 && i < ktable_buckets) {
+
+      uint64_t hash = cityhash64(keys[i], lens[i]);
+      size_t b = hash % ktable_buckets;
+
+      while (table.bucket[b].value >= 0 && table.bucket[b].hash != hash)
+        b = (b + 1) % ktable_buckets;
+
+      table.bucket[b].hash = hash;
+      table.bucket[b].value = i;
+    }
+  }
+
+  const int inflight[] = {0, 1, 3, CITYHASH_LOOKUP_MAX_INFLIGHT + 1};
+
+  for (int r = 0; r < 4; r++) {
+
+    memset(table.found, 0, sizeof(table.found));
+    cityhash64_lookup_batch(&lookup, keys, lens, klookup_keys, inflight[r]);
+
+    for (int i = 0; i < klookup_keys; i++) {
+
+      int64_t expected = i % 2 == 0 && i < ktable_buckets ? i : -1;
+
+      check(expected, table.found[i]);
+    }
+  }
+}
+
+void test_rows() {
+
+  enum { rows = 3000, ncols = 4 };
+
+  static uint32_t offsets[rows + 1];
+  static uint8_t nulls[2][rows];
+  static uint64_t out[rows];
+  static uint64_t h[rows];
+  static uint64_t v[rows];
+  static uint8_t out_nulls[rows];
+
+  // every fixed width takes a different length case of cityhash64()
+  for (size_t width = 0; width <= 40; width++) {
+
+    cityhash64_batch_fixed(data, width, 100, out);
+
+    for (size_t i = 0; i < 100; i++)
+      check(cityhash64(data + i * width, width), out[i]);
+  }
+
+  for (int i = 0; i < rows; i++) {
+    h[i] = cityhash64(data + i, 8);
+    v[i] = cityhash64(data + i, 9);
+    out[i] = h[i];
+  }
+
+  cityhash64_combine(out, v, rows - 3);
+
+  for (int i = 0; i < rows; i++) {
+    const uint128_t u = {h[i], v[i]};
+    check(i < rows - 3 ? hash_128_to_64(u) : h[i], out[i]);
+  }
+
+  for (int i = 0; i < rows; i++) {
+    offsets[i + 1] = offsets[i] + (i * 7919) % 40;
+    nulls[0][i] = i % 7 == 0;
+    nulls[1][i] = i % 5 == 0 || i < 1100;
+  }
+
+  // a nullable string, an 8-byte integer, a nullable 4-byte integer and a
+  // 1-byte integer
+  const struct cityhash_column cols[ncols] = {
+      {data, offsets, 0, nulls[0]},
+      {data + 1, NULL, 8, NULL},
+      {data + 2, NULL, 4, nulls[1]},
+      {data + 3, NULL, 1, NULL},
+  };
+
+  const struct cityhash_column swapped[ncols] = {cols[2], cols[1], cols[0],
+                                                 cols[3]};
+
+  for (int mode = CITYHASH_NULLS_HASH; mode <= CITYHASH_NULLS_PROPAGATE;
+       mode++) {
+
+    for (size_t n = 0; n <= ncols; n++) {
+
+      for (int order = 0; order < 2; order++) {
+
+        const struct cityhash_column* c = order ? swapped : cols;
+
+        cityhash64_rows(c, n, rows, mode, out, out_nulls);
+
+        for (int i = 0; i < rows; i++) {
+
+          int is_null;
+
+          check(cityhash64_row(c, n, i, mode, &is_null), out[i]);
+          check(is_null, out_nulls[i]);
+        }
+      }
+    }
+  }
+}
+
+void test_cstr() {
+
+  static char str[512 + 64];
+  long page = sysconf(_SC_PAGESIZE);
+
+  for (int offset = 0; offset < 64; offset++) {
+    for (int len = 0; len <= 512; len += len < 80 ? 1 : 37) {
+
+      char* p = str + offset;
+
+      for (int i = 0; i < len; i++)
+        p[i] = (char)(data[offset + i] | 1);
+
+      p[len] = '\0';
+      check(cityhash64((const uint8_t*)p, len), cityhash64_cstr(p));
+      check(cityhash32((const uint8_t*)p, len), cityhash32_cstr(p));
+    }
+  }
+
+  // strings that end just before an inaccessible page
+  char* map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (map == MAP_FAILED || mprotect(map + page, page, PROT_NONE) != 0)
+    return;
+
+  memset(map, 'x', page);
+  map[page - 1] = '\0';
+
+  for (int len = 0; len < 100; len++) {
+
+    const char* p = map + page - 1 - len;
+
+    check(cityhash64((const uint8_t*)p, len), cityhash64_cstr(p));
+    check(cityhash32((const uint8_t*)p, len), cityhash32_cstr(p));
+  }
+
+  munmap(map, 2 * page);
+}
+
+void test_ci() {
+
+  enum { kci_max = 300 };
+
+  static uint8_t mixed[kci_max];
+  static uint8_t lower[kci_max];
+  static const uint8_t* bufs[kci_max + 1];
+  static size_t lens[kci_max + 1];
+  static uint64_t out[kci_max + 1];
+
+  // letters of both cases next to the bytes around them, including the
+  // non-ASCII bytes 0xc1..0xda that would be letters without the top bit
+  for (int i = 0; i < kci_max; i++) {
+
+    uint8_t c = data[i];
+
+    mixed[i] = i % 3 == 0 ? c : "AzZa@[`{"[c % 8] + (c & 0x80);
+    lower[i] = mixed[i] < 0x80 ? (uint8_t)tolower(mixed[i]) : mixed[i];
+  }
+
+  for (int len = 0; len <= kci_max; len++) {
+
+    check(cityhash64(lower, len), cityhash64_ci(mixed, len));
+    check(cityhash32(lower, len), cityhash32_ci(mixed, len));
+
+    bufs[len] = mixed;
+    lens[len] = len;
+  }
+
+  cityhash64_ci_batch(bufs, lens, kci_max + 1, out);
+
+  for (int len = 0; len <= kci_max; len++)
+    check(cityhash64(lower, len), out[len]);
+}
+
+void test_arena() {
+
+  const int flags[] = {0, CITYHASH_ARENA_THP,
+                       CITYHASH_ARENA_HUGETLB | CITYHASH_ARENA_THP};
+
+  for (int f = 0; f < 3; f++) {
+
+    struct cityhash_arena* arena = cityhash_arena_create(3 << 20, flags[f]);
+    uint8_t* base = cityhash_arena_base(arena);
+
+    check(4 << 20, cityhash_arena_capacity(arena));
+    check(0, (uintptr_t)base % CITYHASH_HUGE_PAGE);
+
+    // bump allocations are aligned and do not overlap
+    uint8_t* a = cityhash_arena_alloc(arena, 3, 1);
+    uint8_t* b = cityhash_arena_alloc(arena, 100, 64);
+
+    check(0, a - base);
+    check(64, b - base);
+    memset(b, 0xab, 100);
+    check(164, cityhash_arena_used(arena));
+    check(0, (uintptr_t)cityhash_arena_alloc(arena, 4 << 20, 1));
+
+    // size classes hand back what was put
+    uint8_t* c = cityhash_arena_get(arena, 100);
+
+    check(0, (uintptr_t)c % 64);
+    cityhash_arena_put(arena, c, 100);
+    check((uintptr_t)c, (uintptr_t)cityhash_arena_get(arena, 128));
+    check(1, cityhash_arena_get(arena, 100) != c);
+
+    // through the allocator interface
+    struct cityhash_allocator al = cityhash_arena_allocator(arena);
+    uint64_t* d = al.alloc(al.ctx, 1000);
+
+    for (int i = 0; i < 125; i++)
+      d[i] = i;
+
+    al.free(al.ctx, d, 1000);
+    check((uintptr_t)d, (uintptr_t)al.alloc(al.ctx, 1024));
+    check(0xab, b[99]);
+
+    cityhash_arena_reset(arena);
+    check(0, cityhash_arena_used(arena));
+    check((uintptr_t)base, (uintptr_t)cityhash_arena_get(arena, 8));
+
+    // above the largest class, bump allocated on a cache line
+    check(64, (uint8_t*)cityhash_arena_get(arena, 1 << 20) - base);
+    cityhash_arena_destroy(arena);
+  }
+
+  void* p = cityhash_heap_allocator.alloc(NULL, 100);
+
+  check(1, p != NULL);
+  cityhash_heap_allocator.free(NULL, p, 100);
+}
+
+enum { kiblt_keys = 10000, kiblt_only_a = 30, kiblt_only_b = 20 };
+
+static uint64_t iblt_key(uint64_t i) {
+  return cityhash64_with_seed((const uint8_t*)&i, sizeof(i), 0xfeed);
+}
+
+void test_iblt() {
+
+  struct cityhash_arena* arena = cityhash_arena_create(1 << 20, 0);
+  struct cityhash_allocator al = cityhash_arena_allocator(arena);
+  struct cityhash_strata* sa = cityhash_strata_create(7, NULL);
+  struct cityhash_strata* sb = cityhash_strata_create(7, &al);
+
+  // a has keys 0..9999, b lacks the first 30 and has 20 more
+  for (uint64_t i = 0; i < kiblt_keys + kiblt_only_b; i++) {
+    if (i < kiblt_keys)
+      cityhash_strata_insert(sa, iblt_key(i));
+    if (i >= kiblt_only_a)
+      cityhash_strata_insert(sb, iblt_key(i));
+  }
+
+  // b sends its strata, a estimates the difference of 50
+  size_t bytes = cityhash_strata_bytes(sb);
+  uint8_t* buf = malloc(bytes);
+
+  cityhash_strata_serialize(sb, buf);
+  cityhash_strata_destroy(sb);
+  check(0, (uintptr_t)cityhash_strata_deserialize(buf, bytes - 1, NULL));
+  sb = cityhash_strata_deserialize(buf, bytes, NULL);
+  free(buf);
+
+  check(0, cityhash_strata_subtract(sa, sb));
+
+  size_t estimate = cityhash_strata_estimate(sa);
+
+  check(1, estimate >= 25 && estimate <= 100);
+  check(estimate, cityhash_strata_estimate(sa));
+  cityhash_strata_destroy(sa);
+  cityhash_strata_destroy(sb);
+
+  // then the table sized from it, built by both and sent by b
+  size_t cells = cityhash_iblt_cells(estimate);
+  struct cityhash_iblt* a = cityhash_iblt_create(cells, 0, 9, &al);
+  struct cityhash_iblt* b = cityhash_iblt_create(cells, 0, 9, NULL);
+  struct cityhash_iblt* c = cityhash_iblt_create(cells + 100, 0, 9, NULL);
+
+  check(0, cityhash_iblt_size(a) % CITYHASH_IBLT_HASHES);
+  check(1, cityhash_iblt_size(a) >= cells);
+
+  for (uint64_t i = 0; i < kiblt_keys + kiblt_only_b; i++) {
+    if (i < kiblt_keys)
+      cityhash_iblt_insert(a, iblt_key(i));
+    if (i >= kiblt_only_a)
+      cityhash_iblt_insert(b, iblt_key(i));
+  }
+
+  bytes = cityhash_iblt_bytes(b);
+  buf = malloc(bytes);
+  cityhash_iblt_serialize(b, buf);
+  cityhash_iblt_destroy(b);
+  check(0, (uintptr_t)cityhash_iblt_deserialize(buf, bytes - 24, NULL));
+  b = cityhash_iblt_deserialize(buf, bytes, NULL);
+  free(buf);
+
+  check(-1, cityhash_iblt_subtract(a, c));
+  check(0, cityhash_iblt_subtract(a, b));
+
+  uint64_t ours[64];
+  uint64_t theirs[64];
+  size_t nours;
+  size_t ntheirs;
+
+  check(0, cityhash_iblt_decode(a, ours, &nours, theirs, &ntheirs, 64));
+  check(kiblt_only_a, nours);
+  check(kiblt_only_b, ntheirs);
+
+  int missing = 0;
+
+  for (uint64_t i = 0; i < kiblt_only_a; i++) {
+
+    int found = 0;
+
+    for (size_t j = 0; j < nours; j++)
+      found |= ours[j] == iblt_key(i);
+
+    missing += !found;
+  }
+
+  for (uint64_t i = kiblt_keys; i < kiblt_keys + kiblt_only_b; i++) {
+
+    int found = 0;
+
+    for (size_t j = 0; j < ntheirs; j++)
+      found |= theirs[j] == iblt_key(i);
+
+    missing += !found;
+  }
+
+  check(0, missing);
+
+  // b still holds its whole set, far too much for its cells
+  check(-1, cityhash_iblt_decode(b, ours, &nours, theirs, &ntheirs, 64));
+
+  // erasing what was inserted leaves an empty table; an output too small
+  // still gets the count
+  cityhash_iblt_insert(c, 42);
+  cityhash_iblt_erase(c, 42);
+  check(0, cityhash_iblt_decode(c, ours, &nours, theirs, &ntheirs, 64));
+  check(0, nours + ntheirs);
+
+  for (uint64_t i = 0; i < 10; i++)
+    cityhash_iblt_insert(c, iblt_key(i));
+
+  check(-1, cityhash_iblt_decode(c, ours, &nours, theirs, &ntheirs, 5));
+  check(10, nours);
+
+  cityhash_iblt_destroy(a);
+  cityhash_iblt_destroy(b);
+  cityhash_iblt_destroy(c);
+  cityhash_arena_destroy(arena);
+}
+
+static int theta_close(double estimate, double expected, double error) {
+  return estimate > expected * (1 - error) && estimate < expected * (1 + error);
+}
+
+void test_theta() {
+
+  struct cityhash_theta* a = cityhash_theta_create(0, NULL);
+  struct cityhash_theta* b = cityhash_theta_create(0, NULL);
+  struct cityhash_theta* c = cityhash_theta_create(0, NULL);
+  uint64_t hashes[1000];
+
+  // exact below k, whatever the number of repeats
+  for (int r = 0; r < 3; r++) {
+    for (uint64_t i = 0; i < 500; i++)
+      cityhash_theta_update(a, (const uint8_t*)&i, sizeof(i));
+  }
+
+  check(500, (uint64_t)cityhash_theta_estimate(a));
+  check(1, cityhash_theta_fraction(a) == 1.0);
+
+  // a sees keys 0..59999, b 40000..99999 as precomputed hashes
+  cityhash_theta_reset(a);
+
+  for (uint64_t i = 0; i < 60000; i++)
+    cityhash_theta_update(a, (const uint8_t*)&i, sizeof(i));
+
+  for (uint64_t i = 40000; i < 100000; i += 1000) {
+
+    for (uint64_t j = 0; j < 1000; j++) {
+      uint64_t key = i + j;
+      hashes[j] = cityhash64((const uint8_t*)&key, sizeof(key));
+    }
+
+    cityhash_theta_update_hashes(b, hashes, 1000);
+  }
+
+  check(1, theta_close(cityhash_theta_estimate(a), 60000, 0.06));
+  check(1, theta_close(cityhash_theta_estimate(b), 60000, 0.06));
+  check(1, cityhash_theta_retained(a) >= CITYHASH_THETA_K);
+  check(1, cityhash_theta_retained(a) < 2 * CITYHASH_THETA_K);
+
+  check(0, cityhash_theta_union(c, a, b));
+  check(1, theta_close(cityhash_theta_estimate(c), 100000, 0.06));
+  check(1, cityhash_theta_retained(c) <= CITYHASH_THETA_K);
+  check(0, cityhash_theta_intersect(c, a, b));
+  check(1, theta_close(cityhash_theta_estimate(c), 20000, 0.15));
+  check(0, cityhash_theta_difference(c, a, b));
+  check(1, theta_close(cityhash_theta_estimate(c), 40000, 0.1));
+
+  // a round trip keeps the k smallest hashes, in order
+  size_t bytes = cityhash_theta_bytes(a);
+  uint8_t* buf = malloc(bytes);
+
+  check(24 + 8 * CITYHASH_THETA_K, bytes);
+  cityhash_theta_serialize(a, buf);
+  check(CITYHASH_THETA_K, cityhash_theta_retained(a));
+
+  struct cityhash_theta* d = cityhash_theta_deserialize(buf, bytes, NULL);
+
+  check(1, d != NULL);
+  check(1, cityhash_theta_estimate(a) == cityhash_theta_estimate(d));
+  check(0, (uintptr_t)cityhash_theta_deserialize(buf, bytes - 8, NULL));
+
+  memcpy(buf + 40, buf + 32, 8);
+  check(0, (uintptr_t)cityhash_theta_deserialize(buf, bytes, NULL));
+
+  // a header only sketch is exact and empty, unless its k is too large to
+  // allocate or its theta is 0
+  struct cityhash_theta* e = cityhash_theta_create(0, NULL);
+
+  cityhash_theta_serialize(e, buf);
+  cityhash_theta_destroy(e);
+  e = cityhash_theta_deserialize(buf, 24, NULL);
+  check(1, e != NULL);
+  check(0, (uint64_t)cityhash_theta_estimate(e));
+  cityhash_theta_destroy(e);
+
+  buf[8 + 3] = 0x08; // k of over 2^27
+  check(0, (uintptr_t)cityhash_theta_deserialize(buf, 24, NULL));
+  buf[8 + 3] = 0;
+  memset(buf, 0, 8);
+  check(0, (uintptr_t)cityhash_theta_deserialize(buf, 24, NULL));
+  free(buf);
+
+  // out may be an input, so a sketch can accumulate a union
+  check(0, cityhash_theta_union(d, d, b));
+  check(1, theta_close(cityhash_theta_estimate(d), 100000, 0.06));
+
+  cityhash_theta_destroy(a);
+  cityhash_theta_destroy(b);
+  cityhash_theta_destroy(c);
+  cityhash_theta_destroy(d);
+}
+
+enum { krouter_cores = 4, krouter_keys = 20000 };
+
+static const uint8_t* router_keys[krouter_cores][krouter_keys];
+static size_t router_lens[krouter_cores][krouter_keys];
+static void* router_args[krouter_cores][krouter_keys];
+
+struct router_core {
+  struct cityhash_router* router;
+  int core;
+  int expected;
+  int received;
+  int bad;
+  size_t last[krouter_cores];
+};
+
+static void router_drain(struct router_core* c) {
+
+  struct cityhash_route_msg msgs[64];
+  size_t n = cityhash_router_receive(c->router, c->core, msgs, 64);
+
+  for (size_t i = 0; i < n; i++) {
+
+    size_t src = (uintptr_t)msgs[i].arg >> 24;
+    size_t seq = (uintptr_t)msgs[i].arg & 0xffffff;
+
+    // right owner, right hash, and in order per source
+    c->bad += msgs[i].hash != cityhash64(msgs[i].key, msgs[i].len);
+    c->bad += cityhash_router_owner(c->router, msgs[i].hash) != c->core;
+    c->bad += seq + 1 <= c->last[src];
+    c->last[src] = seq + 1;
+  }
+
+  c->received += n;
+}
+
+static void* router_main(void* p) {
+
+  struct router_core* c = p;
+  size_t sent = 0;
+
+  // a full ring makes the sender drain its own rings before it retries
+  while (sent < krouter_keys) {
+    sent += cityhash_router_send(
+        c->router, c->core, router_keys[c->core] + sent,
+        router_lens[c->core] + sent, router_args[c->core] + sent,
+        krouter_keys - sent);
+    router_drain(c);
+  }
+
+  while (c->received < c->expected)
+    router_drain(c);
+
+  return NULL;
+}
+
+void test_router() {
+
+  struct cityhash_router* router = cityhash_router_create(krouter_cores, 16);
+  struct router_core core[krouter_cores];
+  pthread_t thread[krouter_cores];
+
+  memset(core, 0, sizeof(core));
+
+  for (int c = 0; c < krouter_cores; c++) {
+    for (int i = 0; i < krouter_keys; i++) {
+
+      router_keys[c][i] = data + (i * 7 + c * 13) % 1000;
+      router_lens[c][i] = i % 40;
+      router_args[c][i] = (void*)(((uintptr_t)c << 24) | i);
+
+      uint64_t hash = cityhash64(router_keys[c][i], router_lens[c][i]);
+
+      core[cityhash_router_owner(router, hash)].expected++;
+    }
+  }
+
+  for (int c = 0; c < krouter_cores; c++) {
+    core[c].router = router;
+    core[c].core = c;
+    pthread_create(&thread[c], NULL, router_main, &core[c]);
+  }
+
+  for (int c = 0; c < krouter_cores; c++) {
+    pthread_join(thread[c], NULL);
+    check(core[c].expected, core[c].received);
+    check(0, core[c].bad);
+  }
+
+  cityhash_router_destroy(router);
+}
+
+enum { kservice_requests = 20000 };
+
+struct service_producer {
+  struct cityhash_service* svc;
+  struct cityhash_request* reqs;
+  int called;
+};
+
+static void service_callback(struct cityhash_request* req) {
+  // releases the result to the thread that reads called
+  __atomic_add_fetch(&((struct service_producer*)req->user)->called, 1,
+                     __ATOMIC_RELEASE);
+}
+
+static void* service_submit(void* p) {
+
+  struct service_producer* producer = p;
+
+  for (int i = 0; i < kservice_requests; i++) {
+
+    struct cityhash_request* req = &producer->reqs[i];
+
+    req->len = i % 997 == 5 ? kdata_size : (i * 7919) % 300;
+    req->buf = data + (req->len == kdata_size ? 0 : i % 1000);
+    req->algorithm = (enum cityhash_algorithm)(i % 3);
+    req->callback = i % 2 == 0 ? service_callback : NULL;
+    req->user = producer;
+
+    while (cityhash_service_submit(producer->svc, req) != 0)
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+void test_service() {
+
+  static struct cityhash_request reqs[2][kservice_requests];
+  struct service_producer producer[2];
+  pthread_t thread[2];
+  struct cityhash_service* svc = cityhash_service_create(2, 256);
+
+  for (int t = 0; t < 2; t++) {
+    producer[t].svc = svc;
+    producer[t].reqs = reqs[t];
+    producer[t].called = 0;
+    pthread_create(&thread[t], NULL, service_submit, &producer[t]);
+  }
+
+  for (int t = 0; t < 2; t++)
+    pthread_join(thread[t], NULL);
+
+  for (int t = 0; t < 2; t++) {
+
+    for (int i = 1; i < kservice_requests; i += 2)
+      cityhash_request_wait(&reqs[t][i]);
+
+    while (__atomic_load_n(&producer[t].called, __ATOMIC_ACQUIRE) <
+           kservice_requests / 2)
+      sched_yield();
+
+    for (int i = 0; i < kservice_requests; i++) {
+
+      const struct cityhash_request* req = &reqs[t][i];
+      const uint128_t u = cityhash128(req->buf, req->len);
+
+      switch (req->algorithm) {
+      case CITYHASH_ALG_32:
+        check(cityhash32(req->buf, req->len), req->result.a);
+        break;
+      case CITYHASH_ALG_64:
+        check(cityhash64(req->buf, req->len), req->result.a);
+        break;
+      case CITYHASH_ALG_128:
+        check(u.a, req->result.a);
+        check(u.b, req->result.b);
+        break;
+      }
+    }
+  }
+
+  // the eventfd counts every completion, the last batch may be added to it
+  // just after its requests are done
+  if (cityhash_service_fd(svc) >= 0) {
+
+    uint64_t total = 0;
+
+    while (total < 2 * kservice_requests) {
+
+      uint64_t count;
+
+      if (read(cityhash_service_fd(svc), &count, sizeof(count)) ==
+          sizeof(count))
+        total += count;
+      else
+        sched_yield();
+    }
+
+    check(2 * kservice_requests, total);
+  }
+
+  cityhash_service_destroy(svc);
 }
 
 //#define test(a, b, c) dump((b, (c))
@@ -1345,6 +2353,19 @@ int main(int argc, char* argv[]) {
     test(testdata[i], i * i, i);
 
   test(testdata[ktest_size - 1], 0, kdata_size);
+  test_batch();
+  test_stats();
+  test_numa();
+  test_parallel();
+  test_service();
+  test_lookup();
+  test_rows();
+  test_cstr();
+  test_ci();
+  test_arena();
+  test_router();
+  test_iblt();
+  test_theta();
 
   return (int)(errors > 0);
 }
@@ -0,0 +1,398 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Theta sketches, see cityhash-theta.h.
+
+#include <string.h>
+
+#include "cityhash-theta.h"
+
+// theta of a sketch that has kept every hash; hashes of 0 and UINT64_MAX
+// are never counted, 0 marks an empty slot
+#define KEXACT (UINT64_MAX)
+
+// a serialized sketch starts with its theta, k and number of hashes
+#define KHEADER (24)
+
+struct cityhash_theta {
+  size_t k;
+  uint64_t theta;
+  size_t count;
+  size_t mask;      // slots - 1, slots a power of two of at least 4k
+  uint64_t* slot;   // hashes below theta, open addressing
+  uint64_t* hashes; // 2k entries of scratch for cut()
+  struct cityhash_allocator allocator;
+};
+
+static size_t gather(const struct cityhash_theta* t, uint64_t* out) {
+
+  size_t n = 0;
+
+  for (size_t i = 0; i <= t->mask; i++) {
+    if (t->slot[i] != 0)
+      out[n++] = t->slot[i];
+  }
+
+  return n;
+}
+
+// reorders a[0..n) so that a[k] holds the k+1-th smallest value, with the
+// smaller ones before it (quickselect; the hashes are distinct and random,
+// so the middle element is as good a pivot as any)
+static void select_nth(uint64_t* a, size_t n, size_t k) {
+
+  size_t lo = 0;
+  size_t hi = n - 1;
+
+  while (lo < hi) {
+
+    size_t mid = lo + (hi - lo) / 2;
+    uint64_t pivot = a[mid];
+    size_t store = lo;
+
+    a[mid] = a[hi];
+    a[hi] = pivot;
+
+    for (size_t i = lo; i < hi; i++) {
+      if (a[i] < pivot) {
+        uint64_t x = a[i];
+        a[i] = a[store];
+        a[store++] = x;
+      }
+    }
+
+    a[hi] = a[store];
+    a[store] = pivot;
+
+    if (k == store)
+      return;
+
+    if (k < store)
+      hi = store - 1;
+    else
+      lo = store + 1;
+  }
+}
+
+static void insert(struct cityhash_theta* t, uint64_t h);
+
+// keeps the k smallest hashes and lowers theta to the next one
+static void cut(struct cityhash_theta* t) {
+
+  size_t n = gather(t, t->hashes);
+
+  select_nth(t->hashes, n, t->k);
+  t->theta = t->hashes[t->k];
+  t->count = 0;
+  memset(t->slot, 0, (t->mask + 1) * sizeof(uint64_t));
+
+  for (size_t i = 0; i < t->k; i++)
+    insert(t, t->hashes[i]);
+}
+
+static void insert(struct cityhash_theta* t, uint64_t h) {
+
+  if (h >= t->theta || h == 0)
+    return;
+
+  size_t i = h & t->mask;
+
+  while (t->slot[i] != 0) {
+
+    if (t->slot[i] == h)
+      return;
+
+    i = (i + 1) & t->mask;
+  }
+
+  t->slot[i] = h;
+
+  if (++t->count == 2 * t->k)
+    cut(t);
+}
+
+struct cityhash_theta* cityhash_theta_create(
+    size_t k, const struct cityhash_allocator* allocator) {
+
+  if (allocator == NULL)
+    allocator = &cityhash_heap_allocator;
+
+  if (k == 0)
+    k = CITYHASH_THETA_K;
+
+  if (k > CITYHASH_THETA_MAX_K)
+    return NULL;
+
+  size_t slots = 4;
+
+  while (slots < 4 * k)
+    slots <<= 1;
+
+  struct cityhash_theta* t = allocator->alloc(allocator->ctx, sizeof(*t));
+
+  if (t == NULL)
+    return NULL;
+
+  t->k = k;
+  t->mask = slots - 1;
+  t->allocator = *allocator;
+  t->slot = allocator->alloc(allocator->ctx, slots * sizeof(uint64_t));
+  t->hashes = allocator->alloc(allocator->ctx, 2 * k * sizeof(uint64_t));
+
+  if (t->slot == NULL || t->hashes == NULL) {
+    cityhash_theta_destroy(t);
+    return NULL;
+  }
+
+  cityhash_theta_reset(t);
+
+  return t;
+}
+
+void cityhash_theta_destroy(struct cityhash_theta* theta) {
+
+  if (theta == NULL)
+    return;
+
+  struct cityhash_allocator a = theta->allocator;
+
+  if (theta->slot != NULL)
+    a.free(a.ctx, theta->slot, (theta->mask + 1) * sizeof(uint64_t));
+
+  if (theta->hashes != NULL)
+    a.free(a.ctx, theta->hashes, 2 * theta->k * sizeof(uint64_t));
+
+  a.free(a.ctx, theta, sizeof(*theta));
+}
+
+void cityhash_theta_reset(struct cityhash_theta* theta) {
+
+  theta->theta = KEXACT;
+  theta->count = 0;
+  memset(theta->slot, 0, (theta->mask + 1) * sizeof(uint64_t));
+}
+
+void cityhash_theta_update(struct cityhash_theta* theta, const uint8_t* buf,
+                           size_t len) {
+  insert(theta, cityhash64(buf, len));
+}
+
+void cityhash_theta_update_hashes(struct cityhash_theta* theta,
+                                  const uint64_t* hashes, size_t n) {
+
+  size_t i = 0;
+
+  // once theta has dropped almost no block of 8 has a hash below it; the
+  // test is branch free, so the compiler can vectorize it
+  for (; i + 8 <= n; i += 8) {
+
+    uint64_t t = theta->theta;
+    int below = 0;
+
+    for (int j = 0; j < 8; j++)
+      below |= hashes[i + j] < t;
+
+    if (!below)
+      continue;
+
+    for (int j = 0; j < 8; j++)
+      insert(theta, hashes[i + j]);
+  }
+
+  for (; i < n; i++)
+    insert(theta, hashes[i]);
+}
+
+double cityhash_theta_estimate(const struct cityhash_theta* theta) {
+  return theta->count / cityhash_theta_fraction(theta);
+}
+
+size_t cityhash_theta_retained(const struct cityhash_theta* theta) {
+  return theta->count;
+}
+
+double cityhash_theta_fraction(const struct cityhash_theta* theta) {
+  return theta->theta == KEXACT ? 1.0 : theta->theta * 0x1p-64;
+}
+
+static int compare(const void* a, const void* b) {
+
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+enum set_op { OP_UNION, OP_INTERSECT, OP_DIFFERENCE };
+
+// merges the sorted hashes of a and b below the smaller theta into out, and
+// cuts it back to its own k
+static int combine(struct cityhash_theta* out, const struct cityhash_theta* a,
+                   const struct cityhash_theta* b, enum set_op op) {
+
+  struct cityhash_allocator al = out->allocator;
+  size_t bytes = (a->count + b->count) * sizeof(uint64_t);
+  uint64_t* ha = al.alloc(al.ctx, bytes > 0 ? bytes : 1);
+
+  if (ha == NULL)
+    return -1;
+
+  uint64_t theta = a->theta < b->theta ? a->theta : b->theta;
+  uint64_t* hb = ha + a->count;
+  size_t na = gather(a, ha);
+  size_t nb = gather(b, hb);
+  size_t i = 0;
+  size_t j = 0;
+
+  qsort(ha, na, sizeof(uint64_t), compare);
+  qsort(hb, nb, sizeof(uint64_t), compare);
+
+  // a and b are copied, so out may be either of them
+  cityhash_theta_reset(out);
+  out->theta = theta;
+
+  while (i < na && ha[i] < theta) {
+
+    while (j < nb && hb[j] < ha[i]) {
+      if (op == OP_UNION)
+        insert(out, hb[j]);
+      j++;
+    }
+
+    int both = j < nb && hb[j] == ha[i];
+
+    if (op == OP_UNION || (op == OP_INTERSECT) == both)
+      insert(out, ha[i]);
+
+    j += both;
+    i++;
+  }
+
+  for (; op == OP_UNION && j < nb; j++)
+    insert(out, hb[j]);
+
+  al.free(al.ctx, ha, bytes > 0 ? bytes : 1);
+
+  // a union of two full sketches holds up to 2k hashes below theta
+  if (out->count > out->k)
+    cut(out);
+
+  return 0;
+}
+
+int cityhash_theta_union(struct cityhash_theta* out,
+                         const struct cityhash_theta* a,
+                         const struct cityhash_theta* b) {
+  return combine(out, a, b, OP_UNION);
+}
+
+int cityhash_theta_intersect(struct cityhash_theta* out,
+                             const struct cityhash_theta* a,
+                             const struct cityhash_theta* b) {
+  return combine(out, a, b, OP_INTERSECT);
+}
+
+int cityhash_theta_difference(struct cityhash_theta* out,
+                              const struct cityhash_theta* a,
+                              const struct cityhash_theta* b) {
+  return combine(out, a, b, OP_DIFFERENCE);
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get64(const uint8_t* p) {
+
+  uint64_t v = 0;
+
+  for (int i = 0; i < 8; i++)
+    v |= (uint64_t)p[i] << (8 * i);
+
+  return v;
+}
+
+size_t cityhash_theta_bytes(const struct cityhash_theta* theta) {
+  return KHEADER +
+         (theta->count < theta->k ? theta->count : theta->k) * sizeof(uint64_t);
+}
+
+void cityhash_theta_serialize(struct cityhash_theta* theta, uint8_t* out) {
+
+  if (theta->count > theta->k)
+    cut(theta);
+
+  size_t n = gather(theta, theta->hashes);
+
+  qsort(theta->hashes, n, sizeof(uint64_t), compare);
+  put64(out, theta->theta);
+  put64(out + 8, theta->k);
+  put64(out + 16, n);
+
+  for (size_t i = 0; i < n; i++)
+    put64(out + KHEADER + 8 * i, theta->hashes[i]);
+}
+
+struct cityhash_theta* cityhash_theta_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator) {
+
+  if (len < KHEADER)
+    return NULL;
+
+  uint64_t theta = get64(buf);
+  uint64_t k = get64(buf + 8);
+  uint64_t n = get64(buf + 16);
+
+  // a k from the buffer is not trusted to size the allocation, and a theta
+  // of 0 would make every estimate 0 / 0
+  if (k == 0 || k > CITYHASH_THETA_MAX_K || theta == 0 || n > k ||
+      n != (len - KHEADER) / 8 || (len - KHEADER) % 8 != 0)
+    return NULL;
+
+  struct cityhash_theta* t = cityhash_theta_create(k, allocator);
+
+  if (t == NULL)
+    return NULL;
+
+  t->theta = theta;
+
+  uint64_t prev = 0;
+
+  // ascending, distinct and below theta, or it was not written by us
+  for (size_t i = 0; i < n; i++) {
+
+    uint64_t h = get64(buf + KHEADER + 8 * i);
+
+    if (h <= prev || h >= theta) {
+      cityhash_theta_destroy(t);
+      return NULL;
+    }
+
+    insert(t, h);
+    prev = h;
+  }
+
+  return t;
+}
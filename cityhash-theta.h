@@ -0,0 +1,107 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//
+//
+// Theta sketches (k minimum values over cityhash64) for distinct counts
+// that, unlike HyperLogLog, can be intersected and subtracted.  A sketch
+// keeps the hashes below a threshold theta, at least k of them once it has
+// seen more than k distinct keys, and estimates the distinct count as their
+// number over theta / 2^64, with a relative standard error of about
+// 1 / sqrt(k).  Once theta has dropped, almost every update is rejected by
+// a single comparison; the hashes below it sit in an open addressing table
+// that is cut back to the k smallest with a quickselect whenever it reaches
+// 2k entries.  Union, intersection and difference take the smaller theta of
+// their inputs and combine the hashes below it, so their results estimate
+// |A u B|, |A n B| and |A \ B| and can be combined further.  A sketch is not
+// thread-safe; build one per thread and take their union.
+
+#ifndef CITYHASH_THETA_H
+#define CITYHASH_THETA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cityhash-arena.h"
+#include "cityhash.h"
+
+// nominal entries when the caller has no preference, about 1.6% error
+#define CITYHASH_THETA_K (4096)
+
+// largest k a sketch can have, about 48 MiB and 0.1% error
+#define CITYHASH_THETA_MAX_K (1 << 20)
+
+struct cityhash_theta;
+
+// a sketch of k nominal entries (0 for CITYHASH_THETA_K), taking about 48k
+// bytes; allocator may be NULL for the heap; NULL if k is above
+// CITYHASH_THETA_MAX_K or the memory cannot be allocated
+struct cityhash_theta* cityhash_theta_create(
+    size_t k, const struct cityhash_allocator* allocator);
+
+void cityhash_theta_destroy(struct cityhash_theta* theta);
+
+// forgets every update
+void cityhash_theta_reset(struct cityhash_theta* theta);
+
+// adds the key of len bytes at buf
+void cityhash_theta_update(struct cityhash_theta* theta, const uint8_t* buf,
+                           size_t len);
+
+// adds n keys given by their cityhash64() values, e.g. from
+// cityhash64_batch() or a column of stored hashes
+void cityhash_theta_update_hashes(struct cityhash_theta* theta,
+                                  const uint64_t* hashes, size_t n);
+
+// the estimated number of distinct keys
+double cityhash_theta_estimate(const struct cityhash_theta* theta);
+
+// hashes retained, and the threshold as a fraction of the hash space (1.0
+// while the sketch is still exact)
+size_t cityhash_theta_retained(const struct cityhash_theta* theta);
+double cityhash_theta_fraction(const struct cityhash_theta* theta);
+
+// out = a u b, a n b and a \ b; out may be a or b, and is cut back to its
+// own k; -1 if temporary memory cannot be allocated
+int cityhash_theta_union(struct cityhash_theta* out,
+                         const struct cityhash_theta* a,
+                         const struct cityhash_theta* b);
+int cityhash_theta_intersect(struct cityhash_theta* out,
+                             const struct cityhash_theta* a,
+                             const struct cityhash_theta* b);
+int cityhash_theta_difference(struct cityhash_theta* out,
+                              const struct cityhash_theta* a,
+                              const struct cityhash_theta* b);
+
+// bytes cityhash_theta_serialize() writes, at most 24 + 8k
+size_t cityhash_theta_bytes(const struct cityhash_theta* theta);
+
+// cuts the sketch back to its k smallest hashes and writes theta, k and
+// the hashes in ascending order (little endian) to out
+void cityhash_theta_serialize(struct cityhash_theta* theta, uint8_t* out);
+
+// a sketch from len bytes of cityhash_theta_serialize(); NULL if they are
+// malformed, give a k above CITYHASH_THETA_MAX_K or a theta of 0, or the
+// memory cannot be allocated
+struct cityhash_theta* cityhash_theta_deserialize(
+    const uint8_t* buf, size_t len,
+    const struct cityhash_allocator* allocator);
+
+#endif // CITYHASH_THETA_H
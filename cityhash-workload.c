@@ -0,0 +1,1037 @@
+// Copyright (c) 2011 Google, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// YCSB-like workload driver for hash tables keyed by cityhash.
+//
+// A keyspace of 2 * records keys is generated up front; key lengths are
+// fixed, uniform over a range, or sampled from a trace file with one length
+// per line.  The load phase inserts the first records keys, then every
+// thread runs its share of ops operations: reads and deletes pick a key of
+// the loaded range through a uniform or scrambled Zipfian distribution,
+// inserts pick one of the other keys.  The same run is repeated for every
+// thread count given with -T.
+//
+// Two table designs are provided, both sharded by the top bits of the hash
+// with one spinlock per shard:
+//
+//   linear   open addressing with linear probing and tombstones
+//   chained  separate chaining with one malloc'd node per key
+//
+// Reported are ops/sec, p50/p99/p99.9 operation latency, table bytes per live
+// key and LLC misses per operation (when perf counters are available).
+//
+// usage: cityhash_workload [-t linear|chained] [-H 64|32] [-d uniform|zipf]
+//                          [-z theta] [-r records] [-o ops] [-m read,ins,del]
+//                          [-l len | -l lo-hi | -l @trace] [-T 1,2,4]
+//                          [-j out.json] [-c out.csv]
+
+#if defined(BENCHMARKING)
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cityhash-bench-util.h"
+#include "cityhash-histogram.h"
+#include "cityhash-perf.h"
+#include "cityhash.h"
+
+#define KRECORDS (1000000)
+#define KOPS (4000000)
+#define KSHARD_BITS (8)
+#define KSHARDS (1 << KSHARD_BITS)
+#define KMAX_THREADS (256)
+#define KMAX_RUNS (32)
+
+enum op_type { OP_READ = 0, OP_INSERT, OP_DELETE };
+
+static double uniform01(uint64_t* state) {
+  return (splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t now_ticks() {
+#if defined(HAVE_TSC)
+  return __rdtsc();
+#else
+  return (uint64_t)wall_ns();
+#endif
+}
+
+// keys
+
+struct keyspace {
+  uint8_t* data;
+  uint64_t* offset;
+  uint32_t* len;
+  uint64_t n;
+};
+
+struct length_dist {
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t* trace;
+  size_t ntrace;
+};
+
+static int parse_lengths(const char* arg, struct length_dist* d) {
+
+  memset(d, 0, sizeof(*d));
+
+  if (arg[0] == '@') {
+
+    FILE* f = fopen(arg + 1, "r");
+    size_t cap = 1024;
+    unsigned long len;
+
+    if (f == NULL) {
+      perror(arg + 1);
+      return -1;
+    }
+
+    d->trace = malloc(cap * sizeof(uint32_t));
+
+    while (fscanf(f, "%lu", &len) == 1) {
+
+      if (d->ntrace == cap) {
+        cap *= 2;
+        d->trace = realloc(d->trace, cap * sizeof(uint32_t));
+      }
+
+      d->trace[d->ntrace++] = (uint32_t)len;
+    }
+
+    fclose(f);
+
+    return d->ntrace > 0 ? 0 : -1;
+  }
+
+  if (sscanf(arg, "%u-%u", &d->lo, &d->hi) == 2)
+    return d->lo <= d->hi ? 0 : -1;
+
+  if (sscanf(arg, "%u", &d->lo) == 1) {
+    d->hi = d->lo;
+    return 0;
+  }
+
+  return -1;
+}
+
+static uint32_t sample_length(const struct length_dist* d, uint64_t* state) {
+
+  if (d->ntrace > 0)
+    return d->trace[splitmix64(state) % d->ntrace];
+
+  return d->lo + (uint32_t)(splitmix64(state) % (d->hi - d->lo + 1));
+}
+
+// random key bytes, distinct keys of equal length differ with overwhelming
+// probability and keys of length < 8 are made distinct by their id
+static void build_keyspace(struct keyspace* ks, uint64_t n,
+                           const struct length_dist* d) {
+
+  uint64_t state = 42;
+  uint64_t total = 0;
+
+  ks->n = n;
+  ks->offset = malloc(n * sizeof(uint64_t));
+  ks->len = malloc(n * sizeof(uint32_t));
+
+  for (uint64_t i = 0; i < n; i++) {
+    ks->len[i] = sample_length(d, &state);
+    ks->offset[i] = total;
+    total += ks->len[i];
+  }
+
+  ks->data = malloc(total + 8);
+
+  for (uint64_t i = 0; i < n; i++) {
+
+    uint8_t* p = ks->data + ks->offset[i];
+
+    for (uint32_t j = 0; j < ks->len[i]; j += 8) {
+      uint64_t x = splitmix64(&state);
+      memcpy(p + j, &x, ks->len[i] - j < 8 ? ks->len[i] - j : 8);
+    }
+
+    if (ks->len[i] > 0 && ks->len[i] < 8) {
+      uint64_t id = i;
+      memcpy(p, &id, ks->len[i]);
+    }
+  }
+}
+
+static void free_keyspace(struct keyspace* ks) {
+  free(ks->data);
+  free(ks->offset);
+  free(ks->len);
+}
+
+// scrambled Zipfian generator of YCSB (Gray et al., "Quickly generating
+// billion-record synthetic databases")
+struct zipf {
+  uint64_t n;
+  double theta;
+  double alpha;
+  double zetan;
+  double eta;
+};
+
+static void zipf_init(struct zipf* z, uint64_t n, double theta) {
+
+  double zeta2 = 1.0 + pow(0.5, theta);
+
+  z->n = n;
+  z->theta = theta;
+  z->zetan = 0;
+
+  for (uint64_t i = 1; i <= n; i++)
+    z->zetan += 1.0 / pow((double)i, theta);
+
+  z->alpha = 1.0 / (1.0 - theta);
+  z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(const struct zipf* z, uint64_t* state) {
+
+  double u = uniform01(state);
+  double uz = u * z->zetan;
+  uint64_t rank;
+
+  if (uz < 1.0)
+    rank = 0;
+  else if (uz < 1.0 + pow(0.5, z->theta))
+    rank = 1;
+  else
+    rank = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+
+  if (rank >= z->n)
+    rank = z->n - 1;
+
+  // spread the popular ranks over the keyspace
+  uint64_t s = rank;
+
+  return splitmix64(&s) % z->n;
+}
+
+// tables
+
+struct table_ops {
+  const char* name;
+  void* (*create)(uint64_t expected);
+  void (*destroy)(void* t);
+  int (*find)(void* t, uint64_t h, const uint8_t* key, uint32_t len);
+  int (*insert)(void* t, uint64_t h, const uint8_t* key, uint32_t len);
+  int (*erase)(void* t, uint64_t h, const uint8_t* key, uint32_t len);
+  size_t (*bytes)(void* t);
+};
+
+// linear probing
+
+#define SLOT_EMPTY 0
+#define SLOT_FULL 1
+#define SLOT_DELETED 2
+
+struct slot {
+  uint64_t hash;
+  const uint8_t* key;
+  uint32_t len;
+  uint32_t state;
+};
+
+struct linear_shard {
+  pthread_spinlock_t lock;
+  struct slot* slots;
+  size_t capacity;
+  size_t count;
+  size_t deleted;
+} __attribute__((aligned(64)));
+
+struct linear_table {
+  struct linear_shard shards[KSHARDS];
+};
+
+static size_t round_pow2(size_t x) {
+
+  size_t p = 16;
+
+  while (p < x)
+    p <<= 1;
+
+  return p;
+}
+
+static void* linear_create(uint64_t expected) {
+
+  struct linear_table* t;
+  size_t cap = round_pow2(expected * 2 / KSHARDS);
+
+  if (posix_memalign((void**)&t, 64, sizeof(*t)) != 0)
+    return NULL;
+
+  for (int i = 0; i < KSHARDS; i++) {
+    pthread_spin_init(&t->shards[i].lock, PTHREAD_PROCESS_PRIVATE);
+    t->shards[i].slots = calloc(cap, sizeof(struct slot));
+    t->shards[i].capacity = cap;
+    t->shards[i].count = 0;
+    t->shards[i].deleted = 0;
+  }
+
+  return t;
+}
+
+static void linear_destroy(void* p) {
+
+  struct linear_table* t = p;
+
+  for (int i = 0; i < KSHARDS; i++) {
+    pthread_spin_destroy(&t->shards[i].lock);
+    free(t->shards[i].slots);
+  }
+
+  free(t);
+}
+
+static struct linear_shard* linear_shard(struct linear_table* t, uint64_t h) {
+  return &t->shards[h >> (64 - KSHARD_BITS)];
+}
+
+static int key_equal(const struct slot* s, uint64_t h, const uint8_t* key,
+                     uint32_t len) {
+  return s->hash == h && s->len == len && memcmp(s->key, key, len) == 0;
+}
+
+// slot holding the key, or NULL
+static struct slot* linear_lookup(struct linear_shard* sh, uint64_t h,
+                                  const uint8_t* key, uint32_t len) {
+
+  size_t mask = sh->capacity - 1;
+
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+
+    struct slot* s = &sh->slots[i];
+
+    if (s->state == SLOT_EMPTY)
+      return NULL;
+
+    if (s->state == SLOT_FULL && key_equal(s, h, key, len))
+      return s;
+  }
+}
+
+static void linear_rehash(struct linear_shard* sh, size_t capacity) {
+
+  struct slot* old = sh->slots;
+  size_t old_capacity = sh->capacity;
+  size_t mask = capacity - 1;
+
+  sh->slots = calloc(capacity, sizeof(struct slot));
+  sh->capacity = capacity;
+  sh->deleted = 0;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+
+    if (old[i].state != SLOT_FULL)
+      continue;
+
+    size_t j = old[i].hash & mask;
+
+    while (sh->slots[j].state != SLOT_EMPTY)
+      j = (j + 1) & mask;
+
+    sh->slots[j] = old[i];
+  }
+
+  free(old);
+}
+
+static int linear_find(void* p, uint64_t h, const uint8_t* key, uint32_t len) {
+
+  struct linear_shard* sh = linear_shard(p, h);
+
+  pthread_spin_lock(&sh->lock);
+  int found = linear_lookup(sh, h, key, len) != NULL;
+  pthread_spin_unlock(&sh->lock);
+
+  return found;
+}
+
+static int linear_insert(void* p, uint64_t h, const uint8_t* key,
+                         uint32_t len) {
+
+  struct linear_shard* sh = linear_shard(p, h);
+  int inserted = 0;
+
+  pthread_spin_lock(&sh->lock);
+
+  if (linear_lookup(sh, h, key, len) == NULL) {
+
+    // keep the load, tombstones included, under 3/4
+    if ((sh->count + sh->deleted + 1) * 4 > sh->capacity * 3)
+      linear_rehash(sh, (sh->count + 1) * 2 > sh->capacity ? sh->capacity * 2
+                                                           : sh->capacity);
+
+    size_t mask = sh->capacity - 1;
+    size_t i = h & mask;
+
+    while (sh->slots[i].state == SLOT_FULL)
+      i = (i + 1) & mask;
+
+    if (sh->slots[i].state == SLOT_DELETED)
+      sh->deleted--;
+
+    sh->slots[i].hash = h;
+    sh->slots[i].key = key;
+    sh->slots[i].len = len;
+    sh->slots[i].state = SLOT_FULL;
+    sh->count++;
+    inserted = 1;
+  }
+
+  pthread_spin_unlock(&sh->lock);
+
+  return inserted;
+}
+
+static int linear_erase(void* p, uint64_t h, const uint8_t* key, uint32_t len) {
+
+  struct linear_shard* sh = linear_shard(p, h);
+
+  pthread_spin_lock(&sh->lock);
+
+  struct slot* s = linear_lookup(sh, h, key, len);
+
+  if (s != NULL) {
+    s->state = SLOT_DELETED;
+    sh->count--;
+    sh->deleted++;
+  }
+
+  pthread_spin_unlock(&sh->lock);
+
+  return s != NULL;
+}
+
+static size_t linear_bytes(void* p) {
+
+  struct linear_table* t = p;
+  size_t bytes = sizeof(*t);
+
+  for (int i = 0; i < KSHARDS; i++)
+    bytes += t->shards[i].capacity * sizeof(struct slot);
+
+  return bytes;
+}
+
+// separate chaining
+
+struct node {
+  struct node* next;
+  uint64_t hash;
+  const uint8_t* key;
+  uint32_t len;
+};
+
+struct chained_shard {
+  pthread_spinlock_t lock;
+  struct node** buckets;
+  size_t nbuckets;
+  size_t count;
+} __attribute__((aligned(64)));
+
+struct chained_table {
+  struct chained_shard shards[KSHARDS];
+};
+
+static void* chained_create(uint64_t expected) {
+
+  struct chained_table* t;
+  size_t n = round_pow2(expected / KSHARDS);
+
+  if (posix_memalign((void**)&t, 64, sizeof(*t)) != 0)
+    return NULL;
+
+  for (int i = 0; i < KSHARDS; i++) {
+    pthread_spin_init(&t->shards[i].lock, PTHREAD_PROCESS_PRIVATE);
+    t->shards[i].buckets = calloc(n, sizeof(struct node*));
+    t->shards[i].nbuckets = n;
+    t->shards[i].count = 0;
+  }
+
+  return t;
+}
+
+static void chained_destroy(void* p) {
+
+  struct chained_table* t = p;
+
+  for (int i = 0; i < KSHARDS; i++) {
+
+    struct chained_shard* sh = &t->shards[i];
+
+    for (size_t b = 0; b < sh->nbuckets; b++) {
+      for (struct node *n = sh->buckets[b], *next; n != NULL; n = next) {
+        next = n->next;
+        free(n);
+      }
+    }
+
+    pthread_spin_destroy(&sh->lock);
+    free(sh->buckets);
+  }
+
+  free(t);
+}
+
+static struct chained_shard* chained_shard(struct chained_table* t,
+                                           uint64_t h) {
+  return &t->shards[h >> (64 - KSHARD_BITS)];
+}
+
+// link pointing at the node holding the key, or at the terminating NULL
+static struct node** chained_lookup(struct chained_shard* sh, uint64_t h,
+                                    const uint8_t* key, uint32_t len) {
+
+  struct node** link = &sh->buckets[h & (sh->nbuckets - 1)];
+
+  while (*link != NULL) {
+
+    struct node* n = *link;
+
+    if (n->hash == h && n->len == len && memcmp(n->key, key, len) == 0)
+      break;
+
+    link = &n->next;
+  }
+
+  return link;
+}
+
+static void chained_grow(struct chained_shard* sh) {
+
+  size_t n = sh->nbuckets * 2;
+  struct node** buckets = calloc(n, sizeof(struct node*));
+
+  for (size_t b = 0; b < sh->nbuckets; b++) {
+    for (struct node *e = sh->buckets[b], *next; e != NULL; e = next) {
+      next = e->next;
+      e->next = buckets[e->hash & (n - 1)];
+      buckets[e->hash & (n - 1)] = e;
+    }
+  }
+
+  free(sh->buckets);
+  sh->buckets = buckets;
+  sh->nbuckets = n;
+}
+
+static int chained_find(void* p, uint64_t h, const uint8_t* key,
+                        uint32_t len) {
+
+  struct chained_shard* sh = chained_shard(p, h);
+
+  pthread_spin_lock(&sh->lock);
+  int found = *chained_lookup(sh, h, key, len) != NULL;
+  pthread_spin_unlock(&sh->lock);
+
+  return found;
+}
+
+static int chained_insert(void* p, uint64_t h, const uint8_t* key,
+                          uint32_t len) {
+
+  struct chained_shard* sh = chained_shard(p, h);
+  int inserted = 0;
+
+  pthread_spin_lock(&sh->lock);
+
+  struct node** link = chained_lookup(sh, h, key, len);
+
+  if (*link == NULL) {
+
+    struct node* n = malloc(sizeof(struct node));
+
+    n->next = NULL;
+    n->hash = h;
+    n->key = key;
+    n->len = len;
+    *link = n;
+    inserted = 1;
+
+    if (++sh->count > sh->nbuckets)
+      chained_grow(sh);
+  }
+
+  pthread_spin_unlock(&sh->lock);
+
+  return inserted;
+}
+
+static int chained_erase(void* p, uint64_t h, const uint8_t* key,
+                         uint32_t len) {
+
+  struct chained_shard* sh = chained_shard(p, h);
+  struct node* n;
+
+  pthread_spin_lock(&sh->lock);
+
+  struct node** link = chained_lookup(sh, h, key, len);
+
+  if ((n = *link) != NULL) {
+    *link = n->next;
+    sh->count--;
+  }
+
+  pthread_spin_unlock(&sh->lock);
+
+  free(n);
+
+  return n != NULL;
+}
+
+static size_t chained_bytes(void* p) {
+
+  struct chained_table* t = p;
+  size_t bytes = sizeof(*t);
+
+  for (int i = 0; i < KSHARDS; i++) {
+    bytes += t->shards[i].nbuckets * sizeof(struct node*);
+    bytes += t->shards[i].count * sizeof(struct node);
+  }
+
+  return bytes;
+}
+
+static const struct table_ops tables[] = {
+    {"linear", linear_create, linear_destroy, linear_find, linear_insert,
+     linear_erase, linear_bytes},
+    {"chained", chained_create, chained_destroy, chained_find, chained_insert,
+     chained_erase, chained_bytes},
+};
+
+// workload
+
+struct workload {
+  const struct table_ops* table;
+  int hash_bits;
+  int zipfian;
+  double theta;
+  uint64_t records;
+  uint64_t ops;
+  int mix[3];
+};
+
+// the 32-bit hash is spread over the shard and slot bits the same way a
+// 32-bit table would use it
+static uint64_t key_hash(int bits, const uint8_t* key, uint32_t len) {
+
+  if (bits == 32) {
+    uint64_t h = cityhash32(key, len);
+    return h << 32 | h;
+  }
+
+  return cityhash64(key, len);
+}
+
+struct worker {
+  pthread_t thread;
+  const struct workload* w;
+  const struct keyspace* ks;
+  const struct zipf* zipf;
+  pthread_barrier_t* barrier;
+  void* table;
+  int id;
+  uint64_t ops;
+  uint64_t hits[3];
+  struct histogram hist;
+  struct perf_sample perf;
+  int perf_ok;
+};
+
+static uint64_t pick_key(const struct workload* w, const struct zipf* z,
+                         uint64_t* state) {
+
+  if (w->zipfian)
+    return zipf_next(z, state);
+
+  return splitmix64(state) % w->records;
+}
+
+static void* worker_main(void* p) {
+
+  struct worker* wk = p;
+  const struct workload* w = wk->w;
+  const struct keyspace* ks = wk->ks;
+  struct perf_counters pc;
+  uint64_t state = 0x1234567ULL * (wk->id + 1);
+  uint64_t hits[3] = {0, 0, 0};
+
+  histogram_init(&wk->hist);
+  wk->perf_ok = perf_counters_open(&pc) > 0;
+
+  pthread_barrier_wait(wk->barrier);
+  perf_counters_start(&pc);
+
+  for (uint64_t i = 0; i < wk->ops; i++) {
+
+    int r = (int)(splitmix64(&state) % 100);
+    enum op_type op = r < w->mix[OP_READ]                     ? OP_READ
+                      : r < w->mix[OP_READ] + w->mix[OP_INSERT] ? OP_INSERT
+                                                                : OP_DELETE;
+    uint64_t id = op == OP_INSERT
+                      ? w->records + splitmix64(&state) % (ks->n - w->records)
+                      : pick_key(w, wk->zipf, &state);
+    const uint8_t* key = ks->data + ks->offset[id];
+    uint32_t len = ks->len[id];
+    uint64_t t0 = now_ticks();
+    uint64_t h = key_hash(w->hash_bits, key, len);
+
+    switch (op) {
+    case OP_READ:
+      hits[op] += w->table->find(wk->table, h, key, len);
+      break;
+    case OP_INSERT:
+      hits[op] += w->table->insert(wk->table, h, key, len);
+      break;
+    case OP_DELETE:
+      hits[op] += w->table->erase(wk->table, h, key, len);
+      break;
+    }
+
+    histogram_record(&wk->hist, now_ticks() - t0);
+  }
+
+  perf_counters_stop(&pc, &wk->perf);
+  perf_counters_close(&pc);
+  pthread_barrier_wait(wk->barrier);
+
+  memcpy(wk->hits, hits, sizeof(hits));
+
+  return NULL;
+}
+
+struct run_result {
+  int threads;
+  double seconds;
+  uint64_t ops;
+  uint64_t read_hits;
+  double bytes_per_key;
+  uint64_t live_keys;
+  double llc_per_op;
+  struct histogram hist;
+};
+
+static void run(const struct workload* w, const struct keyspace* ks,
+                const struct zipf* z, int nthreads, struct run_result* out) {
+
+  void* table = w->table->create(w->records);
+  struct worker* workers = calloc(nthreads, sizeof(struct worker));
+  pthread_barrier_t barrier;
+  uint64_t live = 0;
+  uint64_t llc = 0;
+  int llc_ok = 1;
+
+  // load phase
+  for (uint64_t i = 0; i < w->records; i++) {
+
+    const uint8_t* key = ks->data + ks->offset[i];
+
+    live += w->table->insert(table, key_hash(w->hash_bits, key, ks->len[i]),
+                             key, ks->len[i]);
+  }
+
+  pthread_barrier_init(&barrier, NULL, nthreads + 1);
+
+  for (int t = 0; t < nthreads; t++) {
+    workers[t].w = w;
+    workers[t].ks = ks;
+    workers[t].zipf = z;
+    workers[t].barrier = &barrier;
+    workers[t].table = table;
+    workers[t].id = t;
+    workers[t].ops = w->ops / nthreads + (t < (int)(w->ops % nthreads));
+    pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+  }
+
+  pthread_barrier_wait(&barrier);
+  double t0 = wall_ns();
+  pthread_barrier_wait(&barrier);
+  double t1 = wall_ns();
+
+  histogram_init(&out->hist);
+  out->read_hits = 0;
+
+  for (int t = 0; t < nthreads; t++) {
+
+    pthread_join(workers[t].thread, NULL);
+    histogram_merge(&out->hist, &workers[t].hist);
+    out->read_hits += workers[t].hits[OP_READ];
+    live += workers[t].hits[OP_INSERT];
+    live -= workers[t].hits[OP_DELETE];
+
+    if (workers[t].perf_ok && workers[t].perf.valid[PERF_LLC_MISSES])
+      llc += workers[t].perf.value[PERF_LLC_MISSES];
+    else
+      llc_ok = 0;
+  }
+
+  // table memory only, the key bytes themselves are not counted
+  size_t bytes = w->table->bytes(table);
+
+  out->threads = nthreads;
+  out->seconds = (t1 - t0) / 1e9;
+  out->ops = w->ops;
+  out->live_keys = live;
+  out->bytes_per_key = live > 0 ? (double)bytes / live : 0.0;
+  out->llc_per_op = llc_ok ? (double)llc / w->ops : -1.0;
+
+  pthread_barrier_destroy(&barrier);
+  free(workers);
+  w->table->destroy(table);
+}
+
+static void write_csv(const char* path, const struct workload* w,
+                      const struct run_result* r, int n, double rate) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f, "table,hash,dist,threads,ops,seconds,ops_per_s,p50_ns,p99_ns,"
+             "p99_9_ns,live_keys,bytes_per_key,llc_per_op\n");
+
+  for (int i = 0; i < n; i++) {
+    fprintf(f, "%s,cityhash%d,%s,%d,%llu,%.4f,%.1f,%.1f,%.1f,%.1f,%llu,%.2f,",
+            w->table->name, w->hash_bits, w->zipfian ? "zipf" : "uniform",
+            r[i].threads, (unsigned long long)r[i].ops, r[i].seconds,
+            r[i].ops / r[i].seconds,
+            histogram_percentile(&r[i].hist, 50.0) / rate,
+            histogram_percentile(&r[i].hist, 99.0) / rate,
+            histogram_percentile(&r[i].hist, 99.9) / rate,
+            (unsigned long long)r[i].live_keys, r[i].bytes_per_key);
+
+    if (r[i].llc_per_op >= 0)
+      fprintf(f, "%.4f\n", r[i].llc_per_op);
+    else
+      fprintf(f, "\n");
+  }
+
+  fclose(f);
+}
+
+static void write_json(const char* path, const struct workload* w,
+                       const struct run_result* r, int n, double rate) {
+
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+
+  fprintf(f,
+          "{\n  \"table\": \"%s\",\n  \"hash\": \"cityhash%d\",\n"
+          "  \"dist\": \"%s\",\n  \"theta\": %.3f,\n  \"records\": %llu,\n"
+          "  \"mix\": [%d, %d, %d],\n  \"results\": [\n",
+          w->table->name, w->hash_bits, w->zipfian ? "zipf" : "uniform",
+          w->theta, (unsigned long long)w->records, w->mix[OP_READ],
+          w->mix[OP_INSERT], w->mix[OP_DELETE]);
+
+  for (int i = 0; i < n; i++) {
+
+    fprintf(f,
+            "    {\"threads\": %d, \"ops\": %llu, \"seconds\": %.4f, "
+            "\"ops_per_s\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, "
+            "\"p99_9_ns\": %.1f, \"live_keys\": %llu, "
+            "\"bytes_per_key\": %.2f, ",
+            r[i].threads, (unsigned long long)r[i].ops, r[i].seconds,
+            r[i].ops / r[i].seconds,
+            histogram_percentile(&r[i].hist, 50.0) / rate,
+            histogram_percentile(&r[i].hist, 99.0) / rate,
+            histogram_percentile(&r[i].hist, 99.9) / rate,
+            (unsigned long long)r[i].live_keys, r[i].bytes_per_key);
+
+    if (r[i].llc_per_op >= 0)
+      fprintf(f, "\"llc_per_op\": %.4f}", r[i].llc_per_op);
+    else
+      fprintf(f, "\"llc_per_op\": null}");
+
+    fprintf(f, "%s\n", i + 1 < n ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static void usage(const char* prog) {
+
+  fprintf(stderr,
+          "usage: %s [-t linear|chained] [-H 64|32] [-d uniform|zipf]\n"
+          "       [-z theta] [-r records] [-o ops] [-m read,ins,del]\n"
+          "       [-l len | -l lo-hi | -l @trace] [-T 1,2,4]\n"
+          "       [-j out.json] [-c out.csv]\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+
+  struct workload w = {&tables[0], 64, 0, 0.99, KRECORDS, KOPS, {90, 5, 5}};
+  struct length_dist lengths = {16, 16, NULL, 0};
+  const char* threads_arg = "1";
+  const char* json_path = NULL;
+  const char* csv_path = NULL;
+  int threads[KMAX_RUNS];
+  int nruns = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:H:d:z:r:o:m:l:T:j:c:h")) != -1) {
+    switch (opt) {
+    case 't':
+      w.table = NULL;
+      for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+        if (strcmp(optarg, tables[i].name) == 0)
+          w.table = &tables[i];
+      }
+      if (w.table == NULL) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'H':
+      w.hash_bits = atoi(optarg) == 32 ? 32 : 64;
+      break;
+    case 'd':
+      w.zipfian = strcmp(optarg, "zipf") == 0;
+      break;
+    case 'z':
+      w.theta = atof(optarg);
+      break;
+    case 'r':
+      w.records = strtoull(optarg, NULL, 0);
+      break;
+    case 'o':
+      w.ops = strtoull(optarg, NULL, 0);
+      break;
+    case 'm':
+      if (sscanf(optarg, "%d,%d,%d", &w.mix[OP_READ], &w.mix[OP_INSERT],
+                 &w.mix[OP_DELETE]) != 3 ||
+          w.mix[OP_READ] + w.mix[OP_INSERT] + w.mix[OP_DELETE] != 100) {
+        fprintf(stderr, "error: -m needs three percentages adding up to 100\n");
+        return 1;
+      }
+      break;
+    case 'l':
+      if (parse_lengths(optarg, &lengths) != 0) {
+        fprintf(stderr, "error: bad key lengths '%s'\n", optarg);
+        return 1;
+      }
+      break;
+    case 'T':
+      threads_arg = optarg;
+      break;
+    case 'j':
+      json_path = optarg;
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (const char* p = threads_arg; *p != '\0' && nruns < KMAX_RUNS;) {
+
+    char* end;
+    long t = strtol(p, &end, 10);
+
+    if (end == p || t < 1 || t > KMAX_THREADS) {
+      fprintf(stderr, "error: bad thread list '%s'\n", threads_arg);
+      return 1;
+    }
+
+    threads[nruns++] = (int)t;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  if (w.records < 1 || w.theta <= 0 || w.theta >= 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct keyspace ks;
+  struct zipf z;
+  struct run_result* results = calloc(nruns, sizeof(struct run_result));
+  double rate = ticks_per_ns();
+
+  build_keyspace(&ks, w.records * 2, &lengths);
+
+  if (w.zipfian)
+    zipf_init(&z, w.records, w.theta);
+
+  printf("# table %s, cityhash%d, %s keys, %llu records, mix %d/%d/%d\n",
+         w.table->name, w.hash_bits, w.zipfian ? "zipfian" : "uniform",
+         (unsigned long long)w.records, w.mix[OP_READ], w.mix[OP_INSERT],
+         w.mix[OP_DELETE]);
+  printf("%7s %12s %9s %9s %9s %12s %10s %10s\n", "threads", "ops/s", "p50 ns",
+         "p99 ns", "p99.9 ns", "live keys", "bytes/key", "LLC/op");
+
+  for (int i = 0; i < nruns; i++) {
+
+    struct run_result* r = &results[i];
+
+    run(&w, &ks, &z, threads[i], r);
+
+    printf("%7d %12.0f %9.1f %9.1f %9.1f %12llu %10.2f", r->threads,
+           r->ops / r->seconds, histogram_percentile(&r->hist, 50.0) / rate,
+           histogram_percentile(&r->hist, 99.0) / rate,
+           histogram_percentile(&r->hist, 99.9) / rate,
+           (unsigned long long)r->live_keys, r->bytes_per_key);
+
+    if (r->llc_per_op >= 0)
+      printf(" %10.3f\n", r->llc_per_op);
+    else
+      printf(" %10s\n", "n/a");
+
+    fflush(stdout);
+  }
+
+  if (csv_path != NULL)
+    write_csv(csv_path, &w, results, nruns, rate);
+
+  if (json_path != NULL)
+    write_json(json_path, &w, results, nruns, rate);
+
+  free(results);
+  free(lengths.trace);
+  free_keyspace(&ks);
+
+  return 0;
+}
+
+#endif // BENCHMARKING
@@ -30,9 +30,22 @@
 #include <assert.h>
 #include <string.h>
 
+#include "cityhash-stats.h"
 #include "cityhash.h"
 
 #define likely(x) (__builtin_expect(!!(x), 1))
+#define force_inline inline __attribute__((always_inline))
+
+// optional USDT probes for bpftrace/systemtap, a single nop per probe site
+// when no tracer is attached
+#if defined(CITYHASH_USDT)
+#include <sys/sdt.h>
+#define PROBE_ENTRY(fn, s, len) DTRACE_PROBE2(cityhash, fn##_entry, s, len)
+#define PROBE_RETURN(fn, len) DTRACE_PROBE1(cityhash, fn##_return, len)
+#else
+#define PROBE_ENTRY(fn, s, len) ((void)0)
+#define PROBE_RETURN(fn, len) ((void)0)
+#endif
 
 #ifdef WORDS_BIGENDIAN
 #define uint32_t_in_expected_order(x) (bswap32(x))
@@ -87,6 +100,47 @@ static uint32_t fetch32(const uint8_t* p) {
   return uint32_t_in_expected_order(uload32(p));
 }
 
+// ASCII case folding of a loaded word, 'A'..'Z' gaining 0x20 in all lanes
+// of the word at once; the hash bodies take a fold flag and read the key
+// through the loads below, every caller passes a constant, so each body is
+// specialized into a plain and a case-insensitive copy that hashes what the
+// plain one would hash for a lowercased key
+static inline uint64_t fold64(uint64_t w) {
+
+  const uint64_t ones = 0x0101010101010101ULL;
+  uint64_t low7 = w & (0x7f * ones);
+  uint64_t ge_a = low7 + (0x80 - 'A') * ones;
+  uint64_t gt_z = low7 + (0x7f - 'Z') * ones;
+
+  return w | (((ge_a ^ gt_z) & ~w & (0x80 * ones)) >> 2);
+}
+
+static inline uint32_t fold32(uint32_t w) {
+
+  const uint32_t ones = 0x01010101;
+  uint32_t low7 = w & (0x7f * ones);
+  uint32_t ge_a = low7 + (0x80 - 'A') * ones;
+  uint32_t gt_z = low7 + (0x7f - 'Z') * ones;
+
+  return w | (((ge_a ^ gt_z) & ~w & (0x80 * ones)) >> 2);
+}
+
+static inline uint8_t fold8(uint8_t c) {
+  return (uint8_t)(c - 'A') < 26 ? c | 0x20 : c;
+}
+
+static inline uint64_t load64(const uint8_t* p, int fold) {
+  return fold ? fold64(fetch64(p)) : fetch64(p);
+}
+
+static inline uint32_t load32(const uint8_t* p, int fold) {
+  return fold ? fold32(fetch32(p)) : fetch32(p);
+}
+
+static inline uint8_t load8(const uint8_t* p, int fold) {
+  return fold ? fold8(*p) : *p;
+}
+
 static uint32_t bswap32(const uint32_t x) {
 
   uint32_t y = x;
@@ -177,27 +231,29 @@ static uint32_t mur(uint32_t a, uint32_t h) {
   return h * 5 + 0xe6546b64;
 }
 
-static uint32_t hash32_13_to_24(const uint8_t* s, size_t len) {
+static force_inline uint32_t hash32_13_to_24(const uint8_t* s, size_t len,
+                                             int fold) {
 
-  uint32_t a = fetch32(s - 4 + (len >> 1));
-  uint32_t b = fetch32(s + 4);
-  uint32_t c = fetch32(s + len - 8);
-  uint32_t d = fetch32(s + (len >> 1));
-  uint32_t e = fetch32(s);
-  uint32_t f = fetch32(s + len - 4);
+  uint32_t a = load32(s - 4 + (len >> 1), fold);
+  uint32_t b = load32(s + 4, fold);
+  uint32_t c = load32(s + len - 8, fold);
+  uint32_t d = load32(s + (len >> 1), fold);
+  uint32_t e = load32(s, fold);
+  uint32_t f = load32(s + len - 4, fold);
   uint32_t h = len;
 
   return fmix(mur(f, mur(e, mur(d, mur(c, mur(b, mur(a, h)))))));
 }
 
-static uint32_t hash32_0_to_4(const uint8_t* s, size_t len) {
+static force_inline uint32_t hash32_0_to_4(const uint8_t* s, size_t len,
+                                           int fold) {
 
   uint32_t b = 0;
   uint32_t c = 9;
 
   for (size_t i = 0; i < len; i++) {
 
-    int8_t v = (int8_t)s[i];
+    int8_t v = (int8_t)load8(s + i, fold);
 
     b = b * c1 + v;
     c ^= b;
@@ -206,33 +262,124 @@ static uint32_t hash32_0_to_4(const uint8_t* s, size_t len) {
   return fmix(mur(b, mur(len, c)));
 }
 
-static uint32_t hash32_5_to_12(const uint8_t* s, size_t len) {
+static force_inline uint32_t hash32_5_to_12(const uint8_t* s, size_t len,
+                                            int fold) {
 
   uint32_t a = len, b = len * 5, c = 9, d = b;
 
-  a += fetch32(s);
-  b += fetch32(s + len - 4);
-  c += fetch32(s + ((len >> 1) & 4));
+  a += load32(s, fold);
+  b += load32(s + len - 4, fold);
+  c += load32(s + ((len >> 1) & 4), fold);
 
   return fmix(mur(c, mur(b, mur(a, d))));
 }
 
-uint32_t cityhash32(const uint8_t* s, size_t len) {
+// with CITYHASH_BRANCHLESS, short keys do not walk the if ladders of
+// cityhash64() and cityhash32(): every length case is computed and the one
+// that matches len is selected with masks, so a random mix of lengths no
+// longer mispredicts; a case that does not apply reads no_key instead of
+// past the end of a shorter key, and its result is discarded
+#if defined(CITYHASH_BRANCHLESS)
+
+static const uint8_t no_key[64];
+
+static inline uint64_t select64(int cond, uint64_t a, uint64_t b) {
+
+  uint64_t m = -(uint64_t)(cond != 0);
+
+  return (a & m) | (b & ~m);
+}
+
+static inline uint32_t select32(int cond, uint32_t a, uint32_t b) {
+
+  uint32_t m = -(uint32_t)(cond != 0);
+
+  return (a & m) | (b & ~m);
+}
+
+// s if len >= min, no_key otherwise
+static inline const uint8_t* case_key(const uint8_t* s, size_t len,
+                                      size_t min) {
+
+  uintptr_t m = -(uintptr_t)(len >= min);
+
+  return (const uint8_t*)(((uintptr_t)s & m) | ((uintptr_t)no_key & ~m));
+}
+
+// len if len >= min, min otherwise
+static inline size_t case_len(size_t len, size_t min) {
+  return select64(len >= min, len, min);
+}
+
+// hash32_0_to_4(), hash32_5_to_12() and hash32_13_to_24() all end in
+// fmix(mur(p, mur(q, r))), their inputs are selected and mixed once
+static uint32_t select_hash32_0_to_24(const uint8_t* s, size_t len) {
+
+  // hash32_0_to_4(), every prefix of the byte loop, then the one for len
+  uint32_t bs[5] = {0};
+  uint32_t cs[5] = {9};
+
+  for (size_t i = 0; i < 4; i++) {
+
+    int8_t v = (int8_t)case_key(s + i, len, i + 1)[0];
+
+    bs[i + 1] = bs[i] * c1 + v;
+    cs[i + 1] = cs[i] ^ bs[i + 1];
+  }
+
+  uint32_t p = bs[len <= 4 ? len : 4];
+  uint32_t q = len;
+  uint32_t r = cs[len <= 4 ? len : 4];
+
+  // hash32_5_to_12()
+  const uint8_t* s5 = case_key(s, len, 5);
+  uint32_t l5 = case_len(len, 5);
+  uint32_t p5 = 9 + fetch32(s5 + ((l5 >> 1) & 4));
+  uint32_t q5 = l5 * 5 + fetch32(s5 + l5 - 4);
+  uint32_t r5 = mur(l5 + fetch32(s5), l5 * 5);
+
+  // hash32_13_to_24()
+  const uint8_t* s13 = case_key(s, len, 13);
+  uint32_t l13 = case_len(len, 13);
+  uint32_t a13 = fetch32(s13 + (l13 >> 1) - 4);
+  uint32_t b13 = fetch32(s13 + 4);
+  uint32_t c13 = fetch32(s13 + l13 - 8);
+  uint32_t d13 = fetch32(s13 + (l13 >> 1));
+  uint32_t p13 = fetch32(s13 + l13 - 4);
+  uint32_t q13 = fetch32(s13);
+  uint32_t r13 = mur(d13, mur(c13, mur(b13, mur(a13, l13))));
+
+  p = select32(len >= 13, p13, select32(len >= 5, p5, p));
+  q = select32(len >= 13, q13, select32(len >= 5, q5, q));
+  r = select32(len >= 13, r13, select32(len >= 5, r5, r));
+
+  return fmix(mur(p, mur(q, r)));
+}
+
+#endif
+
+static force_inline uint32_t city_hash32_body(const uint8_t* s, size_t len,
+                                              int fold) {
 
   if (len <= 24) {
 
-    return len <= 12
-               ? (len <= 4 ? hash32_0_to_4(s, len) : hash32_5_to_12(s, len))
-               : hash32_13_to_24(s, len);
+#if defined(CITYHASH_BRANCHLESS)
+    if (!fold)
+      return select_hash32_0_to_24(s, len);
+#endif
+
+    return len <= 12 ? (len <= 4 ? hash32_0_to_4(s, len, fold)
+                                 : hash32_5_to_12(s, len, fold))
+                     : hash32_13_to_24(s, len, fold);
   }
 
   // len > 24
   uint32_t h = len, g = c1 * len, f = g;
-  uint32_t a0 = rotate32(fetch32(s + len - 4) * c1, 17) * c2;
-  uint32_t a1 = rotate32(fetch32(s + len - 8) * c1, 17) * c2;
-  uint32_t a2 = rotate32(fetch32(s + len - 16) * c1, 17) * c2;
-  uint32_t a3 = rotate32(fetch32(s + len - 12) * c1, 17) * c2;
-  uint32_t a4 = rotate32(fetch32(s + len - 20) * c1, 17) * c2;
+  uint32_t a0 = rotate32(load32(s + len - 4, fold) * c1, 17) * c2;
+  uint32_t a1 = rotate32(load32(s + len - 8, fold) * c1, 17) * c2;
+  uint32_t a2 = rotate32(load32(s + len - 16, fold) * c1, 17) * c2;
+  uint32_t a3 = rotate32(load32(s + len - 12, fold) * c1, 17) * c2;
+  uint32_t a4 = rotate32(load32(s + len - 20, fold) * c1, 17) * c2;
 
   h ^= a0;
   h = rotate32(h, 19);
@@ -254,11 +401,11 @@ uint32_t cityhash32(const uint8_t* s, size_t len) {
 
   do {
 
-    uint32_t a0 = rotate32(fetch32(s) * c1, 17) * c2;
-    uint32_t a1 = fetch32(s + 4);
-    uint32_t a2 = rotate32(fetch32(s + 8) * c1, 17) * c2;
-    uint32_t a3 = rotate32(fetch32(s + 12) * c1, 17) * c2;
-    uint32_t a4 = fetch32(s + 16);
+    uint32_t a0 = rotate32(load32(s, fold) * c1, 17) * c2;
+    uint32_t a1 = load32(s + 4, fold);
+    uint32_t a2 = rotate32(load32(s + 8, fold) * c1, 17) * c2;
+    uint32_t a3 = rotate32(load32(s + 12, fold) * c1, 17) * c2;
+    uint32_t a4 = load32(s + 16, fold);
 
     h ^= a0;
     h = rotate32(h, 18);
@@ -295,6 +442,65 @@ uint32_t cityhash32(const uint8_t* s, size_t len) {
   return h;
 }
 
+static uint32_t city_hash32(const uint8_t* s, size_t len) {
+  return city_hash32_body(s, len, 0);
+}
+
+static uint32_t city_hash32_ci(const uint8_t* s, size_t len) {
+  return city_hash32_body(s, len, 1);
+}
+
+uint32_t cityhash32(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_32, len);
+
+  return city_hash32(s, len);
+}
+
+// cityhash32() of keys of at most 12 bytes followed by CITYHASH_PADDING
+// readable bytes; hash32_0_to_4() and hash32_5_to_12() both end in
+// fmix(mur(p, mur(q, r))), so the inputs of both are computed from full-width
+// loads, the ones matching len are selected with a mask and mixed once
+static uint32_t padded_hash32_0_to_12(const uint8_t* s, size_t len) {
+
+  uint64_t lo = fetch64(s);
+
+  // hash32_0_to_4(), every prefix of the byte loop, then the one for len
+  uint32_t bs[5] = {0};
+  uint32_t cs[5] = {9};
+
+  for (size_t i = 0; i < 4; i++) {
+    bs[i + 1] = bs[i] * c1 + (uint32_t)(int8_t)(lo >> (8 * i));
+    cs[i + 1] = cs[i] ^ bs[i + 1];
+  }
+
+  uint32_t b = bs[len <= 4 ? len : 4];
+  uint32_t c = cs[len <= 4 ? len : 4];
+
+  // hash32_5_to_12()
+  uint32_t a5 = len + (uint32_t)lo;
+  uint32_t b5 = len * 5 + fetch32(s + (len >= 4 ? len - 4 : 0));
+  uint32_t c5 = 9 + (uint32_t)(lo >> (8 * ((len >> 1) & 4)));
+  uint32_t r5 = mur(a5, len * 5);
+
+  uint32_t m0 = -(uint32_t)(len <= 4);
+  uint32_t p = (b & m0) | (c5 & ~m0);
+  uint32_t q = ((uint32_t)len & m0) | (b5 & ~m0);
+  uint32_t r = (c & m0) | (r5 & ~m0);
+
+  return fmix(mur(p, mur(q, r)));
+}
+
+uint32_t cityhash32_padded(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_32, len);
+
+  if (len <= 12)
+    return padded_hash32_0_to_12(s, len);
+
+  return city_hash32(s, len);
+}
+
 // bitwise right rotate, normally this will compile to a single
 // instruction, especially if the shift is a manifest constant.
 static uint64_t rotate64(uint64_t val, size_t shift) {
@@ -323,50 +529,101 @@ static uint64_t hash_mur_16(uint64_t u, uint64_t v, uint64_t mul) {
   return b;
 }
 
-static uint64_t hash_0_to_16(const uint8_t* s, size_t len) {
+static force_inline uint64_t hash_8_to_16(const uint8_t* s, size_t len,
+                                          int fold) {
 
-  if (len >= 8) {
+  uint64_t mul = k2 + len * 2;
+  uint64_t a = load64(s, fold) + k2;
+  uint64_t b = load64(s + len - 8, fold);
+  uint64_t c = rotate64(b, 37) * mul + a;
+  uint64_t d = (rotate64(a, 25) + b) * mul;
 
-    uint64_t mul = k2 + len * 2;
-    uint64_t a = fetch64(s) + k2;
-    uint64_t b = fetch64(s + len - 8);
-    uint64_t c = rotate64(b, 37) * mul + a;
-    uint64_t d = (rotate64(a, 25) + b) * mul;
+  return hash_mur_16(c, d, mul);
+}
 
-    return hash_mur_16(c, d, mul);
-  }
+static force_inline uint64_t hash_4_to_7(const uint8_t* s, size_t len,
+                                         int fold) {
 
-  if (len >= 4) {
+  uint64_t mul = k2 + len * 2;
+  uint64_t a = load32(s, fold);
 
-    uint64_t mul = k2 + len * 2;
-    uint64_t a = fetch32(s);
+  return hash_mur_16(len + (a << 3), load32(s + len - 4, fold), mul);
+}
 
-    return hash_mur_16(len + (a << 3), fetch32(s + len - 4), mul);
-  }
+static force_inline uint64_t hash_1_to_3(const uint8_t* s, size_t len,
+                                         int fold) {
 
-  if (len > 0) {
+  uint8_t a = load8(s, fold);
+  uint8_t b = load8(s + (len >> 1), fold);
+  uint8_t c = load8(s + len - 1, fold);
+  uint32_t y = ((uint32_t)a) + (((uint32_t)b) << 8);
+  uint32_t z = len + (((uint32_t)c) << 2);
 
-    uint8_t a = s[0];
-    uint8_t b = s[len >> 1];
-    uint8_t c = s[len - 1];
-    uint32_t y = ((uint32_t)a) + (((uint32_t)b) << 8);
-    uint32_t z = len + (((uint32_t)c) << 2);
+  return smix(y * k2 ^ z * k0) * k2;
+}
 
-    return smix(y * k2 ^ z * k0) * k2;
+static force_inline uint64_t hash_0_to_16(const uint8_t* s, size_t len,
+                                          int fold) {
+
+  if (len >= 8) {
+    return hash_8_to_16(s, len, fold);
+  }
+
+  if (len >= 4) {
+    return hash_4_to_7(s, len, fold);
+  }
+
+  if (len > 0) {
+    return hash_1_to_3(s, len, fold);
   }
 
   return k2;
 }
 
+// hash_0_to_16() of keys followed by CITYHASH_PADDING readable bytes; the
+// 8..16 and 4..7 byte cases both end in hash_mur_16(), so their inputs and
+// the 1..3 byte case are computed from full-width loads and the ones matching
+// len are selected with masks
+static uint64_t padded_hash_0_to_16(const uint8_t* s, size_t len) {
+
+  uint64_t lo = fetch64(s);
+  uint64_t mul = k2 + len * 2;
+
+  // 8 <= len <= 16
+  uint64_t a8 = lo + k2;
+  uint64_t b8 = fetch64(s + (len >= 8 ? len - 8 : 0));
+  uint64_t u8 = rotate64(b8, 37) * mul + a8;
+  uint64_t v8 = (rotate64(a8, 25) + b8) * mul;
+
+  // 4 <= len < 8, the last 4 bytes are within lo
+  uint64_t u4 = len + ((uint64_t)(uint32_t)lo << 3);
+  uint64_t v4 = (uint32_t)(lo >> (8 * ((len - 4) & 3)));
+
+  // 0 < len < 4, the bytes are within lo
+  uint32_t y = (uint32_t)(lo & 0xff) +
+               ((uint32_t)((lo >> (8 * ((len >> 1) & 7))) & 0xff) << 8);
+  uint32_t z = len + ((uint32_t)((lo >> (8 * ((len - 1) & 7))) & 0xff) << 2);
+  uint64_t h1 = smix(y * k2 ^ z * k0) * k2;
+
+  uint64_t m8 = -(uint64_t)(len >= 8);
+  uint64_t h4 = hash_mur_16((u8 & m8) | (u4 & ~m8), (v8 & m8) | (v4 & ~m8),
+                            mul);
+  uint64_t m4 = -(uint64_t)(len >= 4);
+  uint64_t m0 = -(uint64_t)(len == 0);
+
+  return (h4 & m4) | (h1 & ~m4 & ~m0) | (k2 & m0);
+}
+
 // This probably works well for 16-byte strings as well, but it may be overkill
 // in that case.
-static uint64_t hash_17_to_32(const uint8_t* s, size_t len) {
+static force_inline uint64_t hash_17_to_32(const uint8_t* s, size_t len,
+                                           int fold) {
 
   uint64_t mul = k2 + len * 2;
-  uint64_t a = fetch64(s) * k1;
-  uint64_t b = fetch64(s + 8);
-  uint64_t c = fetch64(s + len - 8) * mul;
-  uint64_t d = fetch64(s + len - 16) * k2;
+  uint64_t a = load64(s, fold) * k1;
+  uint64_t b = load64(s + 8, fold);
+  uint64_t c = load64(s + len - 8, fold) * mul;
+  uint64_t d = load64(s + len - 16, fold) * k2;
 
   return hash_mur_16(rotate64(a + b, 43) + rotate64(c, 30) + d,
                      a + rotate64(b + k2, 18) + c, mul);
@@ -390,25 +647,28 @@ static uint128_t weak_hash_32_with_seeds(uint64_t w, uint64_t x, uint64_t y,
 }
 
 // return a 16-byte hash for s[0] ... s[31], a, and b, quick and dirty
-static uint128_t weak_hash_32_with_seeds_raw(const uint8_t* s, uint64_t a,
-                                             uint64_t b) {
+static force_inline uint128_t
+weak_hash_32_with_seeds_raw(const uint8_t* s, uint64_t a, uint64_t b,
+                            int fold) {
 
-  return weak_hash_32_with_seeds(fetch64(s), fetch64(s + 8), fetch64(s + 16),
-                                 fetch64(s + 24), a, b);
+  return weak_hash_32_with_seeds(load64(s, fold), load64(s + 8, fold),
+                                 load64(s + 16, fold), load64(s + 24, fold), a,
+                                 b);
 }
 
 // return an 8-byte hash for 33 to 64 bytes
-static uint64_t hash_33_to_64(const uint8_t* s, size_t len) {
+static force_inline uint64_t hash_33_to_64(const uint8_t* s, size_t len,
+                                           int fold) {
 
   uint64_t mul = k2 + len * 2;
-  uint64_t a = fetch64(s) * k2;
-  uint64_t b = fetch64(s + 8);
-  uint64_t c = fetch64(s + len - 24);
-  uint64_t d = fetch64(s + len - 32);
-  uint64_t e = fetch64(s + 16) * k2;
-  uint64_t f = fetch64(s + 24) * 9;
-  uint64_t g = fetch64(s + len - 8);
-  uint64_t h = fetch64(s + len - 16) * mul;
+  uint64_t a = load64(s, fold) * k2;
+  uint64_t b = load64(s + 8, fold);
+  uint64_t c = load64(s + len - 24, fold);
+  uint64_t d = load64(s + len - 32, fold);
+  uint64_t e = load64(s + 16, fold) * k2;
+  uint64_t f = load64(s + 24, fold) * 9;
+  uint64_t g = load64(s + len - 8, fold);
+  uint64_t h = load64(s + len - 16, fold) * mul;
   uint64_t u = rotate64(a + g, 43) + (rotate64(b, 30) + c) * 9;
   uint64_t v = ((a + g) ^ d) + f + 1;
   uint64_t w = bswap64((u + v) * mul) + h;
@@ -422,44 +682,91 @@ static uint64_t hash_33_to_64(const uint8_t* s, size_t len) {
   return b + x;
 }
 
-uint64_t cityhash64(const uint8_t* s, size_t len) {
+#if defined(CITYHASH_BRANCHLESS)
+
+// hash_4_to_7(), hash_8_to_16() and hash_17_to_32() all end in
+// hash_mur_16(u, v, mul), their u and v are selected and mixed once
+static uint64_t select_hash_0_to_32(const uint8_t* s, size_t len) {
+
+  uint64_t mul = k2 + len * 2;
+
+  const uint8_t* s17 = case_key(s, len, 17);
+  size_t l17 = case_len(len, 17);
+  uint64_t a17 = fetch64(s17) * k1;
+  uint64_t b17 = fetch64(s17 + 8);
+  uint64_t c17 = fetch64(s17 + l17 - 8) * mul;
+  uint64_t d17 = fetch64(s17 + l17 - 16) * k2;
+  uint64_t u17 = rotate64(a17 + b17, 43) + rotate64(c17, 30) + d17;
+  uint64_t v17 = a17 + rotate64(b17 + k2, 18) + c17;
+
+  const uint8_t* s8 = case_key(s, len, 8);
+  uint64_t a8 = fetch64(s8) + k2;
+  uint64_t b8 = fetch64(s8 + case_len(len, 8) - 8);
+  uint64_t u8 = rotate64(b8, 37) * mul + a8;
+  uint64_t v8 = (rotate64(a8, 25) + b8) * mul;
+
+  const uint8_t* s4 = case_key(s, len, 4);
+  uint64_t u4 = len + ((uint64_t)fetch32(s4) << 3);
+  uint64_t v4 = fetch32(s4 + case_len(len, 4) - 4);
+
+  uint64_t u = select64(len >= 17, u17, select64(len >= 8, u8, u4));
+  uint64_t v = select64(len >= 17, v17, select64(len >= 8, v8, v4));
+  uint64_t h4 = hash_mur_16(u, v, mul);
+  uint64_t h1 = hash_1_to_3(case_key(s, len, 1), case_len(len, 1), 0);
+
+  return select64(len >= 4, h4, select64(len >= 1, h1, k2));
+}
+
+#endif
+
+static force_inline uint64_t city_hash64_body(const uint8_t* s, size_t len,
+                                              int fold) {
+
+#if defined(CITYHASH_BRANCHLESS)
+
+  if (!fold && len <= 32)
+    return select_hash_0_to_32(s, len);
+
+#endif
 
   if (len <= 32) {
 
     if (len <= 16) {
 
-      return hash_0_to_16(s, len);
+      return hash_0_to_16(s, len, fold);
     } else {
 
-      return hash_17_to_32(s, len);
+      return hash_17_to_32(s, len, fold);
     }
   } else if (len <= 64) {
 
-    return hash_33_to_64(s, len);
+    return hash_33_to_64(s, len, fold);
   }
 
   // for strings over 64 bytes we hash the end first, and then as we
   // loop we keep 56 bytes of state: v, w, x, y, and z
-  uint64_t x = fetch64(s + len - 40);
-  uint64_t y = fetch64(s + len - 16) + fetch64(s + len - 56);
-  uint64_t z = hash_16(fetch64(s + len - 48) + len, fetch64(s + len - 24));
-  uint128_t v = weak_hash_32_with_seeds_raw(s + len - 64, len, z);
-  uint128_t w = weak_hash_32_with_seeds_raw(s + len - 32, y + k1, x);
+  uint64_t x = load64(s + len - 40, fold);
+  uint64_t y = load64(s + len - 16, fold) + load64(s + len - 56, fold);
+  uint64_t z =
+      hash_16(load64(s + len - 48, fold) + len, load64(s + len - 24, fold));
+  uint128_t v = weak_hash_32_with_seeds_raw(s + len - 64, len, z, fold);
+  uint128_t w = weak_hash_32_with_seeds_raw(s + len - 32, y + k1, x, fold);
 
-  x = x * k1 + fetch64(s);
+  x = x * k1 + load64(s, fold);
 
   // decrease len to the nearest multiple of 64, and operate on 64-byte chunks
   len = (len - 1) & ~((size_t)63);
 
   do {
 
-    x = rotate64(x + y + v.a + fetch64(s + 8), 37) * k1;
-    y = rotate64(y + v.b + fetch64(s + 48), 42) * k1;
+    x = rotate64(x + y + v.a + load64(s + 8, fold), 37) * k1;
+    y = rotate64(y + v.b + load64(s + 48, fold), 42) * k1;
     x ^= w.b;
-    y += v.a + fetch64(s + 40);
+    y += v.a + load64(s + 40, fold);
     z = rotate64(z + w.a, 33) * k1;
-    v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a);
-    w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + fetch64(s + 16));
+    v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a, fold);
+    w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + load64(s + 16, fold),
+                                    fold);
     swap64(&z, &x);
     s += 64;
     len -= 64;
@@ -468,98 +775,293 @@ uint64_t cityhash64(const uint8_t* s, size_t len) {
   return hash_16(hash_16(v.a, w.a) + smix(y) * k1 + z, hash_16(v.b, w.b) + x);
 }
 
+static uint64_t city_hash64(const uint8_t* s, size_t len) {
+  return city_hash64_body(s, len, 0);
+}
+
+static uint64_t city_hash64_ci(const uint8_t* s, size_t len) {
+  return city_hash64_body(s, len, 1);
+}
+
+uint64_t cityhash64(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64, len);
+  PROBE_ENTRY(cityhash64, s, len);
+
+  uint64_t result = city_hash64(s, len);
+
+  PROBE_RETURN(cityhash64, len);
+
+  return result;
+}
+
+uint64_t cityhash64_padded(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64, len);
+
+  if (len <= 16)
+    return padded_hash_0_to_16(s, len);
+
+  return city_hash64(s, len);
+}
+
 uint64_t cityhash64_with_seed(const uint8_t* s, size_t len, uint64_t seed) {
-  return cityhash64_with_seeds(s, len, k2, seed);
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64_WITH_SEED, len);
+
+  return hash_16(city_hash64(s, len) - k2, seed);
 }
 
 uint64_t cityhash64_with_seeds(const uint8_t* s, size_t len, uint64_t seed0,
                                uint64_t seed1) {
-  return hash_16(cityhash64(s, len) - seed0, seed1);
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64_WITH_SEEDS, len);
+
+  return hash_16(city_hash64(s, len) - seed0, seed1);
+}
+
+// strlen() whose loads are aligned blocks, which never reach into a page
+// that the string itself does not; bytes before s in the first block are
+// shifted out of the mask, bytes after the terminator are never looked at,
+// but they are loaded, hence no address sanitizing
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+#define KCSTR_BLOCK (32)
+#define cstr_zero(p)                                                           \
+  (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(                           \
+      _mm256_load_si256((const __m256i*)(p)), _mm256_setzero_si256()))
+#else
+#define KCSTR_BLOCK (16)
+#define cstr_zero(p)                                                           \
+  (uint32_t) _mm_movemask_epi8(                                                \
+      _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(p)), _mm_setzero_si128()))
+#endif
+
+__attribute__((no_sanitize_address)) static inline size_t
+cstr_len(const char* s) {
+
+  const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)(KCSTR_BLOCK - 1));
+  uint32_t mask = cstr_zero(p) >> (s - p);
+
+  if (mask != 0)
+    return __builtin_ctz(mask);
+
+  for (;;) {
+    p += KCSTR_BLOCK;
+    mask = cstr_zero(p);
+
+    if (mask != 0)
+      return p - s + __builtin_ctz(mask);
+  }
+}
+
+#else
+
+static inline size_t cstr_len(const char* s) { return strlen(s); }
+
+#endif
+
+// the string is hashed right after the scan, while its bytes are in L1
+uint64_t cityhash64_cstr(const char* s) {
+
+  size_t len = cstr_len(s);
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64, len);
+
+  return city_hash64((const uint8_t*)s, len);
+}
+
+uint32_t cityhash32_cstr(const char* s) {
+
+  size_t len = cstr_len(s);
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_32, len);
+
+  return city_hash32((const uint8_t*)s, len);
+}
+
+uint64_t cityhash64_ci(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_64, len);
+
+  return city_hash64_ci(s, len);
+}
+
+uint32_t cityhash32_ci(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_32, len);
+
+  return city_hash32_ci(s, len);
+}
+
+void cityhash64_ci_batch(const uint8_t* const* bufs, const size_t* lens,
+                         size_t n, uint64_t* out) {
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = cityhash64_ci(bufs[i], lens[i]);
+}
+
+void cityhash64_batch(const uint8_t* const* bufs, const size_t* lens, size_t n,
+                      uint64_t* out) {
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = cityhash64(bufs[i], lens[i]);
+}
+
+void cityhash64_batch_offsets(const uint8_t* data, const uint32_t* offsets,
+                              size_t n, uint64_t* out) {
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = cityhash64(data + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+// the length case of a fixed width is picked once, so the loop over the
+// array is a straight run of loads and multiplies
+void cityhash64_batch_fixed(const uint8_t* data, size_t width, size_t n,
+                            uint64_t* out) {
+
+  for (size_t i = 0; i < n; i++)
+    CITYHASH_STATS_RECORD(CITYHASH_STATS_64, width);
+
+  if (width == 8) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = hash_8_to_16(data + i * 8, 8, 0);
+  } else if (width == 4) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = hash_4_to_7(data + i * 4, 4, 0);
+  } else if (width > 8 && width <= 16) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = hash_8_to_16(data + i * width, width, 0);
+  } else if (width > 4 && width < 8) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = hash_4_to_7(data + i * width, width, 0);
+  } else if (width > 0 && width < 4) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = hash_1_to_3(data + i * width, width, 0);
+  } else {
+    for (size_t i = 0; i < n; i++)
+      out[i] = city_hash64(data + i * width, width);
+  }
+}
+
+// state of the city_murmur() loop, split out so that cityhash128_batch() can
+// run several keys through the same steps side by side
+struct murmur_state {
+  uint64_t a, b, c, d;
+};
+
+// sets up st for a key of len > 16 bytes
+static inline void murmur_init(const uint8_t* s, size_t len, uint128_t seed,
+                               struct murmur_state* st) {
+
+  st->a = seed.a;
+  st->b = seed.b;
+  st->c = hash_16(fetch64(s + len - 8) + k1, st->a);
+  st->d = hash_16(st->b + len, st->c + fetch64(s + len - 16));
+  st->a += st->d;
+}
+
+// mixes the next 16 bytes of s into st
+static inline void murmur_step(const uint8_t* s, struct murmur_state* st) {
+
+  st->a ^= smix(fetch64(s) * k1) * k1;
+  st->a *= k1;
+  st->b ^= st->a;
+  st->c ^= smix(fetch64(s + 8) * k1) * k1;
+  st->c *= k1;
+  st->d ^= st->c;
+}
+
+static inline uint128_t murmur_final(const struct murmur_state* st) {
+
+  uint64_t a = hash_16(st->a, st->c);
+  uint64_t b = hash_16(st->d, st->b);
+
+  uint128_t result = {a ^ b, hash_16(b, a)};
+
+  return result;
 }
 
 // a subroutine for cityhash128(), returns a decent 128-bit hash for strings
 // of any length representable in signed long, based on city and murmur
 static uint128_t city_murmur(const uint8_t* s, size_t len, uint128_t seed) {
 
-  uint64_t a = seed.a;
-  uint64_t b = seed.b;
-  uint64_t c = 0;
-  uint64_t d = 0;
+  struct murmur_state st;
   signed long l = len - 16;
 
   if (l <= 0) { // len <= 16
 
-    a = smix(a * k1) * k1;
-    c = b * k1 + hash_0_to_16(s, len);
-    d = smix(a + (len >= 8 ? fetch64(s) : c));
+    st.a = smix(seed.a * k1) * k1;
+    st.b = seed.b;
+    st.c = seed.b * k1 + hash_0_to_16(s, len, 0);
+    st.d = smix(st.a + (len >= 8 ? fetch64(s) : st.c));
+
   } else { // len > 16
 
-    c = hash_16(fetch64(s + len - 8) + k1, a);
-    d = hash_16(b + len, c + fetch64(s + len - 16));
-    a += d;
+    murmur_init(s, len, seed, &st);
 
     do {
 
-      a ^= smix(fetch64(s) * k1) * k1;
-      a *= k1;
-      b ^= a;
-      c ^= smix(fetch64(s + 8) * k1) * k1;
-      c *= k1;
-      d ^= c;
+      murmur_step(s, &st);
       s += 16;
       l -= 16;
     } while (l > 0);
   }
 
-  a = hash_16(a, c);
-  b = hash_16(d, b);
-
-  uint128_t result = {a ^ b, hash_16(b, a)};
-
-  return result;
+  return murmur_final(&st);
 }
 
-uint128_t cityhash128_with_seed(const uint8_t* s, size_t len, uint128_t seed) {
+// we expect len >= 128 to be the common case, keep 56 bytes of state:
+// v, w, x, y, and z
+struct city128_state {
+  uint128_t v, w;
+  uint64_t x, y, z;
+};
 
-  if (len < 128) {
-    return city_murmur(s, len, seed);
-  }
+// sets up st for a key of len >= 128 bytes
+static inline void city128_init(const uint8_t* s, size_t len, uint128_t seed,
+                                struct city128_state* st) {
 
-  // we expect len >= 128 to be the common case, keep 56 bytes of state:
-  // v, w, x, y, and z
-  uint128_t v, w;
-  uint64_t x = seed.a;
-  uint64_t y = seed.b;
-  uint64_t z = len * k1;
+  st->x = seed.a;
+  st->y = seed.b;
+  st->z = len * k1;
 
-  v.a = rotate64(y ^ k1, 49) * k1 + fetch64(s);
-  v.b = rotate64(v.a, 42) * k1 + fetch64(s + 8);
-  w.a = rotate64(y + z, 35) * k1 + x;
-  w.b = rotate64(x + fetch64(s + 88), 53) * k1;
+  st->v.a = rotate64(st->y ^ k1, 49) * k1 + fetch64(s);
+  st->v.b = rotate64(st->v.a, 42) * k1 + fetch64(s + 8);
+  st->w.a = rotate64(st->y + st->z, 35) * k1 + st->x;
+  st->w.b = rotate64(st->x + fetch64(s + 88), 53) * k1;
+}
 
-  // this is the same inner loop as cityhash64(), manually unrolled
-  do {
+// mixes the next 64 bytes of s into st, the same step as cityhash64()
+static inline void city128_step(const uint8_t* s, struct city128_state* st) {
+
+  uint64_t x = st->x, y = st->y, z = st->z;
+  uint128_t v = st->v, w = st->w;
+
+  x = rotate64(x + y + v.a + fetch64(s + 8), 37) * k1;
+  y = rotate64(y + v.b + fetch64(s + 48), 42) * k1;
+  x ^= w.b;
+  y += v.a + fetch64(s + 40);
+  z = rotate64(z + w.a, 33) * k1;
+  v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a, 0);
+  w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + fetch64(s + 16), 0);
+
+  st->x = z;
+  st->y = y;
+  st->z = x;
+  st->v = v;
+  st->w = w;
+}
 
-    x = rotate64(x + y + v.a + fetch64(s + 8), 37) * k1;
-    y = rotate64(y + v.b + fetch64(s + 48), 42) * k1;
-    x ^= w.b;
-    y += v.a + fetch64(s + 40);
-    z = rotate64(z + w.a, 33) * k1;
-    v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a);
-    w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + fetch64(s + 16));
-    swap64(&z, &x);
-    s += 64;
-    x = rotate64(x + y + v.a + fetch64(s + 8), 37) * k1;
-    y = rotate64(y + v.b + fetch64(s + 48), 42) * k1;
-    x ^= w.b;
-    y += v.a + fetch64(s + 40);
-    z = rotate64(z + w.a, 33) * k1;
-    v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a);
-    w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + fetch64(s + 16));
-    swap64(&z, &x);
-    s += 64;
-    len -= 128;
-  } while (likely(len >= 128));
+// hashes the last len < 128 bytes at s into st and returns the result
+static inline uint128_t city128_final(const uint8_t* s, size_t len,
+                                      const struct city128_state* st) {
+
+  uint64_t x = st->x, y = st->y, z = st->z;
+  uint128_t v = st->v, w = st->w;
 
   x += rotate64(v.a + z, 49) * k0;
   y = y * k0 + rotate64(w.b, 37);
@@ -576,7 +1078,7 @@ uint128_t cityhash128_with_seed(const uint8_t* s, size_t len, uint128_t seed) {
     x = x * k0 + w.a;
     z += w.b + fetch64(s + len - tail_done);
     w.b += v.a;
-    v = weak_hash_32_with_seeds_raw(s + len - tail_done, v.a + z, v.b);
+    v = weak_hash_32_with_seeds_raw(s + len - tail_done, v.a + z, v.b, 0);
     v.a *= k0;
   }
 
@@ -591,17 +1093,443 @@ uint128_t cityhash128_with_seed(const uint8_t* s, size_t len, uint128_t seed) {
   return result;
 }
 
-uint128_t cityhash128(const uint8_t* s, size_t len) {
+static uint128_t city_hash128_with_seed(const uint8_t* s, size_t len,
+                                        uint128_t seed) {
+
+  if (len < 128) {
+    return city_murmur(s, len, seed);
+  }
+
+  struct city128_state st;
+
+  city128_init(s, len, seed, &st);
+
+  // this is the same inner loop as cityhash64(), manually unrolled
+  do {
+
+    city128_step(s, &st);
+    city128_step(s + 64, &st);
+    s += 128;
+    len -= 128;
+  } while (likely(len >= 128));
+
+  return city128_final(s, len, &st);
+}
+
+// prefetch the 128 bytes distance ahead of s with a non-temporal hint unless
+// they are past the last len bytes; on x86 this is prefetchnta, the lines go
+// to L1 but are not kept in the outer caches that other threads depend on
+static inline void stream_prefetch(const uint8_t* s, size_t len,
+                                   size_t distance) {
 
-  if (len >= 16) {
+  if (distance < len) {
+    __builtin_prefetch(s + distance, 0, 0);
+    __builtin_prefetch(s + distance + 64, 0, 0);
+  }
+}
+
+// city_hash128_with_seed() for inputs that are read once
+static uint128_t city_hash128_stream(const uint8_t* s, size_t len,
+                                     uint128_t seed, size_t distance) {
+
+  if (len < 128) {
+    return city_murmur(s, len, seed);
+  }
+
+  struct city128_state st;
+
+  city128_init(s, len, seed, &st);
+
+  do {
+
+    stream_prefetch(s, len, distance);
+    city128_step(s, &st);
+    city128_step(s + 64, &st);
+    s += 128;
+    len -= 128;
+  } while (likely(len >= 128));
+
+  return city128_final(s, len, &st);
+}
+
+uint128_t cityhash128_with_seed(const uint8_t* s, size_t len, uint128_t seed) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_128_WITH_SEED, len);
+  PROBE_ENTRY(cityhash128_with_seed, s, len);
+
+  uint128_t result = city_hash128_with_seed(s, len, seed);
+
+  PROBE_RETURN(cityhash128_with_seed, len);
+
+  return result;
+}
+
+// cityhash128() seeds itself from the first 16 bytes of keys that have them,
+// advances *s and *len past those and returns the seed
+static inline uint128_t city_hash128_seed(const uint8_t** s, size_t* len) {
+
+  if (*len >= 16) {
 
-    uint128_t seed = {fetch64(s), fetch64(s + 8) + k0};
-    return cityhash128_with_seed(s + 16, len - 16, seed);
+    uint128_t seed = {fetch64(*s), fetch64(*s + 8) + k0};
+    *s += 16;
+    *len -= 16;
+    return seed;
 
   } else {
 
     uint128_t seed = {k0, k1};
-    return cityhash128_with_seed(s, len, seed);
+    return seed;
+  }
+}
+
+static uint128_t city_hash128(const uint8_t* s, size_t len) {
+
+  uint128_t seed = city_hash128_seed(&s, &len);
+
+  return city_hash128_with_seed(s, len, seed);
+}
+
+uint128_t cityhash128(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_128, len);
+
+  return city_hash128(s, len);
+}
+
+uint128_t cityhash128_stream(const uint8_t* s, size_t len, size_t distance) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_128, len);
+
+  uint128_t seed = city_hash128_seed(&s, &len);
+
+  return city_hash128_stream(s, len, seed,
+                             distance ? distance : CITYHASH_STREAM_DISTANCE);
+}
+
+// cityhash128_batch() runs the long loop of four keys at a time in the 64-bit
+// lanes of AVX2 registers; a lane that finishes is finalized with scalar code
+// and refilled with the next long key while the other lanes keep going
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define KLANES (4)
+
+// AVX2 has no 64-bit multiply or rotate, build them from three 32x32->64
+// multiplies and two shifts; AVX-512VL and DQ have both on 256-bit registers,
+// which moves the point where lanes beat the scalar loop a lot lower
+#if defined(__AVX512VL__) && defined(__AVX512DQ__)
+
+#define KLANE_MIN_LEN (640)
+
+static inline __m256i mul64x4(__m256i a, uint64_t k) {
+  return _mm256_mullo_epi64(a, _mm256_set1_epi64x((long long)k));
+}
+
+#define rotate64x4(v, shift) _mm256_ror_epi64((v), (shift))
+
+#else
+
+#define KLANE_MIN_LEN (1024)
+
+static inline __m256i mul64x4(__m256i a, uint64_t k) {
+
+  const __m256i k_lo = _mm256_set1_epi64x((long long)k);
+  const __m256i k_hi = _mm256_set1_epi64x((long long)(k >> 32));
+
+  __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), k_lo),
+      _mm256_mul_epu32(a, k_hi));
+
+  return _mm256_add_epi64(_mm256_mul_epu32(a, k_lo),
+                          _mm256_slli_epi64(cross, 32));
+}
+
+#define rotate64x4(v, shift)                                                   \
+  _mm256_or_si256(_mm256_srli_epi64((v), (shift)),                             \
+                  _mm256_slli_epi64((v), 64 - (shift)))
+
+#endif
+
+#define add64x4(a, b) _mm256_add_epi64((a), (b))
+
+// idle lanes hash these zeros, their results are discarded
+static const uint8_t lane_idle[128];
+
+// loads 32 bytes at off from each lane and transposes them, f[i] holds word
+// i of every lane
+static inline void fetch256x4(const uint8_t* const p[KLANES], size_t off,
+                              __m256i f[4]) {
+
+  __m256i a0 = _mm256_loadu_si256((const __m256i*)(p[0] + off));
+  __m256i a1 = _mm256_loadu_si256((const __m256i*)(p[1] + off));
+  __m256i a2 = _mm256_loadu_si256((const __m256i*)(p[2] + off));
+  __m256i a3 = _mm256_loadu_si256((const __m256i*)(p[3] + off));
+  __m256i t0 = _mm256_unpacklo_epi64(a0, a1);
+  __m256i t1 = _mm256_unpackhi_epi64(a0, a1);
+  __m256i t2 = _mm256_unpacklo_epi64(a2, a3);
+  __m256i t3 = _mm256_unpackhi_epi64(a2, a3);
+
+  f[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+  f[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+  f[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+  f[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+// lane inputs are written one lane at a time, reading them back with a
+// single 256-bit load would stall on store forwarding
+static inline __m256i load64x4(const uint64_t a[KLANES]) {
+  return _mm256_set_epi64x((long long)a[3], (long long)a[2], (long long)a[1],
+                           (long long)a[0]);
+}
+
+// the length left for city_hash128_with_seed() after city_hash128_seed()
+static inline size_t lane_len(size_t len) { return len >= 16 ? len - 16 : len; }
+
+// city128_state of every lane
+struct city128_state4 {
+  __m256i x, y, z, va, vb, wa, wb;
+};
+
+// city128_init() of the lanes set in mask, the others keep their state
+static inline void city128_init4(const uint64_t seed_a[KLANES],
+                                 const uint64_t seed_b[KLANES],
+                                 const uint64_t len[KLANES],
+                                 const uint64_t f0[KLANES],
+                                 const uint64_t f8[KLANES],
+                                 const uint64_t f88[KLANES], __m256i mask,
+                                 struct city128_state4* st) {
+
+  const __m256i vk1 = _mm256_set1_epi64x((long long)k1);
+
+  __m256i x = load64x4(seed_a);
+  __m256i y = load64x4(seed_b);
+  __m256i z = mul64x4(load64x4(len), k1);
+  __m256i va = mul64x4(rotate64x4(_mm256_xor_si256(y, vk1), 49), k1);
+  va = add64x4(va, load64x4(f0));
+  __m256i vb = add64x4(mul64x4(rotate64x4(va, 42), k1), load64x4(f8));
+  __m256i wa = add64x4(mul64x4(rotate64x4(add64x4(y, z), 35), k1), x);
+  __m256i wb = mul64x4(rotate64x4(add64x4(x, load64x4(f88)), 53), k1);
+
+  st->x = _mm256_blendv_epi8(st->x, x, mask);
+  st->y = _mm256_blendv_epi8(st->y, y, mask);
+  st->z = _mm256_blendv_epi8(st->z, z, mask);
+  st->va = _mm256_blendv_epi8(st->va, va, mask);
+  st->vb = _mm256_blendv_epi8(st->vb, vb, mask);
+  st->wa = _mm256_blendv_epi8(st->wa, wa, mask);
+  st->wb = _mm256_blendv_epi8(st->wb, wb, mask);
+}
+
+// city128_step() of the 64 bytes at off in every lane
+static inline void city128_step4(const uint8_t* const p[KLANES], size_t off,
+                                 struct city128_state4* st) {
+
+  __m256i x = st->x, y = st->y, z = st->z;
+  __m256i va = st->va, vb = st->vb, wa = st->wa, wb = st->wb;
+  __m256i f[8], t, u, c;
+
+  fetch256x4(p, off, f);
+  fetch256x4(p, off + 32, f + 4);
+
+  x = mul64x4(rotate64x4(add64x4(add64x4(x, y), add64x4(va, f[1])), 37), k1);
+  y = mul64x4(rotate64x4(add64x4(add64x4(y, vb), f[6]), 42), k1);
+  x = _mm256_xor_si256(x, wb);
+  y = add64x4(y, add64x4(va, f[5]));
+  z = mul64x4(rotate64x4(add64x4(z, wa), 33), k1);
+
+  // v = weak_hash_32_with_seeds_raw(s, v.b * k1, x + w.a)
+  t = add64x4(mul64x4(vb, k1), f[0]);
+  u = rotate64x4(add64x4(add64x4(add64x4(x, wa), t), f[3]), 21);
+  c = t;
+  t = add64x4(add64x4(t, f[1]), f[2]);
+  va = add64x4(t, f[3]);
+  vb = add64x4(add64x4(u, rotate64x4(t, 44)), c);
+
+  // w = weak_hash_32_with_seeds_raw(s + 32, z + w.b, y + fetch64(s + 16))
+  t = add64x4(add64x4(z, wb), f[4]);
+  u = rotate64x4(add64x4(add64x4(add64x4(y, f[2]), t), f[7]), 21);
+  c = t;
+  t = add64x4(add64x4(t, f[5]), f[6]);
+  wa = add64x4(t, f[7]);
+  wb = add64x4(add64x4(u, rotate64x4(t, 44)), c);
+
+  st->x = z;
+  st->y = y;
+  st->z = x;
+  st->va = va;
+  st->vb = vb;
+  st->wa = wa;
+  st->wb = wb;
+}
+
+// keys with lane_len() >= KLANE_MIN_LEN, the city_hash128_with_seed() loop in
+// 128-byte steps; lanes refilled in a round run city128_init() under a mask
+static void city_hash128_batch_long(const uint8_t* const* bufs,
+                                    const size_t* lens, size_t n,
+                                    uint128_t* out) {
+
+  uint64_t seed_a[KLANES], seed_b[KLANES], len[KLANES], fresh[KLANES];
+  uint64_t f0[KLANES], f8[KLANES], f88[KLANES];
+  uint64_t xs[KLANES], ys[KLANES], zs[KLANES];
+  uint64_t vas[KLANES], vbs[KLANES], was[KLANES], wbs[KLANES];
+  const uint8_t* p[KLANES];
+  size_t steps[KLANES], stride[KLANES], tail[KLANES], job[KLANES];
+  struct city128_state4 st;
+  size_t next = 0;
+  int busy = 0;
+
+  st.x = st.y = st.z = _mm256_setzero_si256();
+  st.va = st.vb = st.wa = st.wb = _mm256_setzero_si256();
+
+  for (int i = 0; i < KLANES; i++) {
+
+    seed_a[i] = seed_b[i] = len[i] = f0[i] = f8[i] = f88[i] = 0;
+    p[i] = lane_idle;
+    stride[i] = 0;
+    job[i] = n;
+  }
+
+  for (;;) {
+
+    int refilled = 0;
+
+    // refill idle lanes with the next long keys
+    for (int i = 0; i < KLANES; i++) {
+
+      fresh[i] = 0;
+
+      while (job[i] == n && next < n) {
+
+        if (lane_len(lens[next]) < KLANE_MIN_LEN) {
+          next++;
+          continue;
+        }
+
+        const uint8_t* s = bufs[next];
+        size_t l = lens[next];
+        uint128_t seed = city_hash128_seed(&s, &l);
+
+        seed_a[i] = seed.a;
+        seed_b[i] = seed.b;
+        len[i] = l;
+        f0[i] = fetch64(s);
+        f8[i] = fetch64(s + 8);
+        f88[i] = fetch64(s + 88);
+        fresh[i] = ~0ULL;
+        p[i] = s;
+        stride[i] = 128;
+        steps[i] = l / 128;
+        tail[i] = l % 128;
+        job[i] = next++;
+        busy++;
+        refilled++;
+      }
+    }
+
+    if (busy == 0)
+      break;
+
+    if (refilled)
+      city128_init4(seed_a, seed_b, len, f0, f8, f88, load64x4(fresh), &st);
+
+    // every busy lane can take this many steps before one of them finishes
+    size_t common = SIZE_MAX;
+
+    for (int i = 0; i < KLANES; i++) {
+      if (job[i] < n && steps[i] < common)
+        common = steps[i];
+    }
+
+    for (size_t k = 0; k < common; k++) {
+
+      city128_step4(p, 0, &st);
+      city128_step4(p, 64, &st);
+
+      for (int i = 0; i < KLANES; i++)
+        p[i] += stride[i];
+    }
+
+    _mm256_storeu_si256((__m256i*)xs, st.x);
+    _mm256_storeu_si256((__m256i*)ys, st.y);
+    _mm256_storeu_si256((__m256i*)zs, st.z);
+    _mm256_storeu_si256((__m256i*)vas, st.va);
+    _mm256_storeu_si256((__m256i*)vbs, st.vb);
+    _mm256_storeu_si256((__m256i*)was, st.wa);
+    _mm256_storeu_si256((__m256i*)wbs, st.wb);
+
+    // finalize the lanes that are done
+    for (int i = 0; i < KLANES; i++) {
+
+      if (job[i] == n || (steps[i] -= common) != 0)
+        continue;
+
+      struct city128_state final = {
+          {vas[i], vbs[i]}, {was[i], wbs[i]}, xs[i], ys[i], zs[i]};
+
+      out[job[i]] = city128_final(p[i], tail[i], &final);
+      p[i] = lane_idle;
+      stride[i] = 0;
+      job[i] = n;
+      busy--;
+    }
+  }
+}
+
+#endif
+
+void cityhash128_batch(const uint8_t* const* bufs, const size_t* lens,
+                       size_t n, uint128_t* out) {
+
+  for (size_t i = 0; i < n; i++)
+    CITYHASH_STATS_RECORD(CITYHASH_STATS_128, lens[i]);
+
+#if defined(__AVX2__)
+
+  // shorter keys spend most of their time outside the long loop, where the
+  // scalar code already overlaps independent keys
+  for (size_t i = 0; i < n; i++) {
+    if (lane_len(lens[i]) < KLANE_MIN_LEN)
+      out[i] = city_hash128(bufs[i], lens[i]);
+  }
+
+  city_hash128_batch_long(bufs, lens, n, out);
+
+#else
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = city_hash128(bufs[i], lens[i]);
+
+#endif
+}
+
+void cityhash64_combine(uint64_t* h, const uint64_t* v, size_t n) {
+
+  size_t i = 0;
+
+#if defined(__AVX2__)
+
+  // the multiplier of hash_128_to_64()
+  const uint64_t kmul = 0x9ddfea08eb382d69;
+
+  for (; i + KLANES <= n; i += KLANES) {
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)(h + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(v + i));
+    __m256i x = mul64x4(_mm256_xor_si256(a, b), kmul);
+
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 47));
+
+    __m256i y = mul64x4(_mm256_xor_si256(b, x), kmul);
+
+    y = _mm256_xor_si256(y, _mm256_srli_epi64(y, 47));
+    _mm256_storeu_si256((__m256i*)(h + i), mul64x4(y, kmul));
+  }
+
+#endif
+
+  for (; i < n; i++) {
+    uint128_t u = {h[i], v[i]};
+    h[i] = hash_128_to_64(u);
   }
 }
 
@@ -611,11 +1539,12 @@ uint128_t cityhash128(const uint8_t* s, size_t len) {
 
 #include <smmintrin.h>
 
-// requires len >= 240
-static uint256_t cityhash256_crc_long(const uint8_t* s, size_t len,
-                                      uint32_t seed) {
+// requires len >= 240, prefetches distance bytes ahead unless distance is 0
+static inline uint256_t cityhash256_crc_long(const uint8_t* s, size_t len,
+                                             uint32_t seed, size_t distance) {
 
   uint256_t result;
+  const uint8_t* end = s + len;
 
   uint64_t a = fetch64(s + 56) + k0;
   uint64_t b = fetch64(s + 96) + k0;
@@ -634,6 +1563,12 @@ static uint256_t cityhash256_crc_long(const uint8_t* s, size_t len,
   len -= iters * 240;
 
   do {
+
+    if (distance != 0) {
+      stream_prefetch(s, end - s, distance);
+      stream_prefetch(s + 128, end - s - 128, distance);
+    }
+
 #define CHUNK(r)                                                               \
   PERMUTE3_64(&x, &z, &y);                                                     \
   b += fetch64(s);                                                             \
@@ -721,28 +1656,55 @@ static uint256_t cityhash256_crc_short(const uint8_t* s, size_t len) {
   memcpy(buf, s, len);
   memset(buf + len, 0, 240 - len);
 
-  return cityhash256_crc_long(buf, 240, ~((uint32_t)len));
+  return cityhash256_crc_long(buf, 240, ~((uint32_t)len), 0);
 }
 
-uint256_t cityhash256_crc(const uint8_t* s, size_t len) {
+static uint256_t city_hash256_crc(const uint8_t* s, size_t len) {
 
   if (likely(len >= 240)) {
-    return cityhash256_crc_long(s, len, 0);
+    return cityhash256_crc_long(s, len, 0, 0);
   } else {
     return cityhash256_crc_short(s, len);
   }
 }
 
+uint256_t cityhash256_crc(const uint8_t* s, size_t len) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_256_CRC, len);
+  PROBE_ENTRY(cityhash256_crc, s, len);
+
+  uint256_t result = city_hash256_crc(s, len);
+
+  PROBE_RETURN(cityhash256_crc, len);
+
+  return result;
+}
+
+uint256_t cityhash256_crc_stream(const uint8_t* s, size_t len,
+                                 size_t distance) {
+
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_256_CRC, len);
+
+  if (len < 240) {
+    return cityhash256_crc_short(s, len);
+  }
+
+  return cityhash256_crc_long(s, len, 0,
+                              distance ? distance : CITYHASH_STREAM_DISTANCE);
+}
+
 uint128_t cityhash128_crc_with_seed(const uint8_t* s, size_t len,
                                     uint128_t seed) {
 
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_128_CRC_WITH_SEED, len);
+
   if (len <= 900) {
 
-    return cityhash128_with_seed(s, len, seed);
+    return city_hash128_with_seed(s, len, seed);
 
   } else {
 
-    uint256_t hash = cityhash256_crc(s, len);
+    uint256_t hash = city_hash256_crc(s, len);
 
     uint64_t u = seed.b + hash.a;
     uint64_t v = seed.a + hash.b;
@@ -755,12 +1717,14 @@ uint128_t cityhash128_crc_with_seed(const uint8_t* s, size_t len,
 
 uint128_t cityhash128_crc(const uint8_t* s, size_t len) {
 
+  CITYHASH_STATS_RECORD(CITYHASH_STATS_128_CRC, len);
+
   if (len <= 900) {
 
-    return cityhash128(s, len);
+    return city_hash128(s, len);
   } else {
 
-    uint256_t hash = cityhash256_crc(s, len);
+    uint256_t hash = city_hash256_crc(s, len);
     uint128_t result = {hash.c, hash.d};
 
     return result;
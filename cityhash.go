@@ -7,6 +7,8 @@ package cityhash
 import "C"
 
 import (
+  "runtime"
+  "sync"
   "unsafe"
 )
 
@@ -23,3 +25,164 @@ func CityHash32(s []byte) uint32 {
   }
   return uint32(C.cityhash32((*C.uint8_t)(unsafe.Pointer(&s[0])), C.size_t(len(s))))
 }
+
+// Uint128 is a 128-bit hash value or seed, Lo and Hi are the first and the
+// second 64-bit word of the C uint128_t
+type Uint128 struct {
+  Lo uint64
+  Hi uint64
+}
+
+func bytesData(s []byte) *C.uint8_t {
+  if len(s) == 0 {
+    return nil
+  }
+  return (*C.uint8_t)(unsafe.Pointer(&s[0]))
+}
+
+// the string is read in place, no []byte conversion and no copy
+func stringData(s string) *C.uint8_t {
+  if len(s) == 0 {
+    return nil
+  }
+  return (*C.uint8_t)(unsafe.Pointer(unsafe.StringData(s)))
+}
+
+func toUint128(h C.uint128_t) Uint128 {
+  return Uint128{uint64(h.a), uint64(h.b)}
+}
+
+func fromUint128(u Uint128) C.uint128_t {
+  return C.uint128_t{a: C.uint64_t(u.Lo), b: C.uint64_t(u.Hi)}
+}
+
+func CityHash64String(s string) uint64 {
+  return uint64(C.cityhash64(stringData(s), C.size_t(len(s))))
+}
+
+func CityHash32String(s string) uint32 {
+  return uint32(C.cityhash32(stringData(s), C.size_t(len(s))))
+}
+
+func CityHash64WithSeed(s []byte, seed uint64) uint64 {
+  return uint64(C.cityhash64_with_seed(bytesData(s), C.size_t(len(s)), C.uint64_t(seed)))
+}
+
+func CityHash64WithSeedString(s string, seed uint64) uint64 {
+  return uint64(C.cityhash64_with_seed(stringData(s), C.size_t(len(s)), C.uint64_t(seed)))
+}
+
+func CityHash64WithSeeds(s []byte, seed0, seed1 uint64) uint64 {
+  return uint64(C.cityhash64_with_seeds(bytesData(s), C.size_t(len(s)), C.uint64_t(seed0),
+    C.uint64_t(seed1)))
+}
+
+func CityHash64WithSeedsString(s string, seed0, seed1 uint64) uint64 {
+  return uint64(C.cityhash64_with_seeds(stringData(s), C.size_t(len(s)), C.uint64_t(seed0),
+    C.uint64_t(seed1)))
+}
+
+func CityHash128(s []byte) Uint128 {
+  return toUint128(C.cityhash128(bytesData(s), C.size_t(len(s))))
+}
+
+func CityHash128String(s string) Uint128 {
+  return toUint128(C.cityhash128(stringData(s), C.size_t(len(s))))
+}
+
+func CityHash128WithSeed(s []byte, seed Uint128) Uint128 {
+  return toUint128(C.cityhash128_with_seed(bytesData(s), C.size_t(len(s)), fromUint128(seed)))
+}
+
+func CityHash128WithSeedString(s string, seed Uint128) Uint128 {
+  return toUint128(C.cityhash128_with_seed(stringData(s), C.size_t(len(s)), fromUint128(seed)))
+}
+
+// scratch space of CityHash64Batch, reused across batches
+type batchScratch struct {
+  bufs []unsafe.Pointer
+  lens []C.size_t
+  pin  runtime.Pinner
+}
+
+var batchPool = sync.Pool{New: func() interface{} { return new(batchScratch) }}
+
+// CityHash64Batch sets out[i] = CityHash64(keys[i]) for every key with a
+// single cgo call. out must be at least as long as keys. The keys must be Go
+// memory, as they are pinned for the call; keys in foreign memory (mmap'd
+// files, C buffers) go through CityHash64BatchOffsets, or through an array
+// of their addresses built on the C side.
+func CityHash64Batch(keys [][]byte, out []uint64) {
+  n := len(keys)
+  if len(out) < n {
+    panic("cityhash: out is shorter than keys")
+  }
+  if n == 0 {
+    return
+  }
+
+  sc := batchPool.Get().(*batchScratch)
+  if cap(sc.bufs) < n {
+    sc.bufs = make([]unsafe.Pointer, n)
+    sc.lens = make([]C.size_t, n)
+  }
+  bufs, lens := sc.bufs[:n], sc.lens[:n]
+
+  // bufs is Go memory handed to C, so every key it points to is pinned
+  // until the call returns; pinning also moves keys off the caller's stack,
+  // which may be copied before the call is entered. Pinning pins the whole
+  // object, and the capacity of a slice lies within one object, so keys cut
+  // from the last pinned key's backing array are not pinned again.
+  var lo, hi uintptr
+  for i, k := range keys {
+    if len(k) == 0 {
+      bufs[i] = nil
+    } else {
+      bufs[i] = unsafe.Pointer(&k[0])
+      if p := uintptr(bufs[i]); p < lo || p >= hi {
+        sc.pin.Pin(bufs[i])
+        lo, hi = p, p+uintptr(cap(k))
+      }
+    }
+    lens[i] = C.size_t(len(k))
+  }
+
+  C.cityhash64_batch((**C.uint8_t)(unsafe.Pointer(&bufs[0])), &lens[0],
+    C.size_t(n), (*C.uint64_t)(unsafe.Pointer(&out[0])))
+
+  sc.pin.Unpin()
+  // the pool must not keep the keys alive
+  for i := range bufs {
+    bufs[i] = nil
+  }
+  batchPool.Put(sc)
+}
+
+// CityHash64BatchOffsets hashes keys stored back to back in data with a
+// single cgo call: key i is data[offsets[i]:offsets[i+1]], so offsets holds
+// one entry more than there are keys. out must hold len(offsets)-1 entries.
+func CityHash64BatchOffsets(data []byte, offsets []uint32, out []uint64) {
+  if len(offsets) < 2 {
+    return
+  }
+  n := len(offsets) - 1
+  if len(out) < n {
+    panic("cityhash: out is shorter than the number of keys")
+  }
+  for i := 0; i < n; i++ {
+    if offsets[i] > offsets[i+1] {
+      panic("cityhash: offsets are not ascending")
+    }
+  }
+  if int(offsets[n]) > len(data) {
+    panic("cityhash: offsets point past the end of data")
+  }
+
+  var base *C.uint8_t
+  if len(data) > 0 {
+    base = (*C.uint8_t)(unsafe.Pointer(&data[0]))
+  }
+
+  C.cityhash64_batch_offsets(base, (*C.uint32_t)(unsafe.Pointer(&offsets[0])), C.size_t(n),
+    (*C.uint64_t)(unsafe.Pointer(&out[0])))
+}
@@ -94,6 +94,64 @@ uint128_t cityhash128_with_seed(const uint8_t* s, size_t len, uint128_t seed);
 // hash function for a byte array, most useful in 32-bit binaries
 uint32_t cityhash32(const uint8_t* buf, size_t len);
 
+// readable bytes that cityhash64_padded() and cityhash32_padded() may load
+// past the end of their input
+#define CITYHASH_PADDING (16)
+
+// cityhash64() of a byte array followed by at least CITYHASH_PADDING readable
+// bytes, keys of up to 16 bytes are hashed without branching on their length
+uint64_t cityhash64_padded(const uint8_t* buf, size_t len);
+
+// cityhash32() of a byte array followed by at least CITYHASH_PADDING readable
+// bytes, keys of up to 12 bytes are hashed without branching on their length
+uint32_t cityhash32_padded(const uint8_t* buf, size_t len);
+
+// cityhash64() and cityhash32() of the NUL-terminated string s, without the
+// terminator; the length is found with aligned SSE2/AVX2 scans instead of a
+// separate strlen() pass
+uint64_t cityhash64_cstr(const char* s);
+uint32_t cityhash32_cstr(const char* s);
+
+// cityhash64() and cityhash32() of s with ASCII 'A'..'Z' lowercased, without
+// a lowercased copy: words are case-folded as they are loaded
+uint64_t cityhash64_ci(const uint8_t* s, size_t len);
+uint32_t cityhash32_ci(const uint8_t* s, size_t len);
+
+// out[i] = cityhash64_ci(bufs[i], lens[i]) for i < n
+void cityhash64_ci_batch(const uint8_t* const* bufs, const size_t* lens,
+                         size_t n, uint64_t* out);
+
+// cityhash64() of n byte arrays, out[i] = cityhash64(bufs[i], lens[i])
+void cityhash64_batch(const uint8_t* const* bufs, const size_t* lens, size_t n,
+                      uint64_t* out);
+
+// cityhash64() of n byte arrays stored back to back in data, array i is
+// data[offsets[i]] ... data[offsets[i + 1] - 1], offsets has n + 1 entries
+void cityhash64_batch_offsets(const uint8_t* data, const uint32_t* offsets,
+                              size_t n, uint64_t* out);
+
+// cityhash64() of n byte arrays of width bytes stored back to back in data,
+// out[i] = cityhash64(data + i * width, width)
+void cityhash64_batch_fixed(const uint8_t* data, size_t width, size_t n,
+                            uint64_t* out);
+
+// h[i] = hash_128_to_64({h[i], v[i]}) for i < n; with AVX2 four at a time
+void cityhash64_combine(uint64_t* h, const uint64_t* v, size_t n);
+
+// cityhash128() of n byte arrays, out[i] = cityhash128(bufs[i], lens[i]);
+// with AVX2 four keys are hashed at a time
+void cityhash128_batch(const uint8_t* const* bufs, const size_t* lens,
+                       size_t n, uint128_t* out);
+
+// bytes ahead of the current position that the streaming variants prefetch
+// when they are passed a distance of 0
+#define CITYHASH_STREAM_DISTANCE (1024)
+
+// cityhash128() of a large byte array that is read once, the input is
+// prefetched distance bytes ahead with a non-temporal hint so that hashing it
+// does not evict the working set of other threads from shared caches
+uint128_t cityhash128_stream(const uint8_t* s, size_t len, size_t distance);
+
 // hash 128 input bits down to 64 bits of output
 // this is intended to be a reasonably good hash function
 static inline uint64_t hash_128_to_64(const uint128_t x) {
@@ -138,6 +196,11 @@ uint128_t cityhash128_crc_with_seed(const uint8_t* s, size_t len,
 // hash function for a byte array
 uint256_t cityhash256_crc(const uint8_t* s, size_t len);
 
+// cityhash256_crc() of a large byte array that is read once, see
+// cityhash128_stream()
+uint256_t cityhash256_crc_stream(const uint8_t* s, size_t len,
+                                 size_t distance);
+
 #endif
 
 #endif // CITY_HASH_H
@@ -0,0 +1,224 @@
+package cityhash
+
+import (
+	"fmt"
+	"sync/atomic"
+	"testing"
+)
+
+// key lengths for the benchmarks, covering every length class of the C code
+var benchLengths = []int{0, 1, 4, 8, 12, 16, 24, 32, 48, 64, 96, 128, 256, 512, 1024}
+
+// number of keys hashed per iteration of the slice benchmarks
+const benchKeys = 1024
+
+// results are stored here so the calls are not optimized away; the parallel
+// benchmarks add to them atomically, once per goroutine
+var sink64 uint64
+var sink32 uint32
+
+func benchData(n int) []byte {
+	data := make([]byte, n)
+	x := uint64(9)
+	for i := range data {
+		x ^= x << 13
+		x ^= x >> 7
+		x ^= x << 17
+		data[i] = byte(x >> 37)
+	}
+	return data
+}
+
+// benchKeySlice returns benchKeys distinct keys of length n
+func benchKeySlice(n int) [][]byte {
+	data := benchData(n + benchKeys)
+	keys := make([][]byte, benchKeys)
+	for i := range keys {
+		keys[i] = data[i : i+n]
+	}
+	return keys
+}
+
+// one cgo call per iteration
+func BenchmarkCityHash64(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			var h uint64
+			for i := 0; i < b.N; i++ {
+				h += CityHash64(key)
+			}
+			sink64 = h
+		})
+	}
+}
+
+func BenchmarkCityHash32(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			var h uint32
+			for i := 0; i < b.N; i++ {
+				h += CityHash32(key)
+			}
+			sink32 = h
+		})
+	}
+}
+
+// benchKeys distinct keys per iteration, ns/op is per slice
+func BenchmarkCityHash64Slice(b *testing.B) {
+	for _, n := range benchLengths {
+		keys := benchKeySlice(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n * benchKeys))
+			b.ReportAllocs()
+			var h uint64
+			for i := 0; i < b.N; i++ {
+				for _, k := range keys {
+					h += CityHash64(k)
+				}
+			}
+			sink64 = h
+		})
+	}
+}
+
+func BenchmarkCityHash32Slice(b *testing.B) {
+	for _, n := range benchLengths {
+		keys := benchKeySlice(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n * benchKeys))
+			b.ReportAllocs()
+			var h uint32
+			for i := 0; i < b.N; i++ {
+				for _, k := range keys {
+					h += CityHash32(k)
+				}
+			}
+			sink32 = h
+		})
+	}
+}
+
+// single calls from GOMAXPROCS goroutines
+func BenchmarkCityHash64Parallel(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			b.RunParallel(func(pb *testing.PB) {
+				var h uint64
+				for pb.Next() {
+					h += CityHash64(key)
+				}
+				atomic.AddUint64(&sink64, h)
+			})
+		})
+	}
+}
+
+func BenchmarkCityHash32Parallel(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			b.RunParallel(func(pb *testing.PB) {
+				var h uint32
+				for pb.Next() {
+					h += CityHash32(key)
+				}
+				atomic.AddUint32(&sink32, h)
+			})
+		})
+	}
+}
+
+// benchKeys keys per iteration with one cgo call, compare with the Slice
+// benchmarks
+func BenchmarkCityHash64Batch(b *testing.B) {
+	for _, n := range benchLengths {
+		keys := benchKeySlice(n)
+		out := make([]uint64, len(keys))
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n * benchKeys))
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				CityHash64Batch(keys, out)
+			}
+		})
+	}
+}
+
+func BenchmarkCityHash64BatchOffsets(b *testing.B) {
+	for _, n := range benchLengths {
+		data := benchData(n * benchKeys)
+		offsets := make([]uint32, benchKeys+1)
+		for i := range offsets {
+			offsets[i] = uint32(i * n)
+		}
+		out := make([]uint64, benchKeys)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n * benchKeys))
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				CityHash64BatchOffsets(data, offsets, out)
+			}
+		})
+	}
+}
+
+func BenchmarkCityHash64String(b *testing.B) {
+	for _, n := range benchLengths {
+		key := string(benchData(n))
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			var h uint64
+			for i := 0; i < b.N; i++ {
+				h += CityHash64String(key)
+			}
+			sink64 = h
+		})
+	}
+}
+
+func BenchmarkCityHash128(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			var h uint64
+			for i := 0; i < b.N; i++ {
+				h += CityHash128(key).Lo
+			}
+			sink64 = h
+		})
+	}
+}
+
+// Reset, Write and Sum64 of a reused digest
+func BenchmarkDigest64(b *testing.B) {
+	for _, n := range benchLengths {
+		key := benchData(n)
+		d := New64()
+		b.Run(fmt.Sprintf("len=%d", n), func(b *testing.B) {
+			b.SetBytes(int64(n))
+			b.ReportAllocs()
+			var h uint64
+			for i := 0; i < b.N; i++ {
+				d.Reset()
+				d.Write(key)
+				h += d.Sum64()
+			}
+			sink64 = h
+		})
+	}
+}
@@ -0,0 +1,50 @@
+//go:build amd64.v2
+
+package cityhash
+
+// The CRC variants need SSE4.2, which the C code only compiles in when the
+// compiler may use it. cgo applies -msse4.2 to every C file of the package,
+// so this file is only built for GOAMD64=v2 and up, which guarantees it;
+// with the default GOAMD64=v1 the package runs on any x86-64 CPU and has no
+// CRC variants.
+
+/*
+#cgo CFLAGS: -msse4.2
+#include <stdint.h>
+#include "cityhash.h"
+*/
+import "C"
+
+// Uint256 is the result of CityHash256Crc, A to D are the words of the C
+// uint256_t
+type Uint256 struct {
+  A, B, C, D uint64
+}
+
+func CityHash128Crc(s []byte) Uint128 {
+  return toUint128(C.cityhash128_crc(bytesData(s), C.size_t(len(s))))
+}
+
+func CityHash128CrcString(s string) Uint128 {
+  return toUint128(C.cityhash128_crc(stringData(s), C.size_t(len(s))))
+}
+
+func CityHash128CrcWithSeed(s []byte, seed Uint128) Uint128 {
+  return toUint128(C.cityhash128_crc_with_seed(bytesData(s), C.size_t(len(s)), fromUint128(seed)))
+}
+
+func CityHash128CrcWithSeedString(s string, seed Uint128) Uint128 {
+  return toUint128(C.cityhash128_crc_with_seed(stringData(s), C.size_t(len(s)), fromUint128(seed)))
+}
+
+func toUint256(h C.uint256_t) Uint256 {
+  return Uint256{uint64(h.a), uint64(h.b), uint64(h.c), uint64(h.d)}
+}
+
+func CityHash256Crc(s []byte) Uint256 {
+  return toUint256(C.cityhash256_crc(bytesData(s), C.size_t(len(s))))
+}
+
+func CityHash256CrcString(s string) Uint256 {
+  return toUint256(C.cityhash256_crc(stringData(s), C.size_t(len(s))))
+}
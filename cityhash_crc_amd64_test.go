@@ -0,0 +1,32 @@
+//go:build amd64.v2
+
+package cityhash
+
+import (
+	"testing"
+)
+
+func TestCrcEmpty(t *testing.T) {
+	if h := CityHash128Crc(nil); h != (Uint128{0x3df09dfc64c09a2b, 0x3cb540c392e51e29}) {
+		t.Errorf("CityHash128Crc: got %x", h)
+	}
+	if h := CityHash128CrcWithSeed(nil, seed128); h != (Uint128{0x6b56343feac0663, 0x5b7bc50fd8e8ad92}) {
+		t.Errorf("CityHash128CrcWithSeed: got %x", h)
+	}
+	want := Uint256{0x95162f24e6a5f930, 0x6808bdf4f1eb06e0, 0xb3b1f3a67b624d82, 0xc9a62f12bd4cd80b}
+	if h := CityHash256Crc(nil); h != want {
+		t.Errorf("CityHash256Crc: got %x", h)
+	}
+}
+
+func TestCrcStringVariants(t *testing.T) {
+	_, keys, _ := batchTestKeys()
+	for _, k := range keys {
+		s := string(k)
+		if CityHash128CrcString(s) != CityHash128Crc(k) ||
+			CityHash128CrcWithSeedString(s, seed128) != CityHash128CrcWithSeed(k, seed128) ||
+			CityHash256CrcString(s) != CityHash256Crc(k) {
+			t.Error("string and []byte results differ for length", len(k))
+		}
+	}
+}
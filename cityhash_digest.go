@@ -0,0 +1,141 @@
+package cityhash
+
+import (
+  "hash"
+  "math/bits"
+  "sync"
+)
+
+// CityHash is not a streaming hash, so a digest buffers everything written
+// to it and hashes the whole input in Sum64. Buffers come from size class
+// pools and go back to them when a digest outgrows them or is Reset, so
+// long-lived digests that are Reset between inputs do not allocate. The
+// pools hold *[]byte, and a digest keeps the pointer it got, so putting a
+// buffer back does not allocate a new slice header.
+
+const (
+  minBufferShift = 6  // 64 bytes
+  maxBufferShift = 24 // 16 MiB, larger buffers are not pooled
+)
+
+var bufferPools [maxBufferShift + 1]sync.Pool
+
+// getBuffer returns an empty buffer with a capacity of at least n
+func getBuffer(n int) *[]byte {
+  shift := minBufferShift
+  if n > 1<<minBufferShift {
+    shift = bits.Len(uint(n - 1))
+  }
+  if shift > maxBufferShift {
+    b := make([]byte, 0, n)
+    return &b
+  }
+  if b, ok := bufferPools[shift].Get().(*[]byte); ok {
+    *b = (*b)[:0]
+    return b
+  }
+  b := make([]byte, 0, 1<<shift)
+  return &b
+}
+
+// putBuffer returns b to its pool, false if it is not of a pooled size
+func putBuffer(b *[]byte) bool {
+  c := cap(*b)
+  if c < 1<<minBufferShift || c > 1<<maxBufferShift || c&(c-1) != 0 {
+    return false
+  }
+  *b = (*b)[:0]
+  bufferPools[bits.Len(uint(c-1))].Put(b)
+  return true
+}
+
+type digest struct {
+  buf   *[]byte // nil until the first write
+  seeds int     // number of seeds used: 0, 1 or 2
+  seed0 uint64
+  seed1 uint64
+}
+
+// New64 returns a hash.Hash64 computing CityHash64
+func New64() hash.Hash64 {
+  return &digest{}
+}
+
+// New64WithSeed returns a hash.Hash64 computing CityHash64WithSeed
+func New64WithSeed(seed uint64) hash.Hash64 {
+  return &digest{seeds: 1, seed0: seed}
+}
+
+// New64WithSeeds returns a hash.Hash64 computing CityHash64WithSeeds
+func New64WithSeeds(seed0, seed1 uint64) hash.Hash64 {
+  return &digest{seeds: 2, seed0: seed0, seed1: seed1}
+}
+
+// grow makes room for n more bytes
+func (d *digest) grow(n int) {
+  if d.buf == nil {
+    d.buf = getBuffer(n)
+    return
+  }
+  if len(*d.buf)+n > cap(*d.buf) {
+    b := getBuffer(len(*d.buf) + n)
+    *b = append(*b, *d.buf...)
+    putBuffer(d.buf)
+    d.buf = b
+  }
+}
+
+func (d *digest) Write(p []byte) (int, error) {
+  d.grow(len(p))
+  *d.buf = append(*d.buf, p...)
+  return len(p), nil
+}
+
+// WriteString appends s without converting it to a []byte first
+func (d *digest) WriteString(s string) (int, error) {
+  d.grow(len(s))
+  *d.buf = append(*d.buf, s...)
+  return len(s), nil
+}
+
+func (d *digest) Sum64() uint64 {
+  var buf []byte
+  if d.buf != nil {
+    buf = *d.buf
+  }
+  switch d.seeds {
+  case 1:
+    return CityHash64WithSeed(buf, d.seed0)
+  case 2:
+    return CityHash64WithSeeds(buf, d.seed0, d.seed1)
+  }
+  return CityHash64(buf)
+}
+
+// Sum appends the big-endian hash to b
+func (d *digest) Sum(b []byte) []byte {
+  h := d.Sum64()
+  return append(b, byte(h>>56), byte(h>>48), byte(h>>40), byte(h>>32),
+    byte(h>>24), byte(h>>16), byte(h>>8), byte(h))
+}
+
+// Reset returns the buffer to its pool, the next write takes one back out;
+// a buffer too large to be pooled is kept for the next input
+func (d *digest) Reset() {
+  if d.buf == nil {
+    return
+  }
+  if putBuffer(d.buf) {
+    d.buf = nil
+  } else {
+    *d.buf = (*d.buf)[:0]
+  }
+}
+
+func (d *digest) Size() int {
+  return 8
+}
+
+func (d *digest) BlockSize() int {
+  return 64
+}
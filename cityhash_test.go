@@ -40,3 +40,179 @@ func TestCityHash32(t *testing.T) {
 		}
 	}
 }
+
+// keys of every length from 0 to 300 cut out of one pseudorandom buffer
+func batchTestKeys() ([]byte, [][]byte, []uint32) {
+	data := make([]byte, 301*302/2)
+	for i := range data {
+		data[i] = byte(i*131 + i>>7)
+	}
+	keys := make([][]byte, 301)
+	offsets := make([]uint32, 302)
+	off := 0
+	for n := range keys {
+		keys[n] = data[off : off+n]
+		offsets[n] = uint32(off)
+		off += n
+	}
+	offsets[len(keys)] = uint32(off)
+	return data, keys, offsets
+}
+
+func TestCityHash64Batch(t *testing.T) {
+	_, keys, _ := batchTestKeys()
+	out := make([]uint64, len(keys))
+	CityHash64Batch(keys, out)
+	for i, k := range keys {
+		if want := CityHash64(k); out[i] != want {
+			t.Error("For length", len(k), "expected", want, "got", out[i])
+		}
+	}
+}
+
+// keys backed by the caller's stack, with the stack grown by deep calls
+// in between, still hash to the same values
+func TestCityHash64BatchStackKeys(t *testing.T) {
+	var a, b [40]byte
+	for i := range a {
+		a[i] = byte(i)
+		b[i] = byte(3 * i)
+	}
+	out := make([]uint64, 3)
+	for depth := 0; depth < 200; depth += 50 {
+		growStack(depth, func() {
+			CityHash64Batch([][]byte{a[:], b[:7], a[:0]}, out)
+		})
+		if out[0] != CityHash64(a[:]) || out[1] != CityHash64(b[:7]) ||
+			out[2] != CityHash64(nil) {
+			t.Error("stack keys differ at depth", depth)
+		}
+	}
+}
+
+func growStack(depth int, f func()) {
+	var pad [256]byte
+	if depth > 0 {
+		growStack(depth-1, f)
+	} else {
+		f()
+	}
+	pad[0]++
+}
+
+func TestCityHash64BatchOffsets(t *testing.T) {
+	data, keys, offsets := batchTestKeys()
+	out := make([]uint64, len(keys))
+	CityHash64BatchOffsets(data, offsets, out)
+	for i, k := range keys {
+		if want := CityHash64(k); out[i] != want {
+			t.Error("For length", len(k), "expected", want, "got", out[i])
+		}
+	}
+}
+
+// expected values for the empty input, from cityhash-test.c
+var (
+	seed0   uint64 = 1234567
+	seed1   uint64 = 0xc3a5c85c97cb3127
+	seed128        = Uint128{1234567, 0xc3a5c85c97cb3127}
+)
+
+func TestSeededAndWideEmpty(t *testing.T) {
+	if h := CityHash64WithSeed(nil, seed0); h != 0x75106db890237a4a {
+		t.Errorf("CityHash64WithSeed: got %x", h)
+	}
+	if h := CityHash64WithSeeds(nil, seed0, seed1); h != 0x3feac5f636039766 {
+		t.Errorf("CityHash64WithSeeds: got %x", h)
+	}
+	if h := CityHash128(nil); h != (Uint128{0x3df09dfc64c09a2b, 0x3cb540c392e51e29}) {
+		t.Errorf("CityHash128: got %x", h)
+	}
+	if h := CityHash128WithSeed(nil, seed128); h != (Uint128{0x6b56343feac0663, 0x5b7bc50fd8e8ad92}) {
+		t.Errorf("CityHash128WithSeed: got %x", h)
+	}
+}
+
+func TestStringVariants(t *testing.T) {
+	_, keys, _ := batchTestKeys()
+	for _, k := range keys {
+		s := string(k)
+		if CityHash64String(s) != CityHash64(k) ||
+			CityHash32String(s) != CityHash32(k) ||
+			CityHash64WithSeedString(s, seed0) != CityHash64WithSeed(k, seed0) ||
+			CityHash64WithSeedsString(s, seed0, seed1) != CityHash64WithSeeds(k, seed0, seed1) ||
+			CityHash128String(s) != CityHash128(k) ||
+			CityHash128WithSeedString(s, seed128) != CityHash128WithSeed(k, seed128) {
+			t.Error("string and []byte results differ for length", len(k))
+		}
+	}
+}
+
+func TestDigest(t *testing.T) {
+	_, keys, _ := batchTestKeys()
+	d := New64()
+	ds := New64WithSeeds(seed0, seed1)
+	for _, k := range keys {
+		d.Reset()
+		ds.Reset()
+		// write in uneven pieces
+		for i := 0; i < len(k); i += 7 {
+			end := i + 7
+			if end > len(k) {
+				end = len(k)
+			}
+			d.Write(k[i:end])
+			ds.Write(k[i:end])
+		}
+		if d.Sum64() != CityHash64(k) || ds.Sum64() != CityHash64WithSeeds(k, seed0, seed1) {
+			t.Error("digest differs for length", len(k))
+		}
+	}
+}
+
+func TestZeroAllocations(t *testing.T) {
+	if raceEnabled {
+		t.Skip("sync.Pool drops buffers under the race detector")
+	}
+	s := "10F70305-2FA8-45EC-886F-21486263BA69"
+	d := New64()
+	allocs := testing.AllocsPerRun(100, func() {
+		CityHash64String(s)
+		CityHash32String(s)
+		CityHash64WithSeedString(s, seed0)
+		CityHash128String(s)
+		CityHash128WithSeedString(s, seed128)
+		d.Reset()
+		d.(interface{ WriteString(string) (int, error) }).WriteString(s)
+		d.Sum64()
+	})
+	if allocs != 0 {
+		t.Error("expected no allocations, got", allocs)
+	}
+}
+
+// a digest that outgrows its buffer and is Reset hands the buffers back to
+// the pools without allocating
+func TestDigestGrowthAllocations(t *testing.T) {
+	if raceEnabled {
+		t.Skip("sync.Pool drops buffers under the race detector")
+	}
+	small := make([]byte, 100)
+	large := make([]byte, 1000)
+	allocs := testing.AllocsPerRun(100, func() {
+		putBuffer(getBuffer(len(small)))
+	})
+	if allocs != 0 {
+		t.Error("expected no allocations from the buffer pools, got", allocs)
+	}
+	d := New64()
+	allocs = testing.AllocsPerRun(100, func() {
+		d.Reset()
+		d.Write(small)
+		d.Write(large)
+		d.Sum64()
+	})
+	if allocs != 0 {
+		t.Error("expected no allocations, got", allocs)
+	}
+}
@@ -0,0 +1,5 @@
+//go:build !race
+
+package cityhash
+
+const raceEnabled = false
@@ -0,0 +1,7 @@
+//go:build race
+
+package cityhash
+
+// the race detector makes sync.Pool drop a share of the buffers put back,
+// so the pooled paths allocate now and then
+const raceEnabled = true